@@ -0,0 +1,132 @@
+"""
+gen_test_models.py: Produce the tiny stand-in CLIP models that model_test runs OnnxClip on.
+
+The models have the interface of the real ViT-B/32 exports (inputs IMAGE
+[N, 3, 224, 224] float and TEXT [N, L] int64, output OUTPUT [N, 512] float)
+but no weights worth downloading. Instead of an embedding, each output row
+carries a few features of its input that the tests can check, zero padded
+to 512 columns:
+
+    image: mean of channel 0, 1, 2 | N
+    text:  sum of the ids | number of non-zero ids | L | N
+
+N and L are the batch size and sequence length of the run, so a test can tell
+how the rows were batched and whether the sequence length was trimmed. Two
+directories are written, each holding both models under the file names
+OnnxClip loads:
+
+    tiny_clip/          TEXT has a dynamic sequence axis
+    tiny_clip_static/   TEXT is fixed at [N, 77]
+
+Requires the `onnx` and `numpy` packages (pip install onnx numpy). Usage:
+    python gen_test_models.py [<output directory>]
+"""
+
+import os
+import sys
+
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+DEFAULT_OUTPUT = os.path.join(ROOT, "tests", "data")
+
+EMBEDDING_SIZE = 512
+CONTEXT_LENGTH = 77
+OPSET = 17
+
+
+def constant(name, array):
+    return numpy_helper.from_array(np.asarray(array), name)
+
+
+def projection(features):
+    """[features, EMBEDDING_SIZE] weights copying each feature to its own column."""
+    weights = np.zeros((features, EMBEDDING_SIZE), dtype=np.float32)
+    weights[np.arange(features), np.arange(features)] = 1.0
+    return constant("projection", weights)
+
+
+def dimension(input_name, axis, ones, output):
+    """Nodes broadcasting dimension `axis` of `input_name` over the [N, 1] column `ones`."""
+    return [
+        helper.make_node("Shape", [input_name], [output + "_shape"], start=axis, end=axis + 1),
+        helper.make_node("Cast", [output + "_shape"], [output + "_value"], to=TensorProto.FLOAT),
+        helper.make_node("Mul", [ones, output + "_value"], [output]),
+    ]
+
+
+def save(graph, path):
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET)], producer_name="clip_cpp")
+    model.ir_version = 8
+    onnx.checker.check_model(model)
+    onnx.save(model, path)
+
+
+def image_model(path):
+    nodes = [
+        helper.make_node("ReduceMean", ["IMAGE"], ["means"], axes=[2, 3], keepdims=0),
+        helper.make_node("ReduceSum", ["means", "axis_1"], ["means_sum"], keepdims=1),
+        helper.make_node("Mul", ["means_sum", "zero"], ["zeros"]),
+        helper.make_node("Add", ["zeros", "one"], ["ones"]),
+    ]
+    nodes += dimension("IMAGE", 0, "ones", "rows")
+    nodes += [
+        helper.make_node("Concat", ["means", "rows"], ["features"], axis=1),
+        helper.make_node("MatMul", ["features", "projection"], ["OUTPUT"]),
+    ]
+
+    graph = helper.make_graph(
+        nodes, "tiny_clip_image",
+        [helper.make_tensor_value_info("IMAGE", TensorProto.FLOAT, ["N", 3, 224, 224])],
+        [helper.make_tensor_value_info("OUTPUT", TensorProto.FLOAT, ["N", EMBEDDING_SIZE])],
+        [constant("axis_1", np.array([1], dtype=np.int64)),
+         constant("zero", np.array(0.0, dtype=np.float32)),
+         constant("one", np.array(1.0, dtype=np.float32)),
+         projection(4)])
+    save(graph, path)
+
+
+def text_model(path, dynamic_length):
+    nodes = [
+        helper.make_node("Cast", ["TEXT"], ["ids"], to=TensorProto.FLOAT),
+        helper.make_node("ReduceSum", ["ids", "axis_1"], ["id_sum"], keepdims=1),
+        helper.make_node("Greater", ["TEXT", "zero_id"], ["is_token"]),
+        helper.make_node("Cast", ["is_token"], ["token_flags"], to=TensorProto.FLOAT),
+        helper.make_node("ReduceSum", ["token_flags", "axis_1"], ["token_count"], keepdims=1),
+        helper.make_node("Mul", ["id_sum", "zero"], ["zeros"]),
+        helper.make_node("Add", ["zeros", "one"], ["ones"]),
+    ]
+    nodes += dimension("TEXT", 1, "ones", "length")
+    nodes += dimension("TEXT", 0, "ones", "rows")
+    nodes += [
+        helper.make_node("Concat", ["id_sum", "token_count", "length", "rows"], ["features"], axis=1),
+        helper.make_node("MatMul", ["features", "projection"], ["OUTPUT"]),
+    ]
+
+    length = "L" if dynamic_length else CONTEXT_LENGTH
+    graph = helper.make_graph(
+        nodes, "tiny_clip_text",
+        [helper.make_tensor_value_info("TEXT", TensorProto.INT64, ["N", length])],
+        [helper.make_tensor_value_info("OUTPUT", TensorProto.FLOAT, ["N", EMBEDDING_SIZE])],
+        [constant("axis_1", np.array([1], dtype=np.int64)),
+         constant("zero_id", np.array(0, dtype=np.int64)),
+         constant("zero", np.array(0.0, dtype=np.float32)),
+         constant("one", np.array(1.0, dtype=np.float32)),
+         projection(4)])
+    save(graph, path)
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_OUTPUT
+    for name, dynamic_length in (("tiny_clip", True), ("tiny_clip_static", False)):
+        directory = os.path.join(output, name)
+        os.makedirs(directory, exist_ok=True)
+        image_model(os.path.join(directory, "clip_image_model_vitb32.onnx"))
+        text_model(os.path.join(directory, "clip_text_model_vitb32.onnx"), dynamic_length)
+        print("Wrote", directory)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,190 @@
+"""
+gen_tokenizer_reference.py: Produce the reference token ids that tokenizer_bench checks against.
+
+Each line of the corpus is `<category>\\t<text>`. For every line the script writes
+one line of space-separated ids, as returned by SimpleTokenizer().encode(text)
+in OpenAI's CLIP package (no start/end tokens, no padding).
+
+OpenAI's tokenizer is used when `clip` (with its `ftfy` and `regex` dependencies)
+is importable. Otherwise a standard-library port of clip/simple_tokenizer.py is
+used: the pattern classes \\p{L}, \\p{N} and \\s are taken from unicodedata, and
+ftfy.fix_text is approximated by NFC normalisation. The bundled corpus avoids
+text that ftfy would rewrite (curly quotes, ligatures, mojibake), so both paths
+should produce the same ids.
+
+The bundled assets/tokenizer_reference.txt was written by the port, not by
+OpenAI's package. Its pre-tokenizer split matches `regex.findall` with CLIP's
+pattern on every corpus line, but the ids have not been compared with
+`clip` itself. Rerun with `clip` installed for an independent reference.
+
+Usage:
+    python gen_tokenizer_reference.py [<corpus.tsv> [<bpe_simple_vocab_16e6.txt.gz> [<output.txt>]]]
+"""
+
+import gzip
+import html
+import os
+import sys
+import unicodedata
+from functools import lru_cache
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+DEFAULT_CORPUS = os.path.join(ROOT, "assets", "tokenizer_corpus.tsv")
+DEFAULT_VOCAB = os.path.join(ROOT, "src", "data", "bpe_simple_vocab_16e6.txt.gz")
+DEFAULT_OUTPUT = os.path.join(ROOT, "assets", "tokenizer_reference.txt")
+
+CONTRACTIONS = ("'s", "'t", "'re", "'ve", "'m", "'ll", "'d")
+SPECIALS = ("<|startoftext|>", "<|endoftext|>")
+
+
+@lru_cache()
+def bytes_to_unicode():
+    bs = list(range(ord("!"), ord("~") + 1)) + list(range(ord("¡"), ord("¬") + 1)) + list(range(ord("®"), ord("ÿ") + 1))
+    cs = bs[:]
+    n = 0
+    for b in range(2**8):
+        if b not in bs:
+            bs.append(b)
+            cs.append(2**8 + n)
+            n += 1
+    return dict(zip(bs, [chr(n) for n in cs]))
+
+
+def get_pairs(word):
+    return set(zip(word, word[1:]))
+
+
+def is_letter(ch):
+    return unicodedata.category(ch).startswith("L")
+
+
+def is_number(ch):
+    return unicodedata.category(ch).startswith("N")
+
+
+def find_pieces(text):
+    """regex.findall of the CLIP pattern, alternatives tried in order."""
+    pieces = []
+    i = 0
+    while i < len(text):
+        match = next((s for s in SPECIALS + CONTRACTIONS if text.startswith(s, i)), None)
+        if match:
+            pieces.append(match)
+            i += len(match)
+            continue
+
+        ch = text[i]
+        j = i + 1
+        if is_letter(ch):
+            while j < len(text) and is_letter(text[j]):
+                j += 1
+        elif is_number(ch):
+            pass
+        elif not ch.isspace():
+            while j < len(text) and not (text[j].isspace() or is_letter(text[j]) or is_number(text[j])):
+                j += 1
+        else:
+            i = j
+            continue
+        pieces.append(text[i:j])
+        i = j
+    return pieces
+
+
+class PortedTokenizer:
+    """Standard-library copy of clip.simple_tokenizer.SimpleTokenizer.encode."""
+
+    def __init__(self, bpe_path):
+        self.byte_encoder = bytes_to_unicode()
+        merges = gzip.open(bpe_path).read().decode("utf-8").split("\n")
+        merges = merges[1:49152 - 256 - 2 + 1]
+        merges = [tuple(merge.split()) for merge in merges]
+        vocab = list(bytes_to_unicode().values())
+        vocab = vocab + [v + "</w>" for v in vocab]
+        for merge in merges:
+            vocab.append("".join(merge))
+        vocab.extend(SPECIALS)
+        self.encoder = dict(zip(vocab, range(len(vocab))))
+        self.bpe_ranks = dict(zip(merges, range(len(merges))))
+        self.cache = {s: s for s in SPECIALS}
+
+    def bpe(self, token):
+        if token in self.cache:
+            return self.cache[token]
+        word = tuple(token[:-1]) + (token[-1] + "</w>",)
+        pairs = get_pairs(word)
+
+        if not pairs:
+            return token + "</w>"
+
+        while True:
+            bigram = min(pairs, key=lambda pair: self.bpe_ranks.get(pair, float("inf")))
+            if bigram not in self.bpe_ranks:
+                break
+            first, second = bigram
+            new_word = []
+            i = 0
+            while i < len(word):
+                try:
+                    j = word.index(first, i)
+                    new_word.extend(word[i:j])
+                    i = j
+                except ValueError:
+                    new_word.extend(word[i:])
+                    break
+
+                if word[i] == first and i < len(word) - 1 and word[i + 1] == second:
+                    new_word.append(first + second)
+                    i += 2
+                else:
+                    new_word.append(word[i])
+                    i += 1
+            word = tuple(new_word)
+            if len(word) == 1:
+                break
+            pairs = get_pairs(word)
+        word = " ".join(word)
+        self.cache[token] = word
+        return word
+
+    def encode(self, text):
+        text = unicodedata.normalize("NFC", text)
+        text = html.unescape(html.unescape(text)).strip()
+        text = " ".join(text.split()).strip().lower()
+        bpe_tokens = []
+        for token in find_pieces(text):
+            token = "".join(self.byte_encoder[b] for b in token.encode("utf-8"))
+            bpe_tokens.extend(self.encoder[bpe_token] for bpe_token in self.bpe(token).split(" "))
+        return bpe_tokens
+
+
+def load_tokenizer(bpe_path):
+    try:
+        from clip.simple_tokenizer import SimpleTokenizer
+        print("Using OpenAI's clip.simple_tokenizer")
+        return SimpleTokenizer(bpe_path)
+    except ImportError:
+        print("clip is not installed, using the standard-library port")
+        return PortedTokenizer(bpe_path)
+
+
+def main():
+    corpus_path = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_CORPUS
+    bpe_path = sys.argv[2] if len(sys.argv) > 2 else DEFAULT_VOCAB
+    output_path = sys.argv[3] if len(sys.argv) > 3 else DEFAULT_OUTPUT
+
+    tokenizer = load_tokenizer(bpe_path)
+    with open(corpus_path, encoding="utf-8") as corpus, open(output_path, "w", encoding="utf-8") as output:
+        count = 0
+        for line in corpus:
+            line = line.rstrip("\n")
+            if not line:
+                continue
+            _, text = line.split("\t", 1)
+            output.write(" ".join(str(i) for i in tokenizer.encode(text)) + "\n")
+            count += 1
+    print(f"Wrote {count} reference encodings to {output_path}")
+
+
+if __name__ == "__main__":
+    main()
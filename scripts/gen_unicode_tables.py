@@ -0,0 +1,135 @@
+"""
+gen_unicode_tables.py: Generate the code point tables used by the C++ pre-tokenizer.
+
+OpenAI's tokenizer splits text with the `regex` pattern classes \\p{L}, \\p{N}
+and \\s after calling str.lower(). This script dumps those classes from the
+Python unicodedata module into compact sorted range tables so that
+src/inference/pretokenizer.cpp can classify code points without std::regex.
+
+The output header contains:
+- LETTER_RANGES: inclusive [first, last] ranges of general category L*
+- NUMBER_RANGES: inclusive [first, last] ranges of general category N*
+- SPACE_RANGES: inclusive [first, last] ranges where str.isspace() is true
+- CASED_RANGES / CASE_IGNORABLE_RANGES: the properties str.lower() consults to
+  choose the final form of capital sigma
+- LOWER_RUNS: {first, last, delta, stride} runs; a code point c in [first, last]
+  with (c - first) % stride == 0 lowercases to c + delta
+
+Usage:
+    python gen_unicode_tables.py [<output_header>]
+"""
+
+import sys
+import unicodedata
+
+MAX_CODE_POINT = 0x110000
+
+
+def to_ranges(code_points):
+    """Collapse a sorted list of code points into inclusive ranges.
+
+    Args:
+        code_points (list[int]): Sorted code points.
+
+    Returns:
+        list[list[int]]: [first, last] pairs.
+    """
+    ranges = []
+    for c in code_points:
+        if ranges and ranges[-1][1] == c - 1:
+            ranges[-1][1] = c
+        else:
+            ranges.append([c, c])
+    return ranges
+
+
+# Word_Break MidLetter, MidNumLet and Single_Quote code points, which are
+# Case_Ignorable in addition to the Mn, Me, Cf, Lm and Sk categories
+WORD_BREAK_IGNORABLE = {
+    0x0027, 0x002E, 0x003A, 0x00B7, 0x0387, 0x055F, 0x05F4, 0x2018, 0x2019,
+    0x2024, 0x2027, 0xFE13, 0xFE52, 0xFE55, 0xFF07, 0xFF0E, 0xFF1A,
+}
+
+
+def is_cased(ch):
+    """Approximate the Unicode Cased property from the case mappings."""
+    return ch.lower() != ch or ch.upper() != ch or unicodedata.category(ch) == 'Lt'
+
+
+def is_case_ignorable(ch):
+    """Unicode Case_Ignorable property."""
+    return (unicodedata.category(ch) in ('Mn', 'Me', 'Cf', 'Lm', 'Sk') or
+            ord(ch) in WORD_BREAK_IGNORABLE)
+
+
+def lower_runs():
+    """Collapse single code point lowercase mappings into strided runs.
+
+    Mappings that expand to several code points (only U+0130) are left to the
+    C++ code.
+
+    Returns:
+        list[list[int]]: [first, last, delta, stride] runs.
+    """
+    runs = []
+    for c in range(MAX_CODE_POINT):
+        lower = chr(c).lower()
+        if len(lower) != 1 or lower == chr(c):
+            continue
+        delta = ord(lower) - c
+        if runs:
+            first, last, run_delta, stride = runs[-1]
+            if run_delta == delta and first == last and c - last in (1, 2):
+                runs[-1] = [first, c, delta, c - last]
+                continue
+            if run_delta == delta and c - last == stride:
+                runs[-1][1] = c
+                continue
+        runs.append([c, c, delta, 1])
+    return runs
+
+
+def write_ranges(f, name, ranges):
+    f.write(f"static const CodePointRange {name}[] = {{\n")
+    for first, last in ranges:
+        f.write(f"    {{0x{first:05X}, 0x{last:05X}}},\n")
+    f.write("};\n\n")
+
+
+def main():
+    out_path = '../src/inference/unicode_tables.hpp'
+    if len(sys.argv) == 2:
+        out_path = sys.argv[1]
+    elif len(sys.argv) > 2:
+        print("Usage: python gen_unicode_tables.py [<output_header>]")
+        return
+
+    letters = [c for c in range(MAX_CODE_POINT) if unicodedata.category(chr(c)).startswith('L')]
+    numbers = [c for c in range(MAX_CODE_POINT) if unicodedata.category(chr(c)).startswith('N')]
+    spaces = [c for c in range(MAX_CODE_POINT) if chr(c).isspace()]
+    cased = [c for c in range(MAX_CODE_POINT) if is_cased(chr(c))]
+    ignorable = [c for c in range(MAX_CODE_POINT) if is_case_ignorable(chr(c))]
+
+    with open(out_path, 'w') as f:
+        f.write("// Generated by scripts/gen_unicode_tables.py from Unicode "
+                f"{unicodedata.unidata_version}. Do not edit.\n")
+        f.write("#ifndef CLIP_UNICODE_TABLES_H\n#define CLIP_UNICODE_TABLES_H\n\n")
+        f.write("#include <cstdint>\n\n")
+        f.write("struct CodePointRange {\n    char32_t first;\n    char32_t last;\n};\n\n")
+        f.write("struct LowerRun {\n    char32_t first;\n    char32_t last;\n"
+                "    int32_t  delta;\n    int32_t  stride;\n};\n\n")
+        write_ranges(f, "LETTER_RANGES", to_ranges(letters))
+        write_ranges(f, "NUMBER_RANGES", to_ranges(numbers))
+        write_ranges(f, "SPACE_RANGES", to_ranges(spaces))
+        write_ranges(f, "CASED_RANGES", to_ranges(cased))
+        write_ranges(f, "CASE_IGNORABLE_RANGES", to_ranges(ignorable))
+        f.write("static const LowerRun LOWER_RUNS[] = {\n")
+        for first, last, delta, stride in lower_runs():
+            f.write(f"    {{0x{first:05X}, 0x{last:05X}, {delta}, {stride}}},\n")
+        f.write("};\n\n#endif // CLIP_UNICODE_TABLES_H\n")
+
+    print(f"Wrote {out_path}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <bpe_vocab.hpp>
+#include <tokenizer.hpp>
+
+/**
+ * Offline converter: parse the CLIP BPE merges once and write the compiled
+ * vocab image that CLIPTokenizer memory-maps at startup, plus the frozen
+ * word table of the vocabulary's whole words and those of an optional corpus
+ * (one text per line).
+ *
+ * Usage: ./compile_vocab <bpe_simple_vocab_16e6.txt[.gz]> [<output.bin> [<corpus.txt>]]
+ * The default output is BPEVocab::compiled_path() of the input, which is
+ * where BPEVocab::load() looks for it; the word table goes to
+ * WordTable::path_for() of the output.
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cout << "Usage: ./compile_vocab <path/to/bpe_simple_vocab_16e6.txt[.gz]> [<output.bin> [<corpus.txt>]]" << std::endl;
+        return 1;
+    }
+    std::string merges_path = argv[1];
+    std::string output_path = argc >= 3 ? argv[2] : BPEVocab::compiled_path(merges_path);
+
+    try {
+        auto vocab = BPEVocab::from_merges(merges_path);
+        vocab->save(output_path);
+
+        // Check the written file maps back to the same tables
+        auto start = std::chrono::steady_clock::now();
+        auto mapped = BPEVocab::from_compiled(output_path);
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (mapped->size() != vocab->size() || mapped->merges().size() != vocab->merges().size()) {
+            std::cerr << "Compiled vocab does not match its source" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Wrote " << output_path << ": " << vocab->size() << " tokens, "
+                  << vocab->merges().size() << " merges (maps in " << ms << " ms)" << std::endl;
+
+        std::vector<std::string> corpus;
+        if (argc == 4) {
+            std::ifstream file(argv[3]);
+            if (!file) {
+                std::cerr << "Error opening corpus file: " << argv[3] << std::endl;
+                return 1;
+            }
+            for (std::string line; std::getline(file, line);) {
+                corpus.push_back(line);
+            }
+        }
+        std::vector<std::string_view> corpus_views(corpus.begin(), corpus.end());
+
+        CLIPTokenizer tokenizer(mapped, BPECache::Config{0});
+        auto words = tokenizer.build_word_table(corpus_views);
+        std::string words_path = WordTable::path_for(output_path);
+        words->save(words_path);
+        std::cout << "Wrote " << words_path << ": " << words->size() << " words" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#ifndef CLIP_BATCH_SCHEDULER_H
+#define CLIP_BATCH_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Flush policy and counters of a BatchScheduler, shared by all input types
+struct BatchSchedulerConfig {
+    size_t                      max_batch_size {32};
+    std::chrono::microseconds   max_delay {5000};
+};
+
+struct BatchSchedulerStats {
+    uint64_t    requests {0};
+    uint64_t    batches {0};
+    uint64_t    rows {0};               // requests run so far
+    uint64_t    full_batches {0};       // flushed at max_batch_size rather than max_delay
+    uint64_t    failed_batches {0};
+    uint64_t    failed_requests {0};    // by a failed batch or an error of their own
+    size_t      queue_depth {0};        // waiting right now
+    size_t      peak_queue_depth {0};
+    double      total_wait_us {0.0};    // submission to start of the run, summed over rows
+
+    // Mean share of max_batch_size used per run, in [0, 1]
+    double      batch_fill(size_t max_batch_size) const {
+        return batches == 0 ? 0.0 : static_cast<double>(rows) / (batches * max_batch_size);
+    }
+    double      mean_batch_size() const { return batches == 0 ? 0.0 : static_cast<double>(rows) / batches; }
+    double      mean_wait_us() const { return rows == 0 ? 0.0 : total_wait_us / rows; }
+};
+
+/**
+ * Dynamic micro-batching in front of a batched model.
+ *
+ * Callers on any thread submit one input at a time and get a future for its
+ * embedding. A single worker thread collects queued inputs and runs them as
+ * one batch as soon as `max_batch_size` are waiting, or once the oldest has
+ * waited `max_delay`, whichever comes first. Under load batches fill up;
+ * when traffic is light a request waits at most `max_delay` for company.
+ *
+ * The runner gets the inputs of a batch in submission order and writes
+ * inputs.size() x embedding_size floats to `out`. It returns one error
+ * message per input, empty for inputs that succeeded, or no messages at all
+ * if every input did; a request with a message fails with a
+ * std::runtime_error holding it. If the runner throws, every request of that
+ * batch fails with the exception. Destruction runs what is still queued
+ * before returning.
+ */
+template <typename Input>
+class BatchScheduler {
+public:
+    using Runner = std::function<std::vector<std::string>(const std::vector<Input>& inputs, float* out)>;
+
+    using Config = BatchSchedulerConfig;
+    using Stats = BatchSchedulerStats;
+
+    BatchScheduler(size_t embedding_size, Runner runner, const Config& config = {})
+        : embedding_size(embedding_size), runner(std::move(runner)), config(config) {
+        if (embedding_size == 0 || config.max_batch_size == 0) {
+            throw std::invalid_argument("BatchScheduler needs a non-zero embedding and batch size");
+        }
+        worker = std::thread(&BatchScheduler::worker_loop, this);
+    }
+
+    ~BatchScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        worker.join();
+    }
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    // Queue one input; the future holds its embedding_size floats
+    std::future<std::vector<float>> submit(Input input) {
+        Request request {std::move(input), {}, std::chrono::steady_clock::now()};
+        std::future<std::vector<float>> result = request.promise.get_future();
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(request));
+            counters.requests++;
+            counters.peak_queue_depth = std::max(counters.peak_queue_depth, queue.size());
+
+            // The worker waits for a first request, then for a full batch
+            wake = queue.size() == 1 || queue.size() >= config.max_batch_size;
+        }
+        if (wake) {
+            ready.notify_one();
+        }
+        return result;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats current = counters;
+        current.queue_depth = queue.size();
+        return current;
+    }
+
+    const Config&   settings() const { return config; }
+
+private:
+    struct Request {
+        Input                                   input;
+        std::promise<std::vector<float>>        promise;
+        std::chrono::steady_clock::time_point   submitted;
+    };
+
+    void worker_loop() {
+        std::vector<Request> batch;
+        std::vector<Input> inputs;
+        std::vector<float> output;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+
+            // Give the batch until the oldest request's deadline to fill up
+            auto deadline = queue.front().submitted + config.max_delay;
+            ready.wait_until(lock, deadline, [this]() {
+                return stopping || queue.size() >= config.max_batch_size;
+            });
+
+            size_t rows = std::min(queue.size(), config.max_batch_size);
+            auto start = std::chrono::steady_clock::now();
+            batch.clear();
+            for (size_t i = 0; i < rows; ++i) {
+                counters.total_wait_us += std::chrono::duration<double, std::micro>(
+                    start - queue.front().submitted).count();
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            counters.batches++;
+            counters.rows += rows;
+            if (rows == config.max_batch_size) {
+                counters.full_batches++;
+            }
+            lock.unlock();
+
+            inputs.clear();
+            for (Request& request : batch) {
+                inputs.push_back(std::move(request.input));
+            }
+            output.resize(rows * embedding_size);
+
+            std::exception_ptr error;
+            std::vector<std::string> errors;
+            try {
+                errors = runner(inputs, output.data());
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            uint64_t failed = 0;
+            for (size_t i = 0; i < rows; ++i) {
+                if (error) {
+                    batch[i].promise.set_exception(error);
+                    failed++;
+                } else if (i < errors.size() && !errors[i].empty()) {
+                    batch[i].promise.set_exception(std::make_exception_ptr(std::runtime_error(errors[i])));
+                    failed++;
+                } else {
+                    const float* row = output.data() + i * embedding_size;
+                    batch[i].promise.set_value(std::vector<float>(row, row + embedding_size));
+                }
+            }
+
+            lock.lock();
+            if (error) {
+                counters.failed_batches++;
+            }
+            counters.failed_requests += failed;
+        }
+    }
+
+    size_t                          embedding_size;
+    Runner                          runner;
+    Config                          config;
+    std::deque<Request>             queue;
+    Stats                           counters;
+    mutable std::mutex              mutex;
+    std::condition_variable         ready;
+    bool                            stopping {false};
+    std::thread                     worker;             // last: started once the rest is set up
+};
+
+#endif // CLIP_BATCH_SCHEDULER_H
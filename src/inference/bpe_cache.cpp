@@ -0,0 +1,106 @@
+#include "bpe_cache.hpp"
+#include <functional>
+
+/**
+ * Split the budget over the shards. Small budgets use fewer shards so that
+ * every shard can hold at least one entry without exceeding the total.
+ *
+ * @param[in] config Config: entry/byte budget and requested shard count
+ */
+BPECache::BPECache(const Config& config) {
+    shard_count = 1;
+    while (shard_count * 2 <= config.shards) {
+        shard_count *= 2;
+    }
+    while (shard_count > 1 && shard_count > config.max_entries) {
+        shard_count /= 2;
+    }
+
+    shard_max_entries = config.max_entries / shard_count;
+    shard_max_bytes = config.max_bytes / shard_count;
+    shards.reset(new Shard[shard_count]);
+}
+
+size_t BPECache::entry_bytes(size_t key_size, size_t id_count) {
+    // Rough cost of the list node, index slot and the two heap buffers
+    return sizeof(Node) + 64 + key_size + id_count * sizeof(int);
+}
+
+BPECache::Shard& BPECache::shard_for(std::string_view key) {
+    size_t h = std::hash<std::string_view>{}(key);
+    // Mix the high bits in, std::hash may leave the low bits weak
+    return shards[(h ^ (h >> 29)) & (shard_count - 1)];
+}
+
+bool BPECache::lookup(std::string_view key, std::vector<int>& ids) {
+    if (shard_max_entries == 0) {
+        return false;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return false;
+    }
+
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    const std::vector<int>& cached = it->second->ids;
+    ids.insert(ids.end(), cached.begin(), cached.end());
+    return true;
+}
+
+void BPECache::insert(std::string_view key, const int* ids, size_t count) {
+    size_t bytes = entry_bytes(key.size(), count);
+    if (shard_max_entries == 0 || bytes > shard_max_bytes) {
+        return;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have merged the same piece meanwhile
+    if (shard.index.count(key)) {
+        return;
+    }
+
+    while (!shard.lru.empty() &&
+           (shard.lru.size() >= shard_max_entries || shard.bytes + bytes > shard_max_bytes)) {
+        const Node& victim = shard.lru.back();
+        shard.bytes -= entry_bytes(victim.key.size(), victim.ids.size());
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+        ++shard.evictions;
+    }
+
+    shard.lru.push_front(Node{std::string(key), std::vector<int>(ids, ids + count)});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += bytes;
+}
+
+BPECache::Stats BPECache::stats() const {
+    Stats total;
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.evictions += shard.evictions;
+        total.entries += shard.lru.size();
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
+
+void BPECache::clear() {
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
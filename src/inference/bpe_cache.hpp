@@ -0,0 +1,79 @@
+#ifndef CLIP_BPE_CACHE_H
+#define CLIP_BPE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Bounded, thread-safe memo of BPE results: pre-tokenized piece -> token ids.
+ *
+ * Keys are spread over independently locked shards, each evicting its least
+ * recently used entries once it exceeds its share of the entry or byte budget.
+ * Hit, miss and eviction counts are kept per shard and summed on request.
+ */
+class BPECache {
+public:
+    struct Config {
+        size_t      max_entries {1 << 16};  // 0 disables caching
+        size_t      max_bytes {32 << 20};   // keys, ids and per-entry overhead
+        size_t      shards {16};            // rounded down to a power of two
+    };
+
+    struct Stats {
+        uint64_t    hits {0};
+        uint64_t    misses {0};
+        uint64_t    evictions {0};
+        size_t      entries {0};
+        size_t      bytes {0};
+
+        double      hit_rate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    BPECache() : BPECache(Config()) {}
+    explicit BPECache(const Config& config);
+
+    // Append the cached ids of `key` to `ids`; returns false on a miss
+    bool            lookup(std::string_view key, std::vector<int>& ids);
+
+    // Remember `count` ids for `key`, evicting old entries as needed
+    void            insert(std::string_view key, const int* ids, size_t count);
+
+    Stats           stats() const;
+    void            clear();
+
+private:
+    struct Node {
+        std::string         key;
+        std::vector<int>    ids;
+    };
+
+    struct Shard {
+        std::mutex                                      mutex;
+        std::list<Node>                                 lru;    // front is most recent
+        std::unordered_map<std::string_view,
+                           std::list<Node>::iterator>   index;  // views into lru keys
+        size_t                                          bytes {0};
+        uint64_t                                        hits {0};
+        uint64_t                                        misses {0};
+        uint64_t                                        evictions {0};
+    };
+
+    static size_t   entry_bytes(size_t key_size, size_t id_count);
+    Shard&          shard_for(std::string_view key);
+
+    std::unique_ptr<Shard[]>    shards;
+    size_t                      shard_count;
+    size_t                      shard_max_entries;
+    size_t                      shard_max_bytes;
+};
+
+#endif // CLIP_BPE_CACHE_H
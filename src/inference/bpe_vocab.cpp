@@ -0,0 +1,426 @@
+#include "bpe_vocab.hpp"
+#include "content_hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const char       VOCAB_MAGIC[8] = {'C', 'L', 'I', 'P', 'B', 'P', 'E', '\0'};
+static const uint32_t   BYTE_ORDER_MARK = 0x01020304;
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+static std::string utf8_encode(int cp) {
+    std::string out;
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+/**
+ * Port of bytes_to_unicode() in OpenAI's CLIP module: maps every byte to a
+ * printable character so BPE never sees whitespace or control bytes.
+ *
+ * @returns vector<pair<int, str>>: byte -> UTF-8 character, in the order the
+ *              python dict is built (printable bytes first)
+ */
+std::vector<std::pair<int, std::string>> BPEVocab::bytes_to_unicode() {
+    // Ranges of bytes that map to themselves
+    std::vector<int> bs;
+    for (int b = 33; b <= 126; ++b) bs.push_back(b);
+    for (int b = 161; b <= 172; ++b) bs.push_back(b);
+    for (int b = 174; b <= 255; ++b) bs.push_back(b);
+    std::vector<int> cs = bs;
+
+    // Remaining bytes are shifted past 255
+    int n = 0;
+    for (int b = 0; b < 256; ++b) {
+        if (std::find(bs.begin(), bs.end(), b) == bs.end()) {
+            bs.push_back(b);
+            cs.push_back(256 + n);
+            ++n;
+        }
+    }
+
+    std::vector<std::pair<int, std::string>> byte_encoder;
+    for (size_t i = 0; i < bs.size(); ++i) {
+        byte_encoder.push_back({bs[i], utf8_encode(cs[i])});
+    }
+    return byte_encoder;
+}
+
+std::string BPEVocab::compiled_path(const std::string& merges_path) {
+    std::string stem = merges_path;
+    for (const std::string ext : {".gz", ".txt"}) {
+        if (stem.size() > ext.size() && stem.compare(stem.size() - ext.size(), ext.size(), ext) == 0) {
+            stem.erase(stem.size() - ext.size());
+        }
+    }
+    return stem + ".bin";
+}
+
+bool BPEVocab::is_compiled(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(VOCAB_MAGIC)] = {};
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, VOCAB_MAGIC, sizeof(magic)) == 0;
+}
+
+std::shared_ptr<const BPEVocab> BPEVocab::load(const std::string& path) {
+    if (is_compiled(path)) {
+        return from_compiled(path);
+    }
+
+    // Prefer a compiled vocab installed next to the merges file; one left by
+    // an older compile_vocab is ignored rather than fatal
+    std::string compiled = compiled_path(path);
+    if (compiled != path && is_compiled(compiled)) {
+        try {
+            return from_compiled(compiled);
+        } catch (const std::runtime_error&) {
+        }
+    }
+
+    return from_merges(path);
+}
+
+/**
+ * Build the vocabulary from a BPE merges file the same way OpenAI's
+ * SimpleTokenizer does: 256 byte symbols, the same with "</w>", one token per
+ * merge and the two special tokens. zlib reads plain text transparently, so
+ * the shipped .txt.gz needs no separate path.
+ *
+ * @param[in] path str: Path to bpe_simple_vocab_16e6.txt(.gz)
+ */
+std::shared_ptr<const BPEVocab> BPEVocab::from_merges(const std::string& path) {
+    gzFile gz = gzopen(path.c_str(), "rb");
+    if (!gz) {
+        throw std::runtime_error("Error opening vocab file: " + path);
+    }
+
+    std::string text;
+    char chunk[1 << 16];
+    int read;
+    while ((read = gzread(gz, chunk, sizeof(chunk))) > 0) {
+        text.append(chunk, read);
+    }
+    gzclose(gz);
+    if (read < 0) {
+        throw std::runtime_error("Error reading vocab file: " + path);
+    }
+
+    // Waste first line, then take MERGE_COUNT "first second" lines
+    std::vector<std::pair<std::string_view, std::string_view>> merges;
+    std::string_view rest(text);
+    size_t eol = rest.find('\n');
+    rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 1);
+    while (!rest.empty() && merges.size() < MERGE_COUNT) {
+        eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 1);
+
+        size_t space = line.find(' ');
+        if (space == std::string_view::npos) {
+            continue;
+        }
+        std::string_view second = line.substr(space + 1);
+        if (!second.empty() && second.back() == '\r') {
+            second.remove_suffix(1);
+        }
+        merges.push_back({line.substr(0, space), second});
+    }
+
+    // Vocabulary in id order
+    std::vector<std::string> vocab;
+    auto byte_encoder = bytes_to_unicode();
+    for (const auto& v : byte_encoder) {
+        vocab.push_back(v.second);
+    }
+    for (const auto& v : byte_encoder) {
+        vocab.push_back(v.second + "</w>");
+    }
+    for (const auto& merge : merges) {
+        vocab.push_back(std::string(merge.first) + std::string(merge.second));
+    }
+    vocab.push_back("<|startoftext|>");
+    vocab.push_back("<|endoftext|>");
+
+    // Build-time token -> id map; duplicates keep the last id like a python dict
+    std::unordered_map<std::string_view, int> encoder;
+    for (size_t i = 0; i < vocab.size(); ++i) {
+        encoder[vocab[i]] = static_cast<int>(i);
+    }
+
+    MergeTable table;
+    table.reserve(merges.size());
+    for (size_t i = 0; i < merges.size(); ++i) {
+        auto left = encoder.find(merges[i].first);
+        auto right = encoder.find(merges[i].second);
+        auto merged = encoder.find(vocab[512 + i]);
+        if (left == encoder.end() || right == encoder.end()) {
+            continue;
+        }
+        table.insert(left->second, right->second, static_cast<int32_t>(i), merged->second);
+    }
+
+    // Decoded form of every token: symbols mapped back to their bytes, with
+    // "</w>" turned into a flag
+    std::unordered_map<std::string, char> byte_decoder;
+    for (const auto& [b, ch] : byte_encoder) {
+        byte_decoder[ch] = static_cast<char>(b);
+    }
+    const std::string eow = "</w>";
+    std::vector<std::string> decoded(vocab.size());
+    std::vector<bool> end_of_word(vocab.size(), false);
+    for (size_t i = 0; i < vocab.size(); ++i) {
+        std::string_view token = vocab[i];
+        if (token.size() >= eow.size() && token.substr(token.size() - eow.size()) == eow) {
+            token.remove_suffix(eow.size());
+            end_of_word[i] = true;
+        }
+        // Symbols are one or two byte UTF-8 characters
+        for (size_t j = 0; j < token.size();) {
+            size_t len = (static_cast<unsigned char>(token[j]) & 0xE0) == 0xC0 ? 2 : 1;
+            auto it = byte_decoder.find(std::string(token.substr(j, len)));
+            if (it != byte_decoder.end()) {
+                decoded[i] += it->second;
+            } else {
+                decoded[i].append(token.substr(j, len));
+            }
+            j += len;
+        }
+    }
+
+    // Lay out the image
+    const uint32_t n = static_cast<uint32_t>(vocab.size());
+    Header header = {};
+    std::memcpy(header.magic, VOCAB_MAGIC, sizeof(VOCAB_MAGIC));
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = FORMAT_VERSION;
+    header.vocab_size = n;
+    header.merge_count = static_cast<uint32_t>(table.size());
+    header.merge_capacity = table.capacity();
+
+    size_t pos = align8(sizeof(Header));
+    header.offsets_pos = pos;
+    pos = align8(pos + (n + 1) * sizeof(uint32_t));
+    header.sorted_pos = pos;
+    pos = align8(pos + n * sizeof(int32_t));
+    header.merges_pos = pos;
+    pos = align8(pos + table.capacity() * sizeof(MergeTable::Entry));
+    header.arena_pos = pos;
+    for (const auto& token : vocab) {
+        header.arena_size += token.size();
+    }
+    pos = align8(pos + header.arena_size);
+    header.decode_pos = pos;
+    pos = align8(pos + n * sizeof(DecodeEntry));
+    header.decode_arena_pos = pos;
+    for (const auto& bytes : decoded) {
+        header.decode_arena_size += bytes.size();
+    }
+    header.file_size = align8(pos + header.decode_arena_size);
+
+    std::shared_ptr<BPEVocab> result(new BPEVocab());
+    result->owned.assign(header.file_size / sizeof(uint64_t), 0);
+    char* image = reinterpret_cast<char*>(result->owned.data());
+
+    std::memcpy(image, &header, sizeof(Header));
+
+    uint32_t* offsets = reinterpret_cast<uint32_t*>(image + header.offsets_pos);
+    char* arena = image + header.arena_pos;
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        offsets[i] = offset;
+        std::memcpy(arena + offset, vocab[i].data(), vocab[i].size());
+        offset += static_cast<uint32_t>(vocab[i].size());
+    }
+    offsets[n] = offset;
+
+    int32_t* sorted = reinterpret_cast<int32_t*>(image + header.sorted_pos);
+    for (uint32_t i = 0; i < n; ++i) {
+        sorted[i] = static_cast<int32_t>(i);
+    }
+    std::stable_sort(sorted, sorted + n, [&](int32_t a, int32_t b) { return vocab[a] < vocab[b]; });
+
+    std::memcpy(image + header.merges_pos, table.data(), table.capacity() * sizeof(MergeTable::Entry));
+
+    DecodeEntry* decode_table = reinterpret_cast<DecodeEntry*>(image + header.decode_pos);
+    char* decode_arena = image + header.decode_arena_pos;
+    offset = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        decode_table[i] = {offset, static_cast<uint16_t>(decoded[i].size()),
+                           static_cast<uint16_t>(end_of_word[i])};
+        std::memcpy(decode_arena + offset, decoded[i].data(), decoded[i].size());
+        offset += static_cast<uint32_t>(decoded[i].size());
+    }
+
+    result->attach(image, header.file_size);
+    return result;
+}
+
+/**
+ * Map a compiled vocab read-only. Nothing is copied; the kernel shares the
+ * pages with every other process mapping the same file.
+ *
+ * @param[in] path str: Path to a file written by save()
+ */
+std::shared_ptr<const BPEVocab> BPEVocab::from_compiled(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening compiled vocab file: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        throw std::runtime_error("Invalid compiled vocab file: " + path);
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map compiled vocab file: " + path);
+    }
+
+    std::shared_ptr<BPEVocab> result(new BPEVocab());
+    result->mapping = mapping;
+    result->mapping_size = size;
+    try {
+        result->attach(static_cast<const char*>(mapping), size);
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + ": " + path);
+    }
+    return result;
+}
+
+BPEVocab::~BPEVocab() {
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+}
+
+/**
+ * Validate the header of an image and point the accessors into it
+ *
+ * @param[in] image char*: start of the image, 8-byte aligned
+ * @param[in] image_size size_t: bytes available at `image`
+ */
+void BPEVocab::attach(const char* image, size_t image_size) {
+    Header header;
+    std::memcpy(&header, image, sizeof(Header));
+
+    if (std::memcmp(header.magic, VOCAB_MAGIC, sizeof(VOCAB_MAGIC)) != 0) {
+        throw std::runtime_error("Not a compiled vocab file");
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Compiled vocab file has the wrong byte order");
+    }
+    if (header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported compiled vocab version " + std::to_string(header.version));
+    }
+    if (header.file_size != image_size ||
+        header.offsets_pos + (uint64_t(header.vocab_size) + 1) * sizeof(uint32_t) > image_size ||
+        header.sorted_pos + uint64_t(header.vocab_size) * sizeof(int32_t) > image_size ||
+        header.merges_pos + header.merge_capacity * sizeof(MergeTable::Entry) > image_size ||
+        header.arena_pos + header.arena_size > image_size ||
+        header.decode_pos + uint64_t(header.vocab_size) * sizeof(DecodeEntry) > image_size ||
+        header.decode_arena_pos + header.decode_arena_size > image_size) {
+        throw std::runtime_error("Truncated compiled vocab file");
+    }
+
+    vocab_size = header.vocab_size;
+    offsets = reinterpret_cast<const uint32_t*>(image + header.offsets_pos);
+    sorted = reinterpret_cast<const int32_t*>(image + header.sorted_pos);
+    arena = image + header.arena_pos;
+    if (offsets[vocab_size] > header.arena_size) {
+        throw std::runtime_error("Truncated compiled vocab file");
+    }
+    for (uint32_t i = 0; i < vocab_size; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw std::runtime_error("Corrupt compiled vocab file");
+        }
+    }
+    decode_table = reinterpret_cast<const DecodeEntry*>(image + header.decode_pos);
+    decode_arena = image + header.decode_arena_pos;
+    for (uint32_t i = 0; i < vocab_size; ++i) {
+        if (uint64_t(decode_table[i].pos) + decode_table[i].size > header.decode_arena_size) {
+            throw std::runtime_error("Truncated compiled vocab file");
+        }
+    }
+    merge_table.attach(reinterpret_cast<const MergeTable::Entry*>(image + header.merges_pos),
+                       header.merge_capacity, header.merge_count, vocab_size);
+
+    // Resolve the symbols every word starts from
+    for (const auto& [b, ch] : bytes_to_unicode()) {
+        byte_ids[b] = at(ch);
+        byte_eow_ids[b] = at(ch + "</w>");
+    }
+    sot = at("<|startoftext|>");
+    eot = at("<|endoftext|>");
+}
+
+void BPEVocab::save(const std::string& path) const {
+    const char* image = mapping ? static_cast<const char*>(mapping)
+                                : reinterpret_cast<const char*>(owned.data());
+    size_t size = mapping ? mapping_size : owned.size() * sizeof(uint64_t);
+
+    // Write beside the target and rename so processes mapping the old file
+    // keep a consistent view
+    std::string temp_path = path + ".part";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(image, static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("Error writing compiled vocab file: " + temp_path);
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+std::string_view BPEVocab::token(int id) const {
+    if (id < 0 || static_cast<uint32_t>(id) >= vocab_size) {
+        return {};
+    }
+    return std::string_view(arena + offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+/**
+ * Merge count and a hash of every token in id order. Ids follow from both,
+ * so equal fingerprints mean a word encodes to the same ids.
+ */
+BPEVocab::Fingerprint BPEVocab::fingerprint() const {
+    const uint8_t* offset_bytes = reinterpret_cast<const uint8_t*>(offsets);
+    uint64_t h = xxh64(std::span<const uint8_t>(offset_bytes, (uint64_t(vocab_size) + 1) * sizeof(uint32_t)));
+    h = xxh64(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(arena), offsets[vocab_size]), h);
+    return Fingerprint {merge_table.size(), h};
+}
+
+int BPEVocab::find(std::string_view token) const {
+    const int32_t* it = std::lower_bound(sorted, sorted + vocab_size, token,
+                                         [this](int32_t id, std::string_view key) { return this->token(id) < key; });
+    if (it != sorted + vocab_size && this->token(*it) == token) {
+        return *it;
+    }
+    return -1;
+}
+
+int BPEVocab::at(std::string_view token) const {
+    int id = find(token);
+    if (id < 0) {
+        throw std::out_of_range("Token not in vocabulary: " + std::string(token));
+    }
+    return id;
+}
@@ -0,0 +1,147 @@
+#ifndef CLIP_BPE_VOCAB_H
+#define CLIP_BPE_VOCAB_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "merge_table.hpp"
+
+/**
+ * Immutable CLIP BPE vocabulary: token strings, token lookup and merge ranks.
+ *
+ * All tables live in one flat image with the same layout in memory and on
+ * disk. Building from the merges text (plain or gzip) assembles the image on
+ * the heap; a compiled vocab file (see compile_vocab) is memory-mapped as-is,
+ * so loading takes no parsing or hashing and the pages are shared between
+ * processes mapping the same file.
+ *
+ * Compiled files use the native byte order and are rejected on a mismatch.
+ */
+class BPEVocab {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 2;
+
+    // Merges taken from the text file: 49152 - 256 bytes - 2 special tokens
+    static constexpr size_t   MERGE_COUNT = 49152 - 256 - 2;
+
+    // Identifies a vocabulary, so files derived from it (word tables) can be
+    // checked against the vocab they are loaded with
+    struct Fingerprint {
+        uint64_t    merge_count {0};
+        uint64_t    hash {0};       // XXH64 of the token offsets and bytes
+
+        bool        operator==(const Fingerprint&) const = default;
+    };
+
+    /**
+     * Load from `path`. A compiled vocab is mapped directly; merges text is
+     * parsed, unless a compiled file exists at compiled_path(path).
+     */
+    static std::shared_ptr<const BPEVocab>  load(const std::string& path);
+
+    // Parse a merges text file, gzip-compressed or not
+    static std::shared_ptr<const BPEVocab>  from_merges(const std::string& path);
+
+    // Memory-map a file written by save()
+    static std::shared_ptr<const BPEVocab>  from_compiled(const std::string& path);
+
+    // Conventional compiled path for a merges file: "x.txt.gz" -> "x.bin"
+    static std::string                      compiled_path(const std::string& merges_path);
+
+    // True if the file at `path` starts with the compiled vocab magic
+    static bool                             is_compiled(const std::string& path);
+
+    // Byte -> printable unicode string mapping of GPT-2/CLIP, in table order
+    static std::vector<std::pair<int, std::string>> bytes_to_unicode();
+
+    ~BPEVocab();
+    BPEVocab(const BPEVocab&) = delete;
+    BPEVocab& operator=(const BPEVocab&) = delete;
+
+    // Write the image to a compiled vocab file
+    void                save(const std::string& path) const;
+
+    int                 size() const { return static_cast<int>(vocab_size); }
+    std::string_view    token(int id) const;
+
+    // Raw bytes a token decodes to, with bytes_to_unicode() reversed and any
+    // "</w>" suffix stripped; empty for unknown ids
+    std::string_view    token_bytes(int id) const {
+        if (id < 0 || static_cast<uint32_t>(id) >= vocab_size) {
+            return {};
+        }
+        return std::string_view(decode_arena + decode_table[id].pos, decode_table[id].size);
+    }
+    // Whether the token ends a word, i.e. decodes with a trailing space
+    bool                ends_word(int id) const {
+        return id >= 0 && static_cast<uint32_t>(id) < vocab_size && decode_table[id].end_of_word;
+    }
+
+    // Returns the id of `token`, or -1 if it is not in the vocabulary
+    int                 find(std::string_view token) const;
+    // Same as find() but throws std::out_of_range for unknown tokens
+    int                 at(std::string_view token) const;
+
+    const MergeTable&   merges() const { return merge_table; }
+    // Computed on each call, one pass over the token table
+    Fingerprint         fingerprint() const;
+    int                 byte_id(unsigned char b) const { return byte_ids[b]; }
+    int                 byte_eow_id(unsigned char b) const { return byte_eow_ids[b]; }
+    int                 sot_id() const { return sot; }
+    int                 eot_id() const { return eot; }
+
+    // Whether the tables are served from a memory-mapped file
+    bool                is_mapped() const { return mapping != nullptr; }
+
+private:
+    struct Header {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+        uint32_t    vocab_size;
+        uint32_t    merge_count;
+        uint64_t    merge_capacity;
+        uint64_t    offsets_pos;    // uint32_t[vocab_size + 1] into the arena
+        uint64_t    sorted_pos;     // int32_t[vocab_size] ids in token order
+        uint64_t    merges_pos;     // MergeTable::Entry[merge_capacity]
+        uint64_t    arena_pos;      // token bytes
+        uint64_t    arena_size;
+        uint64_t    decode_pos;     // DecodeEntry[vocab_size] into the decode arena
+        uint64_t    decode_arena_pos;
+        uint64_t    decode_arena_size;
+        uint64_t    file_size;
+    };
+
+    struct DecodeEntry {
+        uint32_t    pos;
+        uint16_t    size;
+        uint16_t    end_of_word;
+    };
+
+    BPEVocab() = default;
+
+    // Point the accessors at a validated image
+    void                attach(const char* image, size_t image_size);
+
+    // Image storage: either heap (8-byte aligned) or a read-only mapping
+    std::vector<uint64_t>   owned;
+    void*                   mapping {nullptr};
+    size_t                  mapping_size {0};
+
+    uint32_t                vocab_size {0};
+    const uint32_t*         offsets {nullptr};
+    const int32_t*          sorted {nullptr};
+    const char*             arena {nullptr};
+    const DecodeEntry*      decode_table {nullptr};
+    const char*             decode_arena {nullptr};
+    MergeTable              merge_table;
+
+    int                     byte_ids[256];
+    int                     byte_eow_ids[256];
+    int                     sot {-1};
+    int                     eot {-1};
+};
+
+#endif // CLIP_BPE_VOCAB_H
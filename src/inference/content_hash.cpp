@@ -0,0 +1,82 @@
+#include "content_hash.hpp"
+#include <cstring>
+
+// XXH64 primes
+static const uint64_t   PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t   PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t   PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t   PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t   PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+    return (acc ^ xxh_round(0, value)) * PRIME1 + PRIME4;
+}
+
+/**
+ * Four independent lanes over 32-byte stripes, so the multiplies pipeline
+ * and hashing runs near memory speed
+ *
+ * @param[in] bytes span<uint8_t>: Data to hash
+ * @param[in] seed uint64_t: Seed, 0 for the reference XXH64 values
+ */
+uint64_t xxh64(std::span<const uint8_t> bytes, uint64_t seed) {
+    const uint8_t* p = bytes.data();
+    const uint8_t* end = p + bytes.size();
+    uint64_t h;
+
+    if (bytes.size() >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += bytes.size();
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ xxh_round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,12 @@
+#ifndef CLIP_CONTENT_HASH_H
+#define CLIP_CONTENT_HASH_H
+
+#include <cstdint>
+#include <span>
+
+// XXH64 of `bytes`, a few GB/s. Input is read in the native byte order, so
+// hashes only match across hosts of the same endianness, like the cache
+// files keyed by them
+uint64_t xxh64(std::span<const uint8_t> bytes, uint64_t seed = 0);
+
+#endif // CLIP_CONTENT_HASH_H
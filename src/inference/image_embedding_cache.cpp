@@ -0,0 +1,348 @@
+#include "image_embedding_cache.hpp"
+#include "content_hash.hpp"
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+static const char       EMBEDDINGS_MAGIC[8] = {'C', 'L', 'I', 'P', 'I', 'M', 'G', 'E'};
+static const uint32_t   BYTE_ORDER_MARK = 0x01020304;
+
+static uint64_t model_seed(std::string_view model) {
+    return xxh64(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(model.data()), model.size()));
+}
+
+ImageEmbeddingCache::Key ImageEmbeddingCache::key(std::string_view model, std::span<const uint8_t> encoded) {
+    return Key {xxh64(encoded, model_seed(model)), encoded.size()};
+}
+
+/**
+ * Hash of the pixel rows, seeded with the model and the image's size and
+ * type so equal bytes in another shape do not collide. Rows are hashed one
+ * after another, each seeded with the hash so far, so a view into a larger
+ * image hashes like a packed copy.
+ *
+ * @param[in] model str: Model id
+ * @param[in] image cv::Mat: Decoded image as passed to the model
+ */
+ImageEmbeddingCache::Key ImageEmbeddingCache::key(std::string_view model, const cv::Mat& image) {
+    const int64_t shape[3] = {image.rows, image.cols, image.type()};
+    uint64_t h = xxh64(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(shape), sizeof(shape)),
+                       model_seed(model));
+
+    const size_t row_bytes = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; ++y) {
+        h = xxh64(std::span<const uint8_t>(image.ptr<uint8_t>(y), row_bytes), h);
+    }
+    return Key {h, row_bytes * image.rows};
+}
+
+/**
+ * Split the memory budget over the shards and open the disk tier, if any
+ *
+ * @param[in] dim size_t: Floats per embedding
+ * @param[in] config Config: Memory budget, shard count and disk directory
+ */
+ImageEmbeddingCache::ImageEmbeddingCache(size_t dim, const Config& config) : embedding_dim(dim) {
+    if (dim == 0) {
+        throw std::invalid_argument("Image embedding cache needs a non-zero dimension.");
+    }
+
+    shard_count = 1;
+    while (shard_count * 2 <= config.shards) {
+        shard_count *= 2;
+    }
+    // Keep shards big enough for a few dozen embeddings each
+    while (shard_count > 1 && config.max_bytes / shard_count < 32 * entry_bytes()) {
+        shard_count /= 2;
+    }
+    shard_max_bytes = config.max_bytes / shard_count;
+    shards.reset(new Shard[shard_count]);
+
+    if (!config.directory.empty()) {
+        std::filesystem::create_directories(config.directory);
+        try {
+            open_disk((std::filesystem::path(config.directory) / "embeddings.bin").string());
+        } catch (...) {
+            close_disk();
+            throw;
+        }
+        disk_enabled = true;
+    }
+}
+
+ImageEmbeddingCache::~ImageEmbeddingCache() {
+    close_disk();
+}
+
+size_t ImageEmbeddingCache::entry_bytes() const {
+    // Rough cost of the list node, index slot and the embedding buffer
+    return sizeof(Node) + 64 + embedding_dim * sizeof(float);
+}
+
+ImageEmbeddingCache::Shard& ImageEmbeddingCache::shard_for(const Key& key) const {
+    return shards[(key.hash ^ (key.hash >> 29)) & (shard_count - 1)];
+}
+
+bool ImageEmbeddingCache::lookup(const Key& key, float* out) {
+    if (memory_lookup(key, out)) {
+        memory_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (disk_enabled.load(std::memory_order_relaxed)) {
+        try {
+            if (disk_lookup(key, out)) {
+                disk_hits.fetch_add(1, std::memory_order_relaxed);
+                memory_insert(key, out);
+                return true;
+            }
+        } catch (const std::exception& e) {
+            disable_disk(e);
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ImageEmbeddingCache::insert(const Key& key, const float* embedding) {
+    memory_insert(key, embedding);
+    if (disk_enabled.load(std::memory_order_relaxed)) {
+        try {
+            disk_insert(key, embedding);
+        } catch (const std::exception& e) {
+            disable_disk(e);
+        }
+    }
+    inserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Stop using the disk tier after an I/O error, so a full or failing disk
+ * costs the cache its second tier rather than the caller its embeddings.
+ * The file stays open until destruction for lookups already in flight. A
+ * record slot reserved by the failed write is never indexed; on the next
+ * open it reads back as size 0, or as a torn tail that is cut off.
+ */
+void ImageEmbeddingCache::disable_disk(const std::exception& error) {
+    disk_errors.fetch_add(1, std::memory_order_relaxed);
+    if (disk_enabled.exchange(false)) {
+        spdlog::warn("Image embedding cache: {} Disk tier disabled.", error.what());
+    }
+}
+
+bool ImageEmbeddingCache::memory_lookup(const Key& key, float* out) {
+    if (shard_max_bytes == 0) {
+        return false;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    std::memcpy(out, it->second->embedding.data(), embedding_dim * sizeof(float));
+    return true;
+}
+
+void ImageEmbeddingCache::memory_insert(const Key& key, const float* embedding) {
+    size_t bytes = entry_bytes();
+    if (bytes > shard_max_bytes) {
+        return;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.index.count(key)) {
+        return;
+    }
+
+    while (!shard.lru.empty() && shard.bytes + bytes > shard_max_bytes) {
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+        shard.bytes -= bytes;
+        ++shard.evictions;
+    }
+
+    shard.lru.push_front(Node{key, std::vector<float>(embedding, embedding + embedding_dim)});
+    shard.index.emplace(key, shard.lru.begin());
+    shard.bytes += bytes;
+}
+
+/**
+ * Open or create the embeddings file, check its dimension and index every
+ * complete record. A torn record at the end, from an interrupted write, is
+ * cut off so the next append starts on a record boundary again; slots
+ * reserved but never written read back as size 0 and are skipped.
+ */
+void ImageEmbeddingCache::open_disk(const std::string& path) {
+    disk_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (disk_fd < 0) {
+        throw std::runtime_error("Error opening image embedding cache: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(disk_fd, &st) != 0) {
+        throw std::runtime_error("Error reading image embedding cache: " + path);
+    }
+
+    Header header {};
+    if (st.st_size == 0) {
+        std::memcpy(header.magic, EMBEDDINGS_MAGIC, sizeof(EMBEDDINGS_MAGIC));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.version = FORMAT_VERSION;
+        header.dim = embedding_dim;
+        if (::pwrite(disk_fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header))) {
+            throw std::runtime_error("Error writing image embedding cache: " + path);
+        }
+        return;
+    }
+
+    if (::pread(disk_fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header)) ||
+        std::memcmp(header.magic, EMBEDDINGS_MAGIC, sizeof(EMBEDDINGS_MAGIC)) != 0) {
+        throw std::runtime_error("Not an image embedding cache: " + path);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK || header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Image embedding cache has the wrong byte order or version: " + path);
+    }
+    if (header.dim != embedding_dim) {
+        throw std::runtime_error("Image embedding cache holds " + std::to_string(header.dim) +
+                                 "-float embeddings: " + path);
+    }
+
+    uint64_t payload = static_cast<uint64_t>(st.st_size) - sizeof(Header);
+    record_count = payload / record_size();
+    if (payload % record_size() != 0 &&
+        ::ftruncate(disk_fd, static_cast<off_t>(sizeof(Header) + record_count * record_size())) != 0) {
+        throw std::runtime_error("Error repairing image embedding cache: " + path);
+    }
+    if (record_count == 0) {
+        return;
+    }
+
+    remap(record_count);
+    records.reserve(record_count);
+    for (uint64_t record = 0; record < record_count; ++record) {
+        uint64_t entry[2];
+        std::memcpy(entry, mapping + sizeof(Header) + record * record_size(), sizeof(entry));
+        if (entry[1] != 0) {
+            records[Key {entry[0], entry[1]}] = record;
+        }
+    }
+}
+
+void ImageEmbeddingCache::close_disk() {
+    if (mapping) {
+        ::munmap(const_cast<uint8_t*>(mapping), mapping_size);
+        mapping = nullptr;
+    }
+    if (disk_fd >= 0) {
+        ::close(disk_fd);
+        disk_fd = -1;
+    }
+}
+
+void ImageEmbeddingCache::remap(uint64_t records_needed) {
+    size_t needed = sizeof(Header) + records_needed * record_size();
+    if (mapping_size >= needed) {
+        return;
+    }
+
+    struct stat st;
+    if (::fstat(disk_fd, &st) != 0 || static_cast<size_t>(st.st_size) < needed) {
+        throw std::runtime_error("Image embedding cache is shorter than its index.");
+    }
+
+    // Map everything written so far, so later lookups rarely need to remap
+    void* fresh = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, disk_fd, 0);
+    if (fresh == MAP_FAILED) {
+        throw std::runtime_error("Failed to map image embedding cache.");
+    }
+    if (mapping) {
+        ::munmap(const_cast<uint8_t*>(mapping), mapping_size);
+    }
+    mapping = static_cast<const uint8_t*>(fresh);
+    mapping_size = static_cast<size_t>(st.st_size);
+}
+
+bool ImageEmbeddingCache::disk_lookup(const Key& key, float* out) {
+    const size_t floats_offset = 2 * sizeof(uint64_t);
+    uint64_t record;
+    {
+        std::shared_lock<std::shared_mutex> lock(disk_mutex);
+        auto it = records.find(key);
+        if (it == records.end()) {
+            return false;
+        }
+        record = it->second;
+        if (sizeof(Header) + (record + 1) * record_size() <= mapping_size) {
+            std::memcpy(out, mapping + sizeof(Header) + record * record_size() + floats_offset,
+                        embedding_dim * sizeof(float));
+            return true;
+        }
+    }
+
+    // Written since the file was last mapped
+    std::unique_lock<std::shared_mutex> lock(disk_mutex);
+    remap(record + 1);
+    std::memcpy(out, mapping + sizeof(Header) + record * record_size() + floats_offset,
+                embedding_dim * sizeof(float));
+    return true;
+}
+
+/**
+ * The record slot is reserved under the lock but written outside it, so
+ * concurrent inserts do not serialise on I/O. The record becomes visible to
+ * lookups only once it is in the file.
+ */
+void ImageEmbeddingCache::disk_insert(const Key& key, const float* embedding) {
+    uint64_t record;
+    {
+        std::unique_lock<std::shared_mutex> lock(disk_mutex);
+        if (records.count(key)) {
+            return;
+        }
+        record = record_count++;
+    }
+
+    std::vector<uint8_t> data(record_size());
+    const uint64_t entry[2] = {key.hash, key.size};
+    std::memcpy(data.data(), entry, sizeof(entry));
+    std::memcpy(data.data() + sizeof(entry), embedding, embedding_dim * sizeof(float));
+
+    off_t offset = static_cast<off_t>(sizeof(Header) + record * record_size());
+    if (::pwrite(disk_fd, data.data(), data.size(), offset) != static_cast<ssize_t>(data.size())) {
+        throw std::runtime_error("Error writing image embedding cache.");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(disk_mutex);
+    records.emplace(key, record);   // a concurrent duplicate keeps the first record
+}
+
+ImageEmbeddingCache::Stats ImageEmbeddingCache::stats() const {
+    Stats stats;
+    stats.memory_hits = memory_hits.load(std::memory_order_relaxed);
+    stats.disk_hits = disk_hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.inserts = inserts.load(std::memory_order_relaxed);
+    stats.disk_errors = disk_errors.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.evictions += shard.evictions;
+        stats.entries += shard.lru.size();
+        stats.bytes += shard.bytes;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(disk_mutex);
+    stats.disk_entries = records.size();
+    return stats;
+}
@@ -0,0 +1,156 @@
+#ifndef CLIP_IMAGE_EMBEDDING_CACHE_H
+#define CLIP_IMAGE_EMBEDDING_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Cache of image embeddings keyed by a content hash, so a duplicate image
+ * skips preprocessing and the model run entirely.
+ *
+ * Keys are XXH64 of the encoded bytes when the caller has them, otherwise of
+ * the raw pixels together with the image's size and type, seeded with the
+ * model id. The same asset under different URLs or paths therefore hits,
+ * while the two kinds of keys never collide with each other or across models.
+ *
+ * The memory tier is a sharded LRU bounded by a byte budget, like
+ * TextEmbeddingCache. With a directory, every insert is also appended to
+ * `embeddings.bin` there: a header, then (hash, size, floats) records. The
+ * file is memory-mapped and indexed on open, and a disk hit is promoted into
+ * memory. The disk tier is not bounded; delete the file to reset it. It is
+ * optional: an I/O error reading or writing it is logged and switches it
+ * off for the rest of the cache's life, and the call goes on as a miss or a
+ * memory-only insert. All methods are thread-safe; only one process should
+ * write to a directory at a time. Files use the native byte order and are
+ * rejected on a mismatch.
+ */
+class ImageEmbeddingCache {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct Key {
+        uint64_t    hash {0};
+        uint64_t    size {0};       // input length in bytes
+
+        bool        operator==(const Key& other) const { return hash == other.hash && size == other.size; }
+    };
+
+    struct Config {
+        size_t      max_bytes {256 << 20};  // memory tier: embeddings and per-entry overhead; 0 disables
+        size_t      shards {16};            // rounded down to a power of two
+        std::string directory;              // disk tier; empty for memory only
+    };
+
+    struct Stats {
+        uint64_t    memory_hits {0};
+        uint64_t    disk_hits {0};
+        uint64_t    misses {0};
+        uint64_t    inserts {0};
+        uint64_t    evictions {0};          // from the memory tier
+        size_t      entries {0};            // in memory
+        size_t      bytes {0};
+        size_t      disk_entries {0};
+        uint64_t    disk_errors {0};        // the disk tier is off after the first
+
+        double      hit_rate() const {
+            uint64_t hits = memory_hits + disk_hits;
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    // Keys of an encoded image and of decoded pixels, for embeddings of `model`
+    static Key      key(std::string_view model, std::span<const uint8_t> encoded);
+    static Key      key(std::string_view model, const cv::Mat& image);
+
+    /**
+     * Cache embeddings of `dim` floats. An existing disk tier written for
+     * another dimension is rejected with std::runtime_error.
+     */
+    explicit ImageEmbeddingCache(size_t dim) : ImageEmbeddingCache(dim, Config()) {}
+    ImageEmbeddingCache(size_t dim, const Config& config);
+    ~ImageEmbeddingCache();
+    ImageEmbeddingCache(const ImageEmbeddingCache&) = delete;
+    ImageEmbeddingCache& operator=(const ImageEmbeddingCache&) = delete;
+
+    // Copy the dim() floats stored for `key` to `out`; returns false on a miss
+    bool            lookup(const Key& key, float* out);
+
+    // Store an embedding in memory and, with a directory, on disk
+    void            insert(const Key& key, const float* embedding);
+
+    size_t          dim() const { return embedding_dim; }
+    Stats           stats() const;
+
+private:
+    struct Header {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+        uint64_t    dim;
+        char        padding[8];     // records start 32-byte aligned
+    };
+
+    struct KeyHash {
+        size_t      operator()(const Key& key) const { return key.hash; }
+    };
+
+    struct Node {
+        Key                 key;
+        std::vector<float>  embedding;
+    };
+
+    struct Shard {
+        std::mutex                                                  mutex;
+        std::list<Node>                                             lru;    // front is most recent
+        std::unordered_map<Key, std::list<Node>::iterator, KeyHash> index;
+        size_t                                                      bytes {0};
+        uint64_t                                                    evictions {0};
+    };
+
+    size_t          entry_bytes() const;
+    size_t          record_size() const { return 2 * sizeof(uint64_t) + embedding_dim * sizeof(float); }
+    Shard&          shard_for(const Key& key) const;
+    bool            memory_lookup(const Key& key, float* out);
+    void            memory_insert(const Key& key, const float* embedding);
+
+    // Disk tier, see PixelCache for the same scheme
+    void            open_disk(const std::string& path);
+    void            close_disk();
+    bool            disk_lookup(const Key& key, float* out);
+    void            disk_insert(const Key& key, const float* embedding);
+    void            remap(uint64_t records);    // caller holds disk_mutex exclusively
+    void            disable_disk(const std::exception& error);
+
+    size_t                                      embedding_dim;
+    std::unique_ptr<Shard[]>                    shards;
+    size_t                                      shard_count;
+    size_t                                      shard_max_bytes;
+
+    int                                         disk_fd {-1};
+    std::atomic<bool>                           disk_enabled {false};
+    const uint8_t*                              mapping {nullptr};
+    size_t                                      mapping_size {0};
+    uint64_t                                    record_count {0};   // next record to write
+    std::unordered_map<Key, uint64_t, KeyHash>  records;
+    mutable std::shared_mutex                   disk_mutex;
+
+    std::atomic<uint64_t>                       memory_hits {0};
+    std::atomic<uint64_t>                       disk_hits {0};
+    std::atomic<uint64_t>                       misses {0};
+    std::atomic<uint64_t>                       inserts {0};
+    std::atomic<uint64_t>                       disk_errors {0};
+};
+
+#endif // CLIP_IMAGE_EMBEDDING_CACHE_H
@@ -0,0 +1,705 @@
+#include "image_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CLIP_KERNELS_X86 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CLIP_KERNELS_NEON 1
+#endif
+
+/**
+ * One output row of normalize_to_chw. `order[c]` is the source channel of
+ * plane c; the affine `x * scale + bias` folds the /255, -mean and /std.
+ */
+using NormalizeRow = void (*)(const uint8_t* src, int width, const int order[3],
+                              const float scale[3], const float bias[3], float* const planes[3]);
+
+static void normalize_row_scalar(const uint8_t* src, int width, const int order[3],
+                                 const float scale[3], const float bias[3], float* const planes[3]) {
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* px = src + 3 * x;
+        for (int c = 0; c < 3; ++c) {
+            planes[c][x] = px[order[c]] * scale[c] + bias[c];
+        }
+    }
+}
+
+#if CLIP_KERNELS_X86
+/**
+ * Eight pixels (24 bytes) per step: two loads, one pshufb pair per channel to
+ * gather its eight bytes, widen to int32, convert and fused multiply-add.
+ */
+__attribute__((target("avx2,fma")))
+static void normalize_row_avx2(const uint8_t* src, int width, const int order[3],
+                               const float scale[3], const float bias[3], float* const planes[3]) {
+    // Byte k + 3i of the 24 comes from the low load below 16, else the high one
+    alignas(16) int8_t masks[3][2][16];
+    for (int k = 0; k < 3; ++k) {
+        for (int i = 0; i < 16; ++i) {
+            int pos = k + 3 * i;
+            masks[k][0][i] = i < 8 && pos < 16 ? static_cast<int8_t>(pos) : -1;
+            masks[k][1][i] = i < 8 && pos >= 16 ? static_cast<int8_t>(pos - 16) : -1;
+        }
+    }
+
+    __m128i lo_mask[3], hi_mask[3];
+    __m256 scale_v[3], bias_v[3];
+    for (int c = 0; c < 3; ++c) {
+        lo_mask[c] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks[order[c]][0]));
+        hi_mask[c] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks[order[c]][1]));
+        scale_v[c] = _mm256_set1_ps(scale[c]);
+        bias_v[c] = _mm256_set1_ps(bias[c]);
+    }
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint8_t* px = src + 3 * x;
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px));
+        __m128i hi = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(px + 16));
+        for (int c = 0; c < 3; ++c) {
+            __m128i bytes = _mm_or_si128(_mm_shuffle_epi8(lo, lo_mask[c]), _mm_shuffle_epi8(hi, hi_mask[c]));
+            __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+            _mm256_storeu_ps(planes[c] + x, _mm256_fmadd_ps(values, scale_v[c], bias_v[c]));
+        }
+    }
+
+    float* tail[3] = {planes[0] + x, planes[1] + x, planes[2] + x};
+    normalize_row_scalar(src + 3 * x, width - x, order, scale, bias, tail);
+}
+#endif
+
+#if CLIP_KERNELS_NEON
+static void normalize_row_neon(const uint8_t* src, int width, const int order[3],
+                               const float scale[3], const float bias[3], float* const planes[3]) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        // vld3 deinterleaves the eight pixels into one register per channel
+        uint8x8x3_t px = vld3_u8(src + 3 * x);
+        for (int c = 0; c < 3; ++c) {
+            uint16x8_t wide = vmovl_u8(px.val[order[c]]);
+            float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+            float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(wide)));
+            float32x4_t scale_v = vdupq_n_f32(scale[c]);
+            float32x4_t bias_v = vdupq_n_f32(bias[c]);
+            vst1q_f32(planes[c] + x, vmlaq_f32(bias_v, lo, scale_v));
+            vst1q_f32(planes[c] + x + 4, vmlaq_f32(bias_v, hi, scale_v));
+        }
+    }
+
+    float* tail[3] = {planes[0] + x, planes[1] + x, planes[2] + x};
+    normalize_row_scalar(src + 3 * x, width - x, order, scale, bias, tail);
+}
+#endif
+
+// Fixed-point precision of the resize weights, as in Pillow's Resample.c
+static const int RESIZE_PRECISION_BITS = 32 - 8 - 2;
+
+// The SIMD passes multiply bytes by 16-bit halves of each weight,
+// w = hi * 2^11 + lo, and recombine exactly in 32 bits
+static const int RESIZE_SPLIT_BITS = 11;
+
+// Source rows filtered per horizontal call, so each output's weights are
+// loaded once for several rows
+static const int RESIZE_ROW_BLOCK = 4;
+
+/**
+ * Horizontal pass over `rows` (at most RESIZE_ROW_BLOCK) source rows with
+ * `channels` bytes per pixel, writing 3 bytes per output. One vertical pass
+ * combines `count` filtered rows into one output row of `bytes` bytes.
+ */
+using ResizeHorizontal = void (*)(const uint8_t* const* src, uint8_t* const* dst, int rows,
+                                  int channels, const ResizePlan::Taps& taps, int width);
+using ResizeVertical = void (*)(const uint8_t* const* lines, const ResizePlan::Taps& taps, int index,
+                                size_t bytes, uint8_t* dst);
+
+static double bicubic_filter(double x) {
+    const double a = -0.5;
+    x = std::fabs(x);
+    if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    }
+    if (x < 2.0) {
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+    }
+    return 0.0;
+}
+
+/**
+ * Taps of the outputs [first, first + count) of a 1-D resize from in_size to
+ * out_size samples of `channels` bytes each
+ */
+static ResizePlan::Taps compute_taps(int in_size, int out_size, int first, int count, int channels) {
+    const double scale = static_cast<double>(in_size) / out_size;
+    const double filter_scale = std::max(scale, 1.0);
+    const double support = 2.0 * filter_scale;
+
+    ResizePlan::Taps taps;
+    taps.ksize = static_cast<int>(std::ceil(support)) * 2 + 1;
+    taps.groups = (taps.ksize + 3) / 4;
+    taps.start.resize(count);
+    taps.count.resize(count);
+    taps.weights.assign(static_cast<size_t>(count) * taps.ksize, 0);
+    taps.packed.assign(static_cast<size_t>(count) * taps.groups * 32, 0);
+    taps.pairs.assign(static_cast<size_t>(count) * taps.pair_count() * 2, 0);
+
+    std::vector<double> kernel(taps.ksize);
+    for (int i = 0; i < count; ++i) {
+        double center = (first + i + 0.5) * scale;
+        int lo = std::max(static_cast<int>(center - support + 0.5), 0);
+        int hi = std::min(static_cast<int>(center + support + 0.5), in_size);
+
+        double total = 0.0;
+        for (int k = 0; k < hi - lo; ++k) {
+            kernel[k] = bicubic_filter((k + lo - center + 0.5) / filter_scale);
+            total += kernel[k];
+        }
+
+        int32_t* weights = taps.weights.data() + static_cast<size_t>(i) * taps.ksize;
+        for (int k = 0; k < hi - lo; ++k) {
+            double w = (total != 0.0 ? kernel[k] / total : kernel[k]) * (1 << RESIZE_PRECISION_BITS);
+            weights[k] = static_cast<int32_t>(w < 0.0 ? w - 0.5 : w + 0.5);
+        }
+        taps.start[i] = lo;
+        taps.count[i] = hi - lo;
+
+        // Per group of four taps, a low-half and a high-half vector of 16
+        // int16: 128-bit lane l holds taps 2l and 2l + 1 as (tap, tap + 1)
+        // pairs for channels 0-2, then a zero pair
+        int16_t* packed = taps.packed.data() + static_cast<size_t>(i) * taps.groups * 32;
+        for (int k = 0; k < hi - lo; ++k) {
+            int group = k / 4;
+            int lane = (k % 4) / 2;
+            int t = k % 2;
+            for (int c = 0; c < 3; ++c) {
+                int j = group * 32 + lane * 8 + c * 2 + t;
+                packed[j] = static_cast<int16_t>(weights[k] & ((1 << RESIZE_SPLIT_BITS) - 1));
+                packed[j + 16] = static_cast<int16_t>(weights[k] >> RESIZE_SPLIT_BITS);
+            }
+        }
+
+        // Per tap pair, the low halves of (tap, tap + 1) as two int16 in one
+        // int32, then the high halves likewise
+        int32_t* pairs = taps.pairs.data() + static_cast<size_t>(i) * taps.pair_count() * 2;
+        for (int k = 0; k < hi - lo; ++k) {
+            uint32_t low = static_cast<uint32_t>(weights[k]) & ((1u << RESIZE_SPLIT_BITS) - 1);
+            uint32_t high = static_cast<uint32_t>(weights[k] >> RESIZE_SPLIT_BITS) & 0xFFFF;
+            int shift = 16 * (k % 2);
+            pairs[k - k % 2] = static_cast<int32_t>(static_cast<uint32_t>(pairs[k - k % 2]) | (low << shift));
+            pairs[k - k % 2 + 1] = static_cast<int32_t>(static_cast<uint32_t>(pairs[k - k % 2 + 1]) | (high << shift));
+        }
+    }
+
+    // The SIMD pass reads 16 bytes per group; outputs near the end of the row
+    // would read past it
+    while (taps.simd_count < count) {
+        int i = taps.simd_count;
+        int groups = (taps.count[i] + 3) / 4;
+        if ((taps.start[i] + 4 * (groups - 1)) * channels + 16 > in_size * channels) {
+            break;
+        }
+        ++taps.simd_count;
+    }
+    return taps;
+}
+
+static inline uint8_t clip_fixed(int32_t value) {
+    value >>= RESIZE_PRECISION_BITS;
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static void resize_outputs_scalar(const uint8_t* src, int channels, const ResizePlan::Taps& taps,
+                                  int first, int last, uint8_t* dst) {
+    for (int x = first; x < last; ++x) {
+        const uint8_t* px = src + channels * taps.start[x];
+        const int32_t* weights = taps.weights.data() + static_cast<size_t>(x) * taps.ksize;
+        int32_t acc[3] = {1 << (RESIZE_PRECISION_BITS - 1), 1 << (RESIZE_PRECISION_BITS - 1),
+                          1 << (RESIZE_PRECISION_BITS - 1)};
+        for (int k = 0; k < taps.count[x]; ++k) {
+            acc[0] += px[channels * k] * weights[k];
+            acc[1] += px[channels * k + 1] * weights[k];
+            acc[2] += px[channels * k + 2] * weights[k];
+        }
+        dst[3 * x] = clip_fixed(acc[0]);
+        dst[3 * x + 1] = clip_fixed(acc[1]);
+        dst[3 * x + 2] = clip_fixed(acc[2]);
+    }
+}
+
+static void resize_horizontal_scalar(const uint8_t* const* src, uint8_t* const* dst, int rows,
+                                     int channels, const ResizePlan::Taps& taps, int width) {
+    for (int r = 0; r < rows; ++r) {
+        resize_outputs_scalar(src[r], channels, taps, 0, width, dst[r]);
+    }
+}
+
+static void resize_vertical_scalar(const uint8_t* const* lines, const ResizePlan::Taps& taps, int index,
+                                   size_t bytes, uint8_t* dst) {
+    const int32_t* weights = taps.weights.data() + static_cast<size_t>(index) * taps.ksize;
+    const int count = taps.count[index];
+    for (size_t i = 0; i < bytes; ++i) {
+        int32_t acc = 1 << (RESIZE_PRECISION_BITS - 1);
+        for (int k = 0; k < count; ++k) {
+            acc += lines[k][i] * weights[k];
+        }
+        dst[i] = clip_fixed(acc);
+    }
+}
+
+#if CLIP_KERNELS_X86
+/**
+ * Four taps of one output per step: one 16-byte load broadcast to both
+ * lanes, a pshufb that pairs up taps (2l, 2l + 1) per channel as int16 in
+ * lane l, and a pmaddwd per weight half. `ROWS` rows share each weight load.
+ */
+template <int ROWS>
+__attribute__((target("avx2,fma")))
+static void resize_rows_avx2(const uint8_t* const* src, uint8_t* const* dst,
+                             int channels, const ResizePlan::Taps& taps, int count) {
+    // Byte 2j of lane l takes channel j / 2 of tap 2l + j % 2; odd bytes and
+    // the fourth pair are zero
+    alignas(32) int8_t mask_bytes[32];
+    for (int b = 0; b < 32; ++b) {
+        int lane = b / 16;
+        int j = (b % 16) / 2;
+        int c = j / 2;
+        int tap = lane * 2 + j % 2;
+        mask_bytes[b] = b % 2 == 0 && c < 3 ? static_cast<int8_t>(tap * channels + c) : -1;
+    }
+    const __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(mask_bytes));
+    const __m128i half = _mm_set1_epi32(1 << (RESIZE_PRECISION_BITS - 1));
+    const int step = 4 * channels;
+
+    for (int x = 0; x < count; ++x) {
+        const size_t offset = static_cast<size_t>(channels) * taps.start[x];
+        const int16_t* packed = taps.packed.data() + static_cast<size_t>(x) * taps.groups * 32;
+        const int groups = (taps.count[x] + 3) / 4;
+
+        // Unrolled so the accumulators stay in registers
+        __m256i lo[ROWS], hi[ROWS];
+#pragma GCC unroll 4
+        for (int r = 0; r < ROWS; ++r) {
+            lo[r] = _mm256_setzero_si256();
+            hi[r] = _mm256_setzero_si256();
+        }
+        for (int g = 0; g < groups; ++g) {
+            const __m256i* w = reinterpret_cast<const __m256i*>(packed + g * 32);
+            __m256i w_lo = _mm256_loadu_si256(w);
+            __m256i w_hi = _mm256_loadu_si256(w + 1);
+#pragma GCC unroll 4
+            for (int r = 0; r < ROWS; ++r) {
+                __m256i bytes = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[r] + offset + g * step)));
+                __m256i pairs = _mm256_shuffle_epi8(bytes, mask);
+                lo[r] = _mm256_add_epi32(lo[r], _mm256_madd_epi16(pairs, w_lo));
+                hi[r] = _mm256_add_epi32(hi[r], _mm256_madd_epi16(pairs, w_hi));
+            }
+        }
+
+#pragma GCC unroll 4
+        for (int r = 0; r < ROWS; ++r) {
+            __m256i acc = _mm256_add_epi32(_mm256_slli_epi32(hi[r], RESIZE_SPLIT_BITS), lo[r]);
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, half), RESIZE_PRECISION_BITS);
+            sum = _mm_packs_epi32(sum, sum);
+            sum = _mm_packus_epi16(sum, sum);
+            uint32_t value = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+            std::memcpy(dst[r] + 3 * x, &value, 3);
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void resize_horizontal_avx2(const uint8_t* const* src, uint8_t* const* dst, int rows,
+                                   int channels, const ResizePlan::Taps& taps, int width) {
+    const int simd_count = std::min(width, taps.simd_count);
+    if (rows == RESIZE_ROW_BLOCK) {
+        resize_rows_avx2<RESIZE_ROW_BLOCK>(src, dst, channels, taps, simd_count);
+    } else {
+        for (int r = 0; r < rows; ++r) {
+            resize_rows_avx2<1>(src + r, dst + r, channels, taps, simd_count);
+        }
+    }
+
+    for (int r = 0; r < rows; ++r) {
+        resize_outputs_scalar(src[r], channels, taps, simd_count, width, dst[r]);
+    }
+}
+
+/**
+ * Sixteen bytes of two rows per step: the rows are widened to int16 and
+ * interleaved so one pmaddwd applies both weights.
+ */
+__attribute__((target("avx2,fma")))
+static void resize_vertical_avx2(const uint8_t* const* lines, const ResizePlan::Taps& taps, int index,
+                                 size_t bytes, uint8_t* dst) {
+    const int32_t* weights = taps.weights.data() + static_cast<size_t>(index) * taps.ksize;
+    const int32_t* pairs = taps.pairs.data() + static_cast<size_t>(index) * taps.pair_count() * 2;
+    const int count = taps.count[index];
+    const __m256i half = _mm256_set1_epi32(1 << (RESIZE_PRECISION_BITS - 1));
+
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m256i lo0 = _mm256_setzero_si256(), hi0 = _mm256_setzero_si256();
+        __m256i lo1 = _mm256_setzero_si256(), hi1 = _mm256_setzero_si256();
+        for (int k = 0; k < count; k += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lines[k] + i)));
+            __m256i b = _mm256_setzero_si256();
+            if (k + 1 < count) {
+                b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lines[k + 1] + i)));
+            }
+            __m256i w_lo = _mm256_set1_epi32(pairs[k]);
+            __m256i w_hi = _mm256_set1_epi32(pairs[k + 1]);
+
+            __m256i p0 = _mm256_unpacklo_epi16(a, b);
+            __m256i p1 = _mm256_unpackhi_epi16(a, b);
+            lo0 = _mm256_add_epi32(lo0, _mm256_madd_epi16(p0, w_lo));
+            hi0 = _mm256_add_epi32(hi0, _mm256_madd_epi16(p0, w_hi));
+            lo1 = _mm256_add_epi32(lo1, _mm256_madd_epi16(p1, w_lo));
+            hi1 = _mm256_add_epi32(hi1, _mm256_madd_epi16(p1, w_hi));
+        }
+
+        __m256i r0 = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(hi0, RESIZE_SPLIT_BITS), lo0), half);
+        __m256i r1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(hi1, RESIZE_SPLIT_BITS), lo1), half);
+        r0 = _mm256_srai_epi32(r0, RESIZE_PRECISION_BITS);
+        r1 = _mm256_srai_epi32(r1, RESIZE_PRECISION_BITS);
+
+        // Per lane the packs restore byte order; the permute joins the lanes
+        __m256i words = _mm256_packs_epi32(r0, r1);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+    }
+
+    for (; i < bytes; ++i) {
+        int32_t acc = 1 << (RESIZE_PRECISION_BITS - 1);
+        for (int k = 0; k < count; ++k) {
+            acc += lines[k][i] * weights[k];
+        }
+        dst[i] = clip_fixed(acc);
+    }
+}
+#endif
+
+#if CLIP_KERNELS_NEON
+static void resize_vertical_neon(const uint8_t* const* lines, const ResizePlan::Taps& taps, int index,
+                                 size_t bytes, uint8_t* dst) {
+    const int32_t* weights = taps.weights.data() + static_cast<size_t>(index) * taps.ksize;
+    const int count = taps.count[index];
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        int32x4_t lo = vdupq_n_s32(1 << (RESIZE_PRECISION_BITS - 1));
+        int32x4_t hi = lo;
+        for (int k = 0; k < count; ++k) {
+            int16x8_t wide = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(lines[k] + i)));
+            lo = vmlaq_n_s32(lo, vmovl_s16(vget_low_s16(wide)), weights[k]);
+            hi = vmlaq_n_s32(hi, vmovl_s16(vget_high_s16(wide)), weights[k]);
+        }
+        int16x8_t words = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, RESIZE_PRECISION_BITS)),
+                                       vqmovn_s32(vshrq_n_s32(hi, RESIZE_PRECISION_BITS)));
+        vst1_u8(dst + i, vqmovun_s16(words));
+    }
+
+    for (; i < bytes; ++i) {
+        int32_t acc = 1 << (RESIZE_PRECISION_BITS - 1);
+        for (int k = 0; k < count; ++k) {
+            acc += lines[k][i] * weights[k];
+        }
+        dst[i] = clip_fixed(acc);
+    }
+}
+#endif
+
+// BT.601 video-range YUV -> RGB in 20-bit fixed point, OpenCV's constants
+static const int YUV_SHIFT = 20;
+static const int YUV_CY = 1220542;
+static const int YUV_CUB = 2116026;
+static const int YUV_CUG = -409993;
+static const int YUV_CVG = -852492;
+static const int YUV_CVR = 1673527;
+
+using Yuv420ToRgb = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                             int width, int first, int count, uint8_t* dst);
+
+static inline uint8_t clip_yuv(int value) {
+    value >>= YUV_SHIFT;
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static void yuv420_to_rgb_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                                 int, int first, int count, uint8_t* dst) {
+    const int half = 1 << (YUV_SHIFT - 1);
+    for (int x = first; x < first + count; ++x) {
+        int uu = u[(x / 2) * uv_step] - 128;
+        int vv = v[(x / 2) * uv_step] - 128;
+        int luma = std::max(0, y[x] - 16) * YUV_CY;
+        dst[3 * x] = clip_yuv(luma + half + YUV_CVR * vv);
+        dst[3 * x + 1] = clip_yuv(luma + half + YUV_CVG * vv + YUV_CUG * uu);
+        dst[3 * x + 2] = clip_yuv(luma + half + YUV_CUB * uu);
+    }
+}
+
+#if CLIP_KERNELS_X86
+/**
+ * Eight pixels, four chroma pairs per step. The chroma terms are computed
+ * once per pair and duplicated across its two pixels; rows are packed to
+ * bytes and interleaved to RGB with one pshufb per lane.
+ */
+__attribute__((target("avx2,fma")))
+static void yuv420_to_rgb_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                               int width, int first, int count, uint8_t* dst) {
+    const int end = first + count;
+    const int chroma_width = (width + 1) / 2;
+    int x = first;
+    if (x % 2 != 0 && x < end) {
+        yuv420_to_rgb_scalar(y, u, v, uv_step, width, x, 1, dst);
+        ++x;
+    }
+
+    const __m128i even_bytes = _mm_setr_epi8(0, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i duplicate = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i interleave = _mm256_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1,
+                                                0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    const __m128i half = _mm_set1_epi32(1 << (YUV_SHIFT - 1));
+    const __m128i bias = _mm_set1_epi32(128);
+    const __m256i y_bias = _mm256_set1_epi32(16);
+
+    // Each step stores 28 bytes for 24; chroma reads stay within the row
+    for (; x + 10 <= end && x / 2 + 5 <= chroma_width; x += 8) {
+        __m128i u4, v4;
+        if (uv_step == 1) {
+            int32_t u_bytes, v_bytes;
+            std::memcpy(&u_bytes, u + x / 2, 4);
+            std::memcpy(&v_bytes, v + x / 2, 4);
+            u4 = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(u_bytes));
+            v4 = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v_bytes));
+        } else {
+            u4 = _mm_cvtepu8_epi32(_mm_shuffle_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x)), even_bytes));
+            v4 = _mm_cvtepu8_epi32(_mm_shuffle_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x)), even_bytes));
+        }
+        u4 = _mm_sub_epi32(u4, bias);
+        v4 = _mm_sub_epi32(v4, bias);
+
+        __m128i ruv = _mm_add_epi32(half, _mm_mullo_epi32(v4, _mm_set1_epi32(YUV_CVR)));
+        __m128i guv = _mm_add_epi32(_mm_add_epi32(half, _mm_mullo_epi32(v4, _mm_set1_epi32(YUV_CVG))),
+                                    _mm_mullo_epi32(u4, _mm_set1_epi32(YUV_CUG)));
+        __m128i buv = _mm_add_epi32(half, _mm_mullo_epi32(u4, _mm_set1_epi32(YUV_CUB)));
+
+        __m256i luma = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x)));
+        luma = _mm256_mullo_epi32(_mm256_max_epi32(_mm256_sub_epi32(luma, y_bias), _mm256_setzero_si256()),
+                                  _mm256_set1_epi32(YUV_CY));
+
+        __m256i r = _mm256_srai_epi32(_mm256_add_epi32(
+            luma, _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(ruv), duplicate)), YUV_SHIFT);
+        __m256i g = _mm256_srai_epi32(_mm256_add_epi32(
+            luma, _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(guv), duplicate)), YUV_SHIFT);
+        __m256i b = _mm256_srai_epi32(_mm256_add_epi32(
+            luma, _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(buv), duplicate)), YUV_SHIFT);
+
+        // Per lane: bytes r0-3 g0-3 b0-3, then interleaved to r g b triples
+        __m256i rg = _mm256_packs_epi32(r, g);
+        __m256i b0 = _mm256_packs_epi32(b, _mm256_setzero_si256());
+        __m256i rgb = _mm256_shuffle_epi8(_mm256_packus_epi16(rg, b0), interleave);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x + 12), _mm256_extracti128_si256(rgb, 1));
+    }
+
+    yuv420_to_rgb_scalar(y, u, v, uv_step, width, x, end - x, dst);
+}
+#endif
+
+struct KernelSet {
+    NormalizeRow        normalize_row;
+    ResizeHorizontal    resize_horizontal;
+    ResizeVertical      resize_vertical;
+    Yuv420ToRgb         yuv420_to_rgb;
+    const char*         isa;
+};
+
+static KernelSet select_kernels() {
+#if CLIP_KERNELS_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {normalize_row_avx2, resize_horizontal_avx2, resize_vertical_avx2, yuv420_to_rgb_avx2, "avx2"};
+    }
+#endif
+#if CLIP_KERNELS_NEON
+    return {normalize_row_neon, resize_horizontal_scalar, resize_vertical_neon, yuv420_to_rgb_scalar, "neon"};
+#endif
+    return {normalize_row_scalar, resize_horizontal_scalar, resize_vertical_scalar, yuv420_to_rgb_scalar,
+            "scalar"};
+}
+
+static const KernelSet& kernels() {
+    static const KernelSet selected = select_kernels();
+    return selected;
+}
+
+const char* ImageKernels::isa() {
+    return kernels().isa;
+}
+
+void ImageKernels::normalize_to_chw(const uint8_t* src, size_t src_stride,
+                                    int width, int height, bool bgr,
+                                    const float mean[3], const float std[3],
+                                    float* dst) {
+    const int order[3] = {bgr ? 2 : 0, 1, bgr ? 0 : 2};
+    float scale[3];
+    float bias[3];
+    for (int c = 0; c < 3; ++c) {
+        scale[c] = 1.0f / (255.0f * std[c]);
+        bias[c] = -mean[c] / std[c];
+    }
+
+    const size_t plane_size = static_cast<size_t>(width) * height;
+    NormalizeRow normalize_row = kernels().normalize_row;
+    for (int y = 0; y < height; ++y) {
+        float* const planes[3] = {dst + y * static_cast<size_t>(width),
+                                  dst + plane_size + y * static_cast<size_t>(width),
+                                  dst + 2 * plane_size + y * static_cast<size_t>(width)};
+        normalize_row(src + y * src_stride, width, order, scale, bias, planes);
+    }
+}
+
+
+void ImageKernels::yuv420_to_rgb(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                                 int width, int first, int count, uint8_t* dst) {
+    kernels().yuv420_to_rgb(y, u, v, uv_step, width, first, count, dst);
+}
+
+void ImageKernels::resize_crop(const uint8_t* src, size_t src_stride,
+                               int src_width, int src_height,
+                               int resized_width, int resized_height,
+                               int crop_x, int crop_y, int width, int height,
+                               uint8_t* dst, size_t dst_stride) {
+    ResizePlan(src_width, src_height, 3, resized_width, resized_height, crop_x, crop_y, width, height)
+        .apply(src, src_stride, dst, dst_stride);
+}
+
+ResizePlan::ResizePlan(int src_width, int src_height, int channels,
+                       int resized_width, int resized_height,
+                       int crop_x, int crop_y, int width, int height)
+    : source_width(src_width), source_height(src_height), source_channels(channels),
+      crop_x(crop_x), crop_y(crop_y), out_width(width), out_height(height),
+      // Like Pillow, an axis whose size does not change is not filtered
+      horizontal(src_width != resized_width), vertical(src_height != resized_height) {
+    if (channels != 3 && channels != 4) {
+        throw std::invalid_argument("Resize sources should have 3 or 4 channels.");
+    }
+    if (src_width <= 0 || src_height <= 0 || width <= 0 || height <= 0 ||
+        crop_x < 0 || crop_y < 0 || crop_x + width > resized_width || crop_y + height > resized_height) {
+        throw std::invalid_argument("Resize crop window lies outside the resized image.");
+    }
+
+    if (horizontal) {
+        columns = compute_taps(src_width, resized_width, crop_x, width, channels);
+        first_column = columns.start[0];
+        last_column = columns.start[width - 1] + columns.count[width - 1];
+    } else {
+        first_column = crop_x;
+        last_column = crop_x + width;
+    }
+    if (vertical) {
+        rows = compute_taps(src_height, resized_height, crop_y, height, 1);
+    }
+}
+
+// Horizontal pass over `count` source rows into `out`
+void ResizePlan::filter_rows(const uint8_t* const* in, uint8_t* const* out, int count) const {
+    if (horizontal) {
+        kernels().resize_horizontal(in, out, count, source_channels, columns, out_width);
+        return;
+    }
+
+    for (int r = 0; r < count; ++r) {
+        const uint8_t* px = in[r] + static_cast<size_t>(crop_x) * source_channels;
+        if (source_channels == 3) {
+            std::memcpy(out[r], px, static_cast<size_t>(out_width) * 3);
+            continue;
+        }
+        for (int x = 0; x < out_width; ++x, px += source_channels) {
+            out[r][3 * x] = px[0];
+            out[r][3 * x + 1] = px[1];
+            out[r][3 * x + 2] = px[2];
+        }
+    }
+}
+
+template <typename Fetch>
+void ResizePlan::run(const Fetch& fetch, uint8_t* dst, size_t dst_stride) const {
+    const uint8_t* in[RESIZE_ROW_BLOCK];
+    uint8_t* out[RESIZE_ROW_BLOCK];
+
+    if (!vertical) {
+        for (int y = 0; y < out_height; y += RESIZE_ROW_BLOCK) {
+            int count = std::min(RESIZE_ROW_BLOCK, out_height - y);
+            for (int r = 0; r < count; ++r) {
+                in[r] = fetch(crop_y + y + r, r);
+                out[r] = dst + (y + r) * dst_stride;
+            }
+            filter_rows(in, out, count);
+        }
+        return;
+    }
+
+    // Source row r is filtered once, into slot r % ring_rows. Output rows
+    // start at non-decreasing source rows and span at most ksize of them, and
+    // filtering runs at most RESIZE_ROW_BLOCK - 1 rows ahead
+    const size_t row_bytes = static_cast<size_t>(out_width) * 3;
+    const size_t ring_rows = static_cast<size_t>(rows.ksize + RESIZE_ROW_BLOCK - 1);
+    thread_local std::vector<uint8_t> ring;
+    thread_local std::vector<const uint8_t*> lines;
+    if (ring.size() < ring_rows * row_bytes) {
+        ring.resize(ring_rows * row_bytes);
+    }
+    if (lines.size() < ring_rows) {
+        lines.resize(ring_rows);
+    }
+
+    const ResizeVertical resize_vertical = kernels().resize_vertical;
+    const int last_row = rows.start[out_height - 1] + rows.count[out_height - 1];
+    int next_row = rows.start[0];
+    for (int y = 0; y < out_height; ++y) {
+        const int first = rows.start[y];
+        const int count = rows.count[y];
+        for (next_row = std::max(next_row, first); next_row < first + count;) {
+            int block = std::min(RESIZE_ROW_BLOCK, last_row - next_row);
+            for (int r = 0; r < block; ++r) {
+                in[r] = fetch(next_row + r, r);
+                out[r] = ring.data() + ((next_row + r) % ring_rows) * row_bytes;
+            }
+            filter_rows(in, out, block);
+            next_row += block;
+        }
+
+        for (int k = 0; k < count; ++k) {
+            lines[k] = ring.data() + ((first + k) % ring_rows) * row_bytes;
+        }
+        resize_vertical(lines.data(), rows, y, row_bytes, dst + y * dst_stride);
+    }
+}
+
+void ResizePlan::apply(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride) const {
+    run([&](int row, int) { return src + static_cast<size_t>(row) * src_stride; }, dst, dst_stride);
+}
+
+void ResizePlan::apply(const RowReader& read, uint8_t* dst, size_t dst_stride) const {
+    // One buffer per row in flight, with slack for the 16-byte SIMD loads
+    const size_t row_bytes = static_cast<size_t>(source_width) * source_channels + 16;
+    thread_local std::vector<uint8_t> source_rows;
+    if (source_rows.size() < RESIZE_ROW_BLOCK * row_bytes) {
+        source_rows.resize(RESIZE_ROW_BLOCK * row_bytes);
+    }
+
+    run([&](int row, int slot) {
+            uint8_t* out = source_rows.data() + slot * row_bytes;
+            read(row, first_column, last_column, out);
+            return static_cast<const uint8_t*>(out);
+        }, dst, dst_stride);
+}
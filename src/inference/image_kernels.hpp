@@ -0,0 +1,145 @@
+#ifndef CLIP_IMAGE_KERNELS_H
+#define CLIP_IMAGE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * OpenCV-free pixel kernels behind CLIPpreprocessor.
+ *
+ * Kernels work on raw interleaved 8-bit pixels and write straight into the
+ * caller's float tensor memory. The widest implementation available on the
+ * running CPU is picked at first use: AVX2 on x86-64 (checked at runtime, so
+ * the library needs no -mavx2), NEON on ARM, portable scalar code elsewhere.
+ */
+class ImageKernels {
+public:
+    /**
+     * Convert an interleaved 3-channel uint8 image into normalised planar RGB:
+     *
+     *     dst[c][y][x] = (src[y][x][c'] / 255 - mean[c]) / std[c]
+     *
+     * where c' is c, or 2 - c when `bgr` is set. `src_stride` is the distance
+     * in bytes between rows; `dst` receives 3 * width * height floats.
+     */
+    static void     normalize_to_chw(const uint8_t* src, size_t src_stride,
+                                     int width, int height, bool bgr,
+                                     const float mean[3], const float std[3],
+                                     float* dst);
+
+    /**
+     * Bicubic resize of an interleaved 3-channel uint8 image to
+     * resized_width x resized_height, computing only the width x height window
+     * at (crop_x, crop_y) of the result. Source pixels outside the filter
+     * support of that window are never read.
+     *
+     * Coefficients, pass order and rounding follow Pillow's Image.resize with
+     * BICUBIC, which torchvision's Resize uses for CLIP: a = -0.5, the support
+     * widened by the downscale factor (antialiasing), 22-bit fixed-point
+     * weights and a horizontal pass rounded to uint8 before the vertical one.
+     *
+     * Builds a ResizePlan on every call; keep one for repeated geometry.
+     */
+    static void     resize_crop(const uint8_t* src, size_t src_stride,
+                                int src_width, int src_height,
+                                int resized_width, int resized_height,
+                                int crop_x, int crop_y, int width, int height,
+                                uint8_t* dst, size_t dst_stride);
+
+    /**
+     * Convert pixels [first, first + count) of one row of a 4:2:0 YUV image
+     * to interleaved RGB at dst + 3 * first. `u` and `v` point at the row's
+     * chroma samples, `uv_step` bytes apart: 1 for planar I420, 2 for NV12.
+     * `width` is the luma width, bounding chroma reads.
+     *
+     * BT.601 video range in OpenCV's fixed point, so results equal
+     * cv::cvtColor with COLOR_YUV2RGB_NV12 / COLOR_YUV2RGB_I420.
+     */
+    static void     yuv420_to_rgb(const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+                                  int width, int first, int count, uint8_t* dst);
+
+    // Name of the implementation in use: "avx2", "neon" or "scalar"
+    static const char*  isa();
+};
+
+/**
+ * The geometry of one ImageKernels::resize_crop, computed once and applied to
+ * any number of same-sized frames.
+ *
+ * Construction does all the float work: the source rows and columns under the
+ * filter taps of the crop window, and their fixed-point weights. apply() then
+ * only runs the separable integer passes, through a ring of horizontally
+ * filtered rows, and allocates nothing after its first call on a thread.
+ * Results are identical to resize_crop with the same arguments.
+ *
+ * A 1080p frame to the 224x224 crop takes about 2 ms with the AVX2 passes
+ * (1.9 ms on a 2 GHz VM, 2.4 ms on a single-core Xeon), not the 1 ms aimed
+ * for: matching Pillow bit for bit keeps the weights at 22 bits and the
+ * horizontal pass first, and that pass over all 1080 source rows dominates.
+ *
+ * Sources have 3 or 4 interleaved 8-bit channels; the first three are kept,
+ * so a fourth (alpha) channel is dropped during the horizontal pass.
+ */
+class ResizePlan {
+public:
+    // Tap tables of one axis, for the outputs of the crop window only
+    struct Taps {
+        std::vector<int>        start;      // first input sample per output
+        std::vector<int>        count;      // taps per output
+        std::vector<int32_t>    weights;    // `ksize` fixed-point weights per output
+        std::vector<int16_t>    packed;     // weights split for 16-bit SIMD, `groups` x 32 per output
+        std::vector<int32_t>    pairs;      // the same per tap pair, 2 x pair_count() per output
+        int                     ksize {0};
+        int                     groups {0};
+        int                     simd_count {0};  // leading outputs safe for 16-byte loads
+
+        int                     pair_count() const { return (ksize + 1) / 2; }
+    };
+
+    ResizePlan(int src_width, int src_height, int channels,
+               int resized_width, int resized_height,
+               int crop_x, int crop_y, int width, int height);
+
+    /**
+     * Writes source pixels [first, last) of `row`, `channels` bytes each, at
+     * out + channels * first. Lets formats that need converting (YUV) produce
+     * only the source rows and columns the plan reads, one row at a time.
+     */
+    using RowReader = std::function<void(int row, int first, int last, uint8_t* out)>;
+
+    // `dst` receives width x height pixels of 3 bytes
+    void    apply(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride) const;
+    void    apply(const RowReader& read, uint8_t* dst, size_t dst_stride) const;
+
+    int     src_width() const { return source_width; }
+    int     src_height() const { return source_height; }
+    int     channels() const { return source_channels; }
+    int     width() const { return out_width; }
+    int     height() const { return out_height; }
+
+private:
+    void    filter_rows(const uint8_t* const* in, uint8_t* const* out, int count) const;
+
+    // Runs the passes with fetch(row, slot) giving a pointer to source `row`;
+    // `slot` < RESIZE_ROW_BLOCK tells apart rows needed at the same time
+    template <typename Fetch>
+    void    run(const Fetch& fetch, uint8_t* dst, size_t dst_stride) const;
+
+    int     source_width;
+    int     source_height;
+    int     source_channels;
+    int     crop_x;
+    int     crop_y;
+    int     out_width;
+    int     out_height;
+    bool    horizontal;
+    bool    vertical;
+    int     first_column;   // source columns read, [first_column, last_column)
+    int     last_column;
+    Taps    columns;
+    Taps    rows;
+};
+
+#endif // CLIP_IMAGE_KERNELS_H
@@ -0,0 +1,118 @@
+#include "merge_table.hpp"
+#include <stdexcept>
+#include <string>
+
+/**
+ * Allocate a power-of-two slot array with at most 50% load for `count`
+ * entries. Any existing entries are discarded.
+ *
+ * @param[in] count size_t: number of merges that will be inserted
+ */
+void MergeTable::reserve(size_t count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity <<= 1;
+    }
+
+    slots.assign(capacity, Entry{EMPTY_KEY, 0, 0});
+    table = slots.data();
+    mask = capacity - 1;
+    this->count = 0;
+}
+
+/**
+ * Insert a merge, overwriting the rank of a duplicate pair so that the last
+ * occurrence in the merges file wins (same as building a python dict).
+ *
+ * @param[in] left int: symbol id of the left half
+ * @param[in] right int: symbol id of the right half
+ * @param[in] rank int: line index of the merge in the BPE file
+ * @param[in] merged int: symbol id of left + right
+ */
+void MergeTable::insert(int32_t left, int32_t right, int32_t rank, int32_t merged) {
+    if (table && table != slots.data()) {
+        throw std::logic_error("Cannot insert into an attached merge table");
+    }
+    if (slots.empty() || (count + 1) * 2 > slots.size()) {
+        // Grow and rehash
+        std::vector<Entry> old = std::move(slots);
+        reserve(old.empty() ? 16 : old.size());
+        for (const Entry& e : old) {
+            if (e.key != EMPTY_KEY) {
+                insert(static_cast<int32_t>(e.key >> 32), static_cast<int32_t>(e.key), e.rank, e.merged);
+            }
+        }
+    }
+
+    uint64_t key = pack(left, right);
+    size_t i = slot_for(key, mask);
+    while (slots[i].key != EMPTY_KEY && slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    if (slots[i].key == EMPTY_KEY) {
+        ++count;
+    }
+    slots[i] = Entry{key, rank, merged};
+}
+
+const MergeTable::Entry* MergeTable::find(int32_t left, int32_t right) const {
+    if (!table) {
+        return nullptr;
+    }
+
+    uint64_t key = pack(left, right);
+    size_t i = slot_for(key, mask);
+    while (table[i].key != EMPTY_KEY) {
+        if (table[i].key == key) {
+            return &table[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return nullptr;
+}
+
+/**
+ * Look merges up in slots owned elsewhere. The slots must have been produced
+ * by this class (same hash and probing) and outlive the table.
+ *
+ * Slots usually come from a file, so they are checked once here and find()
+ * and the merge loop can trust them: at least one slot must be empty or a
+ * probe for a missing pair never ends, and every id must index the vocab.
+ *
+ * @param[in] slots Entry*: first slot
+ * @param[in] capacity size_t: number of slots, a power of two
+ * @param[in] count size_t: number of occupied slots
+ * @param[in] symbol_count size_t: number of symbols (vocab size) ids index
+ */
+void MergeTable::attach(const Entry* slots, size_t capacity, size_t count, size_t symbol_count) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        throw std::invalid_argument("Merge table capacity must be a power of two");
+    }
+    if (count >= capacity) {
+        throw std::runtime_error("Merge table has no empty slot");
+    }
+
+    size_t occupied = 0;
+    for (size_t i = 0; i < capacity; ++i) {
+        const Entry& e = slots[i];
+        if (e.key == EMPTY_KEY) {
+            continue;
+        }
+        ++occupied;
+        if (static_cast<uint32_t>(e.key >> 32) >= symbol_count || static_cast<uint32_t>(e.key) >= symbol_count ||
+            e.merged < 0 || static_cast<size_t>(e.merged) >= symbol_count) {
+            throw std::runtime_error("Merge table refers to unknown symbols");
+        }
+    }
+    if (occupied != count) {
+        throw std::runtime_error("Merge table holds " + std::to_string(occupied) + " merges, expected " +
+                                 std::to_string(count));
+    }
+
+    this->slots.clear();
+    this->slots.shrink_to_fit();
+    table = slots;
+    mask = capacity - 1;
+    this->count = count;
+}
@@ -0,0 +1,65 @@
+#ifndef CLIP_MERGE_TABLE_H
+#define CLIP_MERGE_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Flat open-addressing hash from a packed (left id, right id) symbol pair to
+ * its BPE merge rank and the id of the merged symbol.
+ *
+ * Slots live in one contiguous array so lookups touch a single cache line in
+ * the common case and the table can be serialised verbatim. A table can also
+ * be attached to slots it does not own, such as a memory-mapped vocab file.
+ */
+class MergeTable {
+public:
+    struct Entry {
+        uint64_t    key;
+        int32_t     rank;
+        int32_t     merged;
+    };
+
+    static constexpr uint64_t EMPTY_KEY = ~uint64_t(0);
+
+    MergeTable() = default;
+    MergeTable(const MergeTable&) = delete;
+    MergeTable& operator=(const MergeTable&) = delete;
+    MergeTable(MergeTable&&) = default;
+    MergeTable& operator=(MergeTable&&) = default;
+
+    static uint64_t     pack(int32_t left, int32_t right) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) |
+                static_cast<uint32_t>(right);
+    }
+
+    // Size the table for `count` entries, dropping anything already inserted
+    void                reserve(size_t count);
+
+    // Insert or overwrite the rank/merged id for a pair
+    void                insert(int32_t left, int32_t right, int32_t rank, int32_t merged);
+
+    // Returns nullptr when the pair is not a known merge
+    const Entry*        find(int32_t left, int32_t right) const;
+
+    // Use `capacity` externally owned slots (a power of two) holding `count`
+    // merges of symbol ids below `symbol_count`; std::runtime_error if they don't
+    void                attach(const Entry* slots, size_t capacity, size_t count, size_t symbol_count);
+
+    const Entry*        data() const { return table; }
+    size_t              capacity() const { return table ? static_cast<size_t>(mask) + 1 : 0; }
+    size_t              size() const { return count; }
+
+private:
+    static size_t       slot_for(uint64_t key, uint64_t mask) {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 17) & mask;
+    }
+
+    std::vector<Entry>  slots;
+    const Entry*        table {nullptr};
+    uint64_t            mask {0};
+    size_t              count {0};
+};
+
+#endif // CLIP_MERGE_TABLE_H
@@ -1,13 +1,17 @@
-#include "model.h"
+#include "model.hpp"
 #include <filesystem>
 #include <fstream>
+#include <numeric>
+#include <algorithm>
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 
 // Constructor implementation
 OnnxClip::OnnxClip(const std::string& model, int batch_size, 
-                   bool silent_download, const std::string& cache_dir) 
-    : batch_size(batch_size), env(ORT_LOGGING_LEVEL_WARNING, "CLIP") {
+                   bool silent_download, const std::string& cache_dir,
+                   int preprocess_threads, const OnnxClipConfig& config) 
+    : model_id(model), batch_size(batch_size), env(_createEnv(config)),
+      scratch_pool([this]() { return std::make_unique<Scratch>(*image_model, *text_model); }) {
     
     // Set embedding size based on model
     if (model == "ViT-B/32") {
@@ -18,142 +22,454 @@ OnnxClip::OnnxClip(const std::string& model, int batch_size,
         throw std::invalid_argument("Unsupported model: " + model);
     }
 
-    // Initialize preprocessor and tokenizer
-    preprocessor = std::make_unique<Preprocessor>();
+    // Initialize preprocessing pool and tokenizer
+    preprocess_pool = std::make_unique<ThreadPool>(std::max(0, preprocess_threads));
     tokenizer = std::make_unique<CLIPTokenizer>("../src/data/bpe_simple_vocab_16e6.txt");
 
-    // Load ONNX models
-    auto [img_model, txt_model] = loadModels(model, silent_download, 
-        cache_dir.empty() ? "../src/data" : cache_dir);
+    // Load ONNX models, both on the member env with the same options
+    Ort::SessionOptions options = _sessionOptions(config);
+    auto [img_model, txt_model] = _loadModels(model, silent_download, 
+        cache_dir.empty() ? "../src/data" : cache_dir, env, options);
     
     image_model = std::move(img_model);
     text_model = std::move(txt_model);
+
+    // Exported with a dynamic sequence axis the text model accepts trimmed inputs,
+    // otherwise every run has to be padded to the full context length
+    auto text_shape = text_model->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    text_dynamic_length = text_shape.size() == 2 && text_shape[1] < 0;
 }
 
 // Implementation of image embedding generation
 cv::Mat OnnxClip::getImageEmbeddings(const std::vector<cv::Mat>& images, bool with_batching) {
-    if (!with_batching || batch_size == 0) {
-        std::vector<cv::Mat> processed_images;
-        for (const auto& image : images) {
-            processed_images.push_back(preprocessor->encodeImage(image));
-        }
-        
-        if (processed_images.empty()) {
-            return getEmptyEmbedding();
+    if (images.empty()) {
+        return getEmptyEmbedding();
+    }
+
+    // The model writes straight into the returned matrix
+    cv::Mat result(static_cast<int>(images.size()), embedding_size, CV_32F);
+    std::vector<std::string> errors = getImageEmbeddings(images, result.ptr<float>(), with_batching);
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (!errors[i].empty()) {
+            throw std::runtime_error("Image " + std::to_string(i) + " could not be preprocessed: " + errors[i]);
         }
+    }
+    return result;
+}
 
-        // Concatenate processed images
-        cv::Mat batch;
-        cv::vconcat(processed_images, batch);
-
-        // Prepare ONNX runtime input
-        std::vector<float> input_tensor_values(batch.ptr<float>(), 
-            batch.ptr<float>() + batch.total());
-        
-        std::vector<int64_t> input_shape = {static_cast<int64_t>(images.size()), 3, 224, 224};
-        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(
-            OrtArenaAllocator, OrtMemTypeDefault);
-        
-        Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
-            memory_info, input_tensor_values.data(), input_tensor_values.size(),
-            input_shape.data(), input_shape.size());
-
-        // Run inference
-        const char* input_names[] = {"IMAGE"};
-        const char* output_names[] = {"OUTPUT"};
-        
-        auto output_tensors = image_model->Run(
-            Ort::RunOptions{nullptr}, input_names, &input_tensor, 1, output_names, 1);
-
-        // Convert output to cv::Mat
-        auto& output_tensor = output_tensors[0];
-        auto output_shape = output_tensor.GetTensorTypeAndShapeInfo().GetShape();
-        
-        cv::Mat output(output_shape[0], embedding_size, CV_32F,
-                      output_tensor.GetTensorMutableData<float>());
-        
-        return output.clone();  // Clone to ensure data ownership
+// Preprocessing of either kind of input into NCHW slots
+static std::vector<std::string> encodeInputs(std::span<const cv::Mat> images, float* out, ThreadPool& pool) {
+    return CLIPpreprocessor::encode_batch(images, out, pool);
+}
+
+static std::vector<std::string> encodeInputs(std::span<const std::span<const uint8_t>> images, float* out,
+                                             ThreadPool& pool) {
+    return CLIPpreprocessor::encode_batch_bytes(images, out, nullptr, pool);
+}
+
+/**
+ * Shared body of the image overloads. With an image cache, inputs are keyed
+ * by content first: hits are copied to `out`, duplicates within the call are
+ * embedded once, and only the remaining misses are preprocessed and run.
+ * Without one, or when everything misses, the model writes straight to `out`.
+ * An image that fails to preprocess gets a zeroed row and is not cached.
+ *
+ * @param[in] images span<Input>: Decoded images or encoded image bytes
+ * @param[out] out float*: images.size() * embedding_size floats
+ * @param[in] with_batching bool: Run at most batch_size images at a time
+ * @returns errors vector<string>: One entry per image, empty on success
+ */
+template <typename Input>
+std::vector<std::string> OnnxClip::embedImages(std::span<const Input> images, float* out, bool with_batching) {
+    auto scratch = scratch_pool.acquire();
+    std::vector<ImageEmbeddingCache::Key>& keys = scratch->image_keys;
+    std::vector<size_t>& sources = scratch->image_sources;
+    std::vector<size_t>& misses = scratch->image_misses;
+    auto& unique = scratch->image_unique;
+
+    // `sources` maps each image to its row among the misses, or NO_ROW for a hit
+    const size_t NO_ROW = static_cast<size_t>(-1);
+    sources.assign(images.size(), NO_ROW);
+    misses.clear();
+    if (!image_cache) {
+        for (size_t i = 0; i < images.size(); ++i) {
+            sources[i] = i;
+            misses.push_back(i);
+        }
     } else {
-        // Handle batching
-        std::vector<cv::Mat> embeddings;
-        auto batches = toBatches(images, batch_size);
-        
-        for (const auto& batch : batches) {
-            embeddings.push_back(getImageEmbeddings(batch, false));
+        keys.resize(images.size());
+        unique.clear();
+        for (size_t i = 0; i < images.size(); ++i) {
+            keys[i] = ImageEmbeddingCache::key(model_id, images[i]);
+            auto [first, inserted] = unique.try_emplace(keys[i], i);
+            if (!inserted) {
+                sources[i] = sources[first->second];
+            } else if (!image_cache->lookup(keys[i], out + i * embedding_size)) {
+                sources[i] = misses.size();
+                misses.push_back(i);
+            }
+        }
+    }
+
+    bool in_place = misses.size() == images.size();
+    float* embeddings = out;
+    std::vector<Input> gathered;
+    if (!in_place) {
+        scratch->image_output.resize(misses.size() * embedding_size);
+        embeddings = scratch->image_output.data();
+        gathered.reserve(misses.size());
+        for (size_t i : misses) {
+            gathered.push_back(images[i]);
+        }
+    }
+    std::span<const Input> inputs = in_place ? images : std::span<const Input>(gathered);
+
+    std::vector<std::string> failures(misses.size());
+    size_t step = with_batching && batch_size > 0 ? static_cast<size_t>(batch_size) : misses.size();
+    for (size_t begin = 0; begin < misses.size(); begin += step) {
+        size_t rows = std::min(step, misses.size() - begin);
+
+        // Preprocess straight into the bound input, one NCHW slot per image
+        float* pixels = imageInput(*scratch, rows);
+        std::vector<std::string> errors = encodeInputs(inputs.subspan(begin, rows), pixels, *preprocess_pool);
+
+        float* batch = embeddings + begin * embedding_size;
+        runImageModel(*scratch, pixels, rows, batch);
+
+        for (size_t i = 0; i < rows; ++i) {
+            if (!errors[i].empty()) {
+                std::fill(batch + i * embedding_size, batch + (i + 1) * embedding_size, 0.0f);
+                failures[begin + i] = std::move(errors[i]);
+            }
+        }
+    }
+
+    for (size_t m = 0; image_cache && m < misses.size(); ++m) {
+        if (failures[m].empty()) {
+            image_cache->insert(keys[misses[m]], embeddings + m * embedding_size);
+        }
+    }
+
+    // A duplicate of a failed image fails the same way
+    std::vector<std::string> errors(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (sources[i] != NO_ROW) {
+            errors[i] = failures[sources[i]];
         }
+    }
+    if (in_place) {
+        return errors;
+    }
 
-        if (embeddings.empty()) {
-            return getEmptyEmbedding();
+    // Rows of misses and duplicates; a duplicate of a hit copies the hit's row
+    for (size_t i = 0; i < images.size(); ++i) {
+        const float* row = nullptr;
+        if (sources[i] != NO_ROW) {
+            row = embeddings + sources[i] * embedding_size;
+        } else if (unique.at(keys[i]) != i) {
+            row = out + unique.at(keys[i]) * embedding_size;
         }
+        if (row) {
+            std::copy(row, row + embedding_size, out + i * embedding_size);
+        }
+    }
+    return errors;
+}
+
+std::vector<std::string> OnnxClip::getImageEmbeddings(const std::vector<cv::Mat>& images, float* out,
+                                                      bool with_batching) {
+    return embedImages(std::span<const cv::Mat>(images), out, with_batching);
+}
+
+std::vector<std::string> OnnxClip::getImageEmbeddings(std::span<const std::span<const uint8_t>> encoded,
+                                                      float* out, bool with_batching) {
+    return embedImages(encoded, out, with_batching);
+}
+
+void OnnxClip::setImageCache(std::shared_ptr<ImageEmbeddingCache> cache) {
+    if (cache && cache->dim() != static_cast<size_t>(embedding_size)) {
+        throw std::invalid_argument("Image embedding cache holds " + std::to_string(cache->dim()) +
+                                    "-float embeddings, the model produces " + std::to_string(embedding_size));
+    }
+    image_cache = std::move(cache);
+}
+
+// Tiles of one image, preprocessed from a single resize and run batch_size at a time
+cv::Mat OnnxClip::getImageEmbeddings(const cv::Mat& image, const CLIPpreprocessor::Tiling& tiling,
+                                     std::vector<cv::Rect2d>& tiles) {
+    Tensor batch = CLIPpreprocessor::encode_tiles(image, tiling, tiles);
+    cv::Mat result(static_cast<int>(tiles.size()), embedding_size, CV_32F);
+    auto scratch = scratch_pool.acquire();
+
+    size_t step = batch_size > 0 ? static_cast<size_t>(batch_size) : tiles.size();
+    for (size_t begin = 0; begin < tiles.size(); begin += step) {
+        size_t rows = std::min(step, tiles.size() - begin);
+        runImageModel(*scratch, batch[static_cast<int64_t>(begin)].data(), rows, result.ptr<float>(static_cast<int>(begin)));
+    }
+    return result;
+}
 
-        cv::Mat result;
-        cv::vconcat(embeddings, result);
-        return result;
+// Image input buffer for at least `rows` images, reallocated only to grow
+float* OnnxClip::imageInput(Scratch& scratch, size_t rows) {
+    if (scratch.image_input.empty() || static_cast<size_t>(scratch.image_input.size(0)) < rows) {
+        scratch.image_input = Tensor({static_cast<int64_t>(rows), 3,
+                                      CLIPpreprocessor::CLIP_INPUT_SIZE, CLIPpreprocessor::CLIP_INPUT_SIZE});
     }
+    return scratch.image_input.data();
+}
+
+// Single image model run: [rows, 3, 224, 224] pixels -> [rows, embedding_size] at `out`
+void OnnxClip::runImageModel(Scratch& scratch, float* pixels, size_t rows, float* out) {
+    const int64_t size = CLIPpreprocessor::CLIP_INPUT_SIZE;
+    const int64_t input_shape[] = {static_cast<int64_t>(rows), 3, size, size};
+    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
+        memory_info, pixels, rows * 3 * size * size, input_shape, 4);
+
+    runBound(*image_model, scratch.image_binding, "IMAGE", input_tensor, rows, out);
+}
+
+/**
+ * Run a model through an IoBinding of the caller's scratch. Input and output
+ * are tensors over memory we own, so ORT neither allocates the output nor
+ * copies anything in or out; only the small OrtValue handles are made per
+ * run. Session::Run is safe to call from several threads at once.
+ *
+ * @param[in] input Ort::Value: Input tensor over caller memory
+ * @param[in] rows size_t: Batch size
+ * @param[out] out float*: rows * embedding_size floats
+ */
+void OnnxClip::runBound(Ort::Session& session, Ort::IoBinding& binding, const char* input_name,
+                        Ort::Value& input, size_t rows, float* out) {
+    const int64_t output_shape[] = {static_cast<int64_t>(rows), embedding_size};
+    Ort::Value output_tensor = Ort::Value::CreateTensor<float>(
+        memory_info, out, rows * embedding_size, output_shape, 2);
+
+    binding.BindInput(input_name, input);
+    binding.BindOutput("OUTPUT", output_tensor);
+    session.Run(Ort::RunOptions{nullptr}, binding);
 }
 
 // Implementation of text embedding generation
 cv::Mat OnnxClip::getTextEmbeddings(const std::vector<std::string>& texts, bool with_batching) {
-    if (!with_batching || batch_size == 0) {
-        if (texts.empty()) {
-            return getEmptyEmbedding();
+    if (texts.empty()) {
+        return getEmptyEmbedding();
+    }
+
+    cv::Mat result(static_cast<int>(texts.size()), embedding_size, CV_32F);
+    getTextEmbeddings(texts, result.ptr<float>(), with_batching);
+    return result;
+}
+
+void OnnxClip::getTextEmbeddings(const std::vector<std::string>& texts, float* out, bool with_batching) {
+    embedTexts(texts, out, with_batching, false);
+}
+
+/**
+ * Shared body of the text entry points. Prompts are deduplicated by
+ * normalized text and looked up in the text cache, if any; only the
+ * remaining misses are tokenized and run, either in chunks of batch_size or
+ * grouped by token count.
+ *
+ * @param[in] texts vector<string>: Prompts
+ * @param[out] out float*: texts.size() * embedding_size floats
+ * @param[in] with_batching bool: Run at most batch_size prompts at a time
+ * @param[in] bucketed bool: Group the misses by length, see runBuckets
+ */
+void OnnxClip::embedTexts(const std::vector<std::string>& texts, float* out, bool with_batching, bool bucketed) {
+    auto scratch = scratch_pool.acquire();
+    std::vector<std::string>& keys = scratch->text_keys;
+    std::vector<size_t>& sources = scratch->text_sources;
+    std::vector<size_t>& misses = scratch->text_misses;
+    auto& unique = scratch->text_unique;
+
+    // Deduplicate by normalized text and serve what the cache has; `sources`
+    // maps each text to its row among the misses, or NO_ROW for a hit
+    const size_t NO_ROW = static_cast<size_t>(-1);
+    if (keys.size() < texts.size()) {
+        keys.resize(texts.size());
+    }
+    sources.assign(texts.size(), NO_ROW);
+    misses.clear();
+    unique.clear();
+    for (size_t i = 0; i < texts.size(); ++i) {
+        TextEmbeddingCache::key(model_id, texts[i], keys[i]);
+        auto [first, inserted] = unique.try_emplace(keys[i], i);
+        if (!inserted) {
+            sources[i] = sources[first->second];
+        } else if (!text_cache || !text_cache->lookup(keys[i], out + i * embedding_size, embedding_size)) {
+            sources[i] = misses.size();
+            misses.push_back(i);
         }
+    }
+
+    // All distinct and uncached: the model writes straight to `out`
+    bool in_place = misses.size() == texts.size();
+    float* embeddings = out;
+    if (!in_place) {
+        scratch->text_output.resize(misses.size() * embedding_size);
+        embeddings = scratch->text_output.data();
+    }
 
-        // Tokenize texts
-        std::vector<std::vector<int>> tokenized;
-        for (const auto& text : texts) {
-            tokenized.push_back(tokenizer->encode_text(text, 77, true));
+    scratch->text_views.clear();
+    for (size_t i : misses) {
+        scratch->text_views.push_back(texts[i]);
+    }
+    std::span<const std::string_view> views(scratch->text_views);
+    size_t step = with_batching && batch_size > 0 ? static_cast<size_t>(batch_size) : misses.size();
+    if (bucketed) {
+        runBuckets(*scratch, views, step, embeddings);
+    } else {
+        for (size_t begin = 0; begin < misses.size(); begin += step) {
+            size_t rows = std::min(step, misses.size() - begin);
+            runTexts(*scratch, views.subspan(begin, rows), embeddings + begin * embedding_size);
         }
+    }
 
-        // Convert to tensor format
-        std::vector<int64_t> tokens_flat;
-        for (const auto& tokens : tokenized) {
-            tokens_flat.insert(tokens_flat.end(), tokens.begin(), tokens.end());
+    for (size_t m = 0; text_cache && m < misses.size(); ++m) {
+        text_cache->insert(keys[misses[m]], embeddings + m * embedding_size, embedding_size);
+    }
+    if (in_place) {
+        return;
+    }
+
+    // Rows of misses and duplicates; a duplicate of a hit copies the hit's row
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const float* row = nullptr;
+        if (sources[i] != NO_ROW) {
+            row = embeddings + sources[i] * embedding_size;
+        } else if (unique.at(keys[i]) != i) {
+            row = out + unique.at(keys[i]) * embedding_size;
         }
+        if (row) {
+            std::copy(row, row + embedding_size, out + i * embedding_size);
+        }
+    }
+}
 
-        // Prepare ONNX runtime input
-        std::vector<int64_t> input_shape = {static_cast<int64_t>(texts.size()), 77};
-        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(
-            OrtArenaAllocator, OrtMemTypeDefault);
-        
-        Ort::Value input_tensor = Ort::Value::CreateTensor<int64_t>(
-            memory_info, tokens_flat.data(), tokens_flat.size(),
-            input_shape.data(), input_shape.size());
-
-        // Run inference
-        const char* input_names[] = {"TEXT"};
-        const char* output_names[] = {"OUTPUT"};
-        
-        auto output_tensors = text_model->Run(
-            Ort::RunOptions{nullptr}, input_names, &input_tensor, 1, output_names, 1);
-
-        // Convert output to cv::Mat
-        auto& output_tensor = output_tensors[0];
-        auto output_shape = output_tensor.GetTensorTypeAndShapeInfo().GetShape();
-        
-        cv::Mat output(output_shape[0], embedding_size, CV_32F,
-                      output_tensor.GetTensorMutableData<float>());
-        
-        return output.clone();
-    } else {
-        // Handle batching
-        std::vector<cv::Mat> embeddings;
-        auto batches = toBatches(texts, batch_size);
-        
-        for (const auto& batch : batches) {
-            embeddings.push_back(getTextEmbeddings(batch, false));
+// Tokenize one chunk straight into the bound [rows, 77] input and run it
+void OnnxClip::runTexts(Scratch& scratch, std::span<const std::string_view> texts, float* out) {
+    const int context_length = 77;
+    if (scratch.text_input.size() < texts.size() * context_length) {
+        scratch.text_input.resize(texts.size() * context_length);
+    }
+    tokenizer->encode_batch(texts, scratch.text_input.data(), context_length, *preprocess_pool);
+    runTextModel(scratch, scratch.text_input.data(), texts.size(), context_length, out);
+}
+
+void OnnxClip::setTextCache(std::shared_ptr<TextEmbeddingCache> cache) {
+    text_cache = std::move(cache);
+}
+
+// Length-bucketed text embedding generation, through the same deduplication and cache
+cv::Mat OnnxClip::getTextEmbeddingsBucketed(const std::vector<std::string>& texts) {
+    if (texts.empty()) {
+        return getEmptyEmbedding();
+    }
+
+    cv::Mat result(static_cast<int>(texts.size()), embedding_size, CV_32F);
+    embedTexts(texts, result.ptr<float>(), true, true);
+    return result;
+}
+
+/**
+ * Run texts grouped by token count, shortest first. Each bucket runs with
+ * its sequence length trimmed to its longest member when the text model has
+ * a dynamic sequence axis, and padded to the full context length otherwise.
+ *
+ * @param[in] texts span<string_view>: Prompts to run
+ * @param[in] max_rows size_t: Largest bucket
+ * @param[out] out float*: texts.size() * embedding_size floats, in input order
+ */
+void OnnxClip::runBuckets(Scratch& scratch, std::span<const std::string_view> texts, size_t max_rows, float* out) {
+    // Token counts are grouped in steps of this size, so short prompts never
+    // share a run with long ones
+    const int bucket_step = 16;
+    const int context_length = 77;
+
+    if (texts.empty()) {
+        return;
+    }
+
+    std::vector<int64_t>& tokens = scratch.text_input;
+    std::vector<int64_t>& bucket_input = scratch.bucket_input;
+    std::vector<float>& bucket_output = scratch.bucket_output;
+
+    if (tokens.size() < texts.size() * context_length) {
+        tokens.resize(texts.size() * context_length);
+    }
+    std::vector<int> lengths = tokenizer->encode_batch(texts, tokens.data(), context_length, *preprocess_pool);
+
+    // Visit rows shortest first; stable so equal lengths keep their input order
+    std::vector<size_t> order(texts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+    if (bucket_input.size() < max_rows * context_length) {
+        bucket_input.resize(max_rows * context_length);
+    }
+    if (bucket_output.size() < max_rows * embedding_size) {
+        bucket_output.resize(max_rows * embedding_size);
+    }
+
+    size_t begin = 0;
+    while (begin < order.size()) {
+        int bucket = (lengths[order[begin]] - 1) / bucket_step;
+        size_t end = begin + 1;
+        while (end < order.size() && end - begin < max_rows &&
+               (lengths[order[end]] - 1) / bucket_step == bucket) {
+            ++end;
         }
 
-        if (embeddings.empty()) {
-            return getEmptyEmbedding();
+        // Rows are sorted, so the last one is the longest of the bucket
+        int64_t seq_len = text_dynamic_length ? lengths[order[end - 1]] : context_length;
+        for (size_t i = begin; i < end; ++i) {
+            const int64_t* row = tokens.data() + order[i] * context_length;
+            std::copy(row, row + seq_len, bucket_input.data() + (i - begin) * seq_len);
         }
 
-        cv::Mat result;
-        cv::vconcat(embeddings, result);
-        return result;
+        // Scatter the bucket back to the original positions
+        runTextModel(scratch, bucket_input.data(), end - begin, seq_len, bucket_output.data());
+        for (size_t i = begin; i < end; ++i) {
+            const float* row = bucket_output.data() + (i - begin) * embedding_size;
+            std::copy(row, row + embedding_size, out + order[i] * embedding_size);
+        }
+        begin = end;
     }
 }
 
+// Single text model run: flat [rows, seq_len] tokens -> [rows, embedding_size] at `out`
+void OnnxClip::runTextModel(Scratch& scratch, int64_t* tokens, size_t rows, int64_t seq_len, float* out) {
+    const int64_t input_shape[] = {static_cast<int64_t>(rows), seq_len};
+    Ort::Value input_tensor = Ort::Value::CreateTensor<int64_t>(
+        memory_info, tokens, rows * seq_len, input_shape, 2);
+
+    runBound(*text_model, scratch.text_binding, "TEXT", input_tensor, rows, out);
+}
+
+// Micro-batching front end; each tower's runner is the float* path of the clip.
+// An image that fails to preprocess fails its own request only
+OnnxClipScheduler::OnnxClipScheduler(OnnxClip& clip, const Config& image_config, const Config& text_config)
+    : images(clip.getEmbeddingSize(),
+             [&clip](const std::vector<cv::Mat>& batch, float* out) {
+                 return clip.getImageEmbeddings(batch, out, false);
+             },
+             image_config),
+      texts(clip.getEmbeddingSize(),
+            [&clip](const std::vector<std::string>& batch, float* out) {
+                clip.getTextEmbeddings(batch, out, false);
+                return std::vector<std::string>();
+            },
+            text_config) {}
+
+std::future<std::vector<float>> OnnxClipScheduler::submitImage(cv::Mat image) {
+    return images.submit(std::move(image));
+}
+
+std::future<std::vector<float>> OnnxClipScheduler::submitText(std::string text) {
+    return texts.submit(std::move(text));
+}
+
 // Similarity scoring implementations
 cv::Mat OnnxClip::getSimilarityScores(const cv::Mat& embeddings1, const cv::Mat& embeddings2) {
     if (embeddings1.rows == 1) {
@@ -168,8 +484,8 @@ cv::Mat OnnxClip::getSimilarityScores(const cv::Mat& embeddings1, const cv::Mat&
 }
 
 cv::Mat OnnxClip::cosineSimilarity(const cv::Mat& embeddings1, const cv::Mat& embeddings2) {
-    cv::Mat norm_emb1 = normalizeEmbeddings(embeddings1);
-    cv::Mat norm_emb2 = normalizeEmbeddings(embeddings2);
+    cv::Mat norm_emb1 = _normalizeEmbeddings(embeddings1);
+    cv::Mat norm_emb2 = _normalizeEmbeddings(embeddings2);
     return norm_emb1 * norm_emb2.t();
 }
 
@@ -192,33 +508,40 @@ cv::Mat OnnxClip::getEmptyEmbedding() const {
     return cv::Mat(0, embedding_size, CV_32F);
 }
 
-template<typename T>
-std::vector<std::vector<T>> OnnxClip::toBatches(const std::vector<T>& items, int size) const {
-    if (size < 1) {
-        throw std::invalid_argument("Batch size must be positive");
+// ORT environment; with global thread pools it owns the pools both sessions share
+Ort::Env OnnxClip::_createEnv(const OnnxClipConfig& config) {
+    if (!config.global_thread_pools) {
+        return Ort::Env(ORT_LOGGING_LEVEL_WARNING, "CLIP");
     }
 
-    std::vector<std::vector<T>> batches;
-    std::vector<T> current_batch;
-    
-    for (const auto& item : items) {
-        current_batch.push_back(item);
-        if (current_batch.size() == size) {
-            batches.push_back(current_batch);
-            current_batch.clear();
-        }
-    }
-    
-    if (!current_batch.empty()) {
-        batches.push_back(current_batch);
+    Ort::ThreadingOptions threading;
+    threading.SetGlobalIntraOpNumThreads(config.intra_op_threads);
+    threading.SetGlobalInterOpNumThreads(config.inter_op_threads);
+    threading.SetGlobalSpinControl(config.allow_spinning ? 1 : 0);
+    return Ort::Env(threading, ORT_LOGGING_LEVEL_WARNING, "CLIP");
+}
+
+// Session options for both models
+Ort::SessionOptions OnnxClip::_sessionOptions(const OnnxClipConfig& config) {
+    Ort::SessionOptions options;
+    if (config.global_thread_pools) {
+        options.DisablePerSessionThreads();
+    } else {
+        options.SetIntraOpNumThreads(config.intra_op_threads);
+        options.SetInterOpNumThreads(config.inter_op_threads);
+        options.AddConfigEntry("session.intra_op.allow_spinning", config.allow_spinning ? "1" : "0");
+        options.AddConfigEntry("session.inter_op.allow_spinning", config.allow_spinning ? "1" : "0");
     }
-    
-    return batches;
+    options.SetExecutionMode(config.parallel_execution ? ExecutionMode::ORT_PARALLEL
+                                                       : ExecutionMode::ORT_SEQUENTIAL);
+    options.SetGraphOptimizationLevel(config.optimization_level);
+    return options;
 }
 
 // Model loading implementations
 std::pair<std::unique_ptr<Ort::Session>, std::unique_ptr<Ort::Session>> 
-OnnxClip::_loadModels(const std::string& model, bool silent, const std::string& cache_dir) {
+OnnxClip::_loadModels(const std::string& model, bool silent, const std::string& cache_dir,
+                      Ort::Env& env, const Ort::SessionOptions& options) {
     std::string image_model_file;
     std::string text_model_file;
     
@@ -235,17 +558,16 @@ OnnxClip::_loadModels(const std::string& model, bool silent, const std::string&
     auto text_path = cache_path / text_model_file;
 
     return {
-        loadModel(image_path.string(), silent),
-        loadModel(text_path.string(), silent)
+        _loadModel(image_path.string(), silent, env, options),
+        _loadModel(text_path.string(), silent, env, options)
     };
 }
 
-std::unique_ptr<Ort::Session> OnnxClip::_loadModel(const std::string& path, bool silent) {
+std::unique_ptr<Ort::Session> OnnxClip::_loadModel(const std::string& path, bool silent,
+                                                   Ort::Env& env, const Ort::SessionOptions& options) {
     try {
         if (std::filesystem::exists(path)) {
-            return std::make_unique<Ort::Session>(Ort::Env(ORT_LOGGING_LEVEL_WARNING, "CLIP"), 
-                                                path.c_str(), 
-                                                Ort::SessionOptions{nullptr});
+            return std::make_unique<Ort::Session>(env, path.c_str(), options);
         }
     } catch (const Ort::Exception& e) {
         if (!silent) {
@@ -265,12 +587,10 @@ std::unique_ptr<Ort::Session> OnnxClip::_loadModel(const std::string& path, bool
     
     // Download to temporary file first
     std::string temp_path = path + ".part";
-    downloadFile(url, temp_path);
+    _downloadFile(url, temp_path);
     std::filesystem::rename(temp_path, path);
 
-    return std::make_unique<Ort::Session>(Ort::Env(ORT_LOGGING_LEVEL_WARNING, "CLIP"), 
-                                        path.c_str(), 
-                                        Ort::SessionOptions{nullptr});
+    return std::make_unique<Ort::Session>(env, path.c_str(), options);
 }
 
 // File download implementation using libcurl
@@ -291,4 +611,11 @@ void OnnxClip::_downloadFile(const std::string& url, const std::string& path) {
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &file);
-    curl_easy_setopt(curl, CURLOPT
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+    CURLcode result = curl_easy_perform(curl);
+    curl_easy_cleanup(curl);
+    if (result != CURLE_OK) {
+        throw std::runtime_error("Failed to download " + url + ": " + curl_easy_strerror(result));
+    }
+}
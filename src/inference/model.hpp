@@ -3,23 +3,103 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <span>
+#include <unordered_map>
+#include <string_view>
 #include <opencv2/opencv.hpp>
 #include <onnxruntime_cxx_api.h>
-#include "preprocessor.h"
-#include "tokenizer.h"
+#include "preprocessor.hpp"
+#include "tokenizer.hpp"
+#include "thread_pool.hpp"
+#include "batch_scheduler.hpp"
+#include "object_pool.hpp"
+#include "text_embedding_cache.hpp"
+#include "image_embedding_cache.hpp"
 
+// ONNX Runtime threading and optimisation settings, applied to both models
+struct OnnxClipConfig {
+    int                     intra_op_threads {0};       // 0: ORT's default, one per physical core
+    int                     inter_op_threads {0};       // only used by parallel execution
+    bool                    parallel_execution {false}; // ORT_PARALLEL rather than ORT_SEQUENTIAL
+    GraphOptimizationLevel  optimization_level {ORT_ENABLE_ALL};
+    bool                    allow_spinning {true};      // busy-wait for work between ops
+
+    // Run both sessions on one set of pools owned by the env, sized by the
+    // thread counts above, instead of one intra-op pool per session
+    bool                    global_thread_pools {false};
+};
+
+/**
+ * CLIP image and text models on ONNX Runtime.
+ *
+ * One instance is meant to be shared by any number of threads. The sessions,
+ * tokenizer tables and preprocessing pool are shared and not modified by
+ * embedding calls: Session::Run is re-entrant, the tokenizer's only mutable
+ * state is its internally locked BPE cache, and the pool serves callers in
+ * turn. Everything a call writes to (model inputs, IoBindings, token
+ * buffers) lives in a Scratch leased from a pool for the duration of the
+ * call, so N threads cost at most N sets of buffers, not N copies of the
+ * models.
+ *
+ * That is the design; it has not been tested yet. model_test has a stress
+ * test of concurrent calls on one instance, but it has not been built or
+ * run against ONNX Runtime.
+ */
 class OnnxClip {
 public:
     // Constructor
-    OnnxClip(const std::string& model = "ViT-B/32", 
+    OnnxClip(const std::string& model = "ViT-B/32",
              int batch_size = 0,
              bool silent_download = false,
-             const std::string& cache_dir = "");
+             const std::string& cache_dir = "",
+             int preprocess_threads = 0,
+             const OnnxClipConfig& config = {});
 
-    // Main public interface
+    // Main public interface. Images are preprocessed in parallel; if one fails
+    // to preprocess, std::runtime_error names it
     cv::Mat getImageEmbeddings(const std::vector<cv::Mat>& images, bool with_batching = true);
     cv::Mat getTextEmbeddings(const std::vector<std::string>& texts, bool with_batching = true);
 
+    // Same, with the models writing size() x getEmbeddingSize() floats
+    // straight to `out`. Inputs are prepared in scratch buffers bound to the
+    // sessions and kept across calls, so a steady stream of batches allocates
+    // and copies nothing on the way through the model. Image failures do not
+    // stop the batch: each image gets its preprocessing error message, empty
+    // on success, and a failed image's row is zero-filled
+    std::vector<std::string> getImageEmbeddings(const std::vector<cv::Mat>& images, float* out,
+                                                bool with_batching = true);
+    void getTextEmbeddings(const std::vector<std::string>& texts, float* out, bool with_batching = true);
+
+    // Embeddings of encoded images (JPEG, PNG, ...), decoded at reduced scale
+    // where possible; with an image cache, keyed by the encoded bytes
+    std::vector<std::string> getImageEmbeddings(std::span<const std::span<const uint8_t>> encoded, float* out,
+                                                bool with_batching = true);
+
+    // Embeddings of the tiles of one image, run batch_size tiles at a time, or
+    // all at once without a batch size. Row i belongs to tiles[i], the tile's
+    // area in source pixel coordinates
+    cv::Mat getImageEmbeddings(const cv::Mat& image, const CLIPpreprocessor::Tiling& tiling,
+                               std::vector<cv::Rect2d>& tiles);
+
+    // Cache text embeddings across calls, keyed by this model and the
+    // normalized prompt; may be shared with other instances and models.
+    // Duplicate prompts within a call are embedded once with or without a
+    // cache. Not synchronised: set it before sharing the instance
+    void setTextCache(std::shared_ptr<TextEmbeddingCache> cache);
+    const std::shared_ptr<TextEmbeddingCache>& textCache() const { return text_cache; }
+
+    // Cache image embeddings by content hash: a repeated image, within a call
+    // or across calls, skips preprocessing and the model. The cache must hold
+    // getEmbeddingSize() floats per entry. Not synchronised: set it before
+    // sharing the instance. Tiled calls are not cached
+    void setImageCache(std::shared_ptr<ImageEmbeddingCache> cache);
+    const std::shared_ptr<ImageEmbeddingCache>& imageCache() const { return image_cache; }
+
+    // Text embeddings with inputs grouped by token count; each bucket runs with its
+    // sequence length trimmed to the longest member when the text model allows it.
+    // Deduplicated and cached like getTextEmbeddings
+    cv::Mat getTextEmbeddingsBucketed(const std::vector<std::string>& texts);
+
     // Helper functions for similarity scoring
     static cv::Mat getSimilarityScores(const cv::Mat& embeddings1, const cv::Mat& embeddings2);
     static cv::Mat cosineSimilarity(const cv::Mat& embeddings1, const cv::Mat& embeddings2);
@@ -27,33 +107,127 @@ public:
 
     // Getters
     int getEmbeddingSize() const { return embedding_size; }
+    bool hasDynamicTextLength() const { return text_dynamic_length; }
 
 private:
+    struct KeyHash {
+        size_t operator()(const ImageEmbeddingCache::Key& key) const { return key.hash; }
+    };
+
+    // Per-call state: IoBindings of both sessions and the input buffers bound
+    // to them, grown to the largest batch seen and never shrunk
+    struct Scratch {
+        Scratch(Ort::Session& image_model, Ort::Session& text_model)
+            : image_binding(image_model), text_binding(text_model) {}
+
+        Ort::IoBinding                  image_binding;
+        Ort::IoBinding                  text_binding;
+        Tensor                          image_input;
+        std::vector<int64_t>            text_input;
+        std::vector<std::string_view>   text_views;
+        std::vector<int64_t>            bucket_input;
+        std::vector<float>              bucket_output;
+
+        // Prompt deduplication and cache lookups
+        std::vector<std::string>        text_keys;
+        std::vector<size_t>             text_sources;
+        std::vector<size_t>             text_misses;
+        std::vector<float>              text_output;
+        std::unordered_map<std::string_view, size_t> text_unique;
+
+        // Image cache lookups
+        std::vector<ImageEmbeddingCache::Key> image_keys;
+        std::vector<size_t>             image_sources;
+        std::vector<size_t>             image_misses;
+        std::vector<float>              image_output;
+        std::unordered_map<ImageEmbeddingCache::Key, size_t, KeyHash> image_unique;
+    };
+
     // Private helper functions
-    static std::pair<std::unique_ptr<Ort::Session>, std::unique_ptr<Ort::Session>> 
-    _loadModels(const std::string& model, bool silent, const std::string& cache_dir);
-    
-    static std::unique_ptr<Ort::Session> 
-    _loadModel(const std::string& path, bool silent);
-    
-    cv::Mat 
-	getEmptyEmbedding() const;
-    
-    template<typename T>
-    std::vector<std::vector<T>> 
-	_toBatches(const std::vector<T>& items, int size) const;
-    
-    static void 
-	_downloadFile(const std::string& url, const std::string& path);
-    static cv::Mat 
-	_normalizeEmbeddings(const cv::Mat& embeddings);
+    static std::pair<std::unique_ptr<Ort::Session>, std::unique_ptr<Ort::Session>>
+    _loadModels(const std::string& model, bool silent, const std::string& cache_dir,
+                Ort::Env& env, const Ort::SessionOptions& options);
+
+    static std::unique_ptr<Ort::Session>
+    _loadModel(const std::string& path, bool silent, Ort::Env& env, const Ort::SessionOptions& options);
+
+    static Ort::Env
+    _createEnv(const OnnxClipConfig& config);
+
+    static Ort::SessionOptions
+    _sessionOptions(const OnnxClipConfig& config);
+
+    cv::Mat
+    getEmptyEmbedding() const;
+
+    template <typename Input>
+    std::vector<std::string>
+    embedImages(std::span<const Input> images, float* out, bool with_batching);
+
+    static float*
+    imageInput(Scratch& scratch, size_t rows);
+
+    void
+    runImageModel(Scratch& scratch, float* pixels, size_t rows, float* out);
+
+    void
+    embedTexts(const std::vector<std::string>& texts, float* out, bool with_batching, bool bucketed);
+
+    void
+    runTexts(Scratch& scratch, std::span<const std::string_view> texts, float* out);
+
+    void
+    runBuckets(Scratch& scratch, std::span<const std::string_view> texts, size_t max_rows, float* out);
+
+    void
+    runTextModel(Scratch& scratch, int64_t* tokens, size_t rows, int64_t seq_len, float* out);
+
+    void
+    runBound(Ort::Session& session, Ort::IoBinding& binding, const char* input_name,
+             Ort::Value& input, size_t rows, float* out);
+
+    static void
+    _downloadFile(const std::string& url, const std::string& path);
+
+    static cv::Mat
+    _normalizeEmbeddings(const cv::Mat& embeddings);
+
+    std::string                             model_id;
+    int                                     embedding_size;
+    int                                     batch_size;
+    std::unique_ptr<ThreadPool>             preprocess_pool;
+    std::unique_ptr<CLIPTokenizer>          tokenizer;
+    Ort::Env                                env;                            // declared before the sessions, so it outlives them
+    std::unique_ptr<Ort::Session>           image_model;
+    std::unique_ptr<Ort::Session>           text_model;
+    bool                                    text_dynamic_length {false};    // TEXT accepts [N, L<=77]
+    const Ort::MemoryInfo                   memory_info {Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU)};
+    ObjectPool<Scratch>                     scratch_pool;                   // one Scratch per concurrent call
+    std::shared_ptr<TextEmbeddingCache>     text_cache;
+    std::shared_ptr<ImageEmbeddingCache>    image_cache;
+};
+
+/**
+ * Asynchronous front end for single-image and single-prompt requests from
+ * many threads. Each tower has its own BatchScheduler queue, so concurrent
+ * requests are coalesced into one batched getImageEmbeddings() or
+ * getTextEmbeddings() call. The two towers run independently, and `clip`
+ * stays usable directly alongside the scheduler.
+ */
+class OnnxClipScheduler {
+public:
+    using Config = BatchSchedulerConfig;
+    using Stats = BatchSchedulerStats;
+
+    explicit OnnxClipScheduler(OnnxClip& clip, const Config& image_config = {}, const Config& text_config = {});
+
+    std::future<std::vector<float>> submitImage(cv::Mat image);
+    std::future<std::vector<float>> submitText(std::string text);
+
+    Stats imageStats() const { return images.stats(); }
+    Stats textStats() const { return texts.stats(); }
+
 private:
-	private:
-	int 							embedding_size;
-    int 							batch_size;
-    std::unique_ptr<Preprocessor> 	preprocessor;
-    std::unique_ptr<CLIPTokenizer> 	tokenizer;
-    std::unique_ptr<Ort::Session> 	image_model;
-    std::unique_ptr<Ort::Session> 	text_model;
-    Ort::Env 						env;
+    BatchScheduler<cv::Mat>         images;
+    BatchScheduler<std::string>     texts;
 };
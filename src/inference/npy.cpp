@@ -0,0 +1,216 @@
+#include "npy.hpp"
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char   NPY_MAGIC[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+static const size_t NPY_PREAMBLE_SIZE = 10;    // magic, version, 2-byte header size
+static const size_t NPY_ALIGNMENT = 64;        // np.save pads the header to this
+
+/**
+ * Parse the Python dict literal of a .npy header, e.g.
+ * "{'descr': '<f4', 'fortran_order': False, 'shape': (1, 3, 224, 224), }"
+ *
+ * @returns shape vector<int64_t>: Dimensions; throws for anything but '<f4' C order
+ */
+static std::vector<int64_t> parse_header(const std::string& header) {
+    auto value_of = [&](const char* key) {
+        size_t pos = header.find(key);
+        if (pos == std::string::npos || (pos = header.find(':', pos)) == std::string::npos) {
+            throw std::runtime_error(std::string("Missing ") + key + " in .npy header");
+        }
+        return pos + 1;
+    };
+
+    size_t descr = header.find_first_of("'\"", value_of("'descr'"));
+    if (descr == std::string::npos || header.compare(descr + 1, 3, "<f4") != 0) {
+        throw std::runtime_error("Only little-endian float32 ('<f4') .npy data is supported");
+    }
+
+    size_t order = header.find_first_not_of(' ', value_of("'fortran_order'"));
+    if (order == std::string::npos || header.compare(order, 5, "False") != 0) {
+        throw std::runtime_error("Only C-order .npy data is supported");
+    }
+
+    size_t open = header.find('(', value_of("'shape'"));
+    size_t close = header.find(')', open);
+    if (open == std::string::npos || close == std::string::npos) {
+        throw std::runtime_error("Malformed shape in .npy header");
+    }
+
+    std::vector<int64_t> shape;
+    const char* p = header.c_str() + open + 1;
+    const char* end = header.c_str() + close;
+    while (p < end) {
+        if (*p == ' ' || *p == ',') {
+            ++p;
+            continue;
+        }
+        char* next;
+        long long dim = std::strtoll(p, &next, 10);
+        if (next == p || dim < 0) {
+            throw std::runtime_error("Malformed shape in .npy header");
+        }
+        shape.push_back(dim);
+        p = next;
+    }
+    return shape;
+}
+
+/**
+ * Map a .npy file copy-on-write and point the view at its data. Nothing is
+ * read up front; pages come in as the data is touched.
+ *
+ * @param[in] path str: Path to a '<f4' C-order .npy file
+ */
+NpyArray NpyArray::load(const std::string& path) {
+    if constexpr (std::endian::native != std::endian::little) {
+        throw std::runtime_error("Mapping '<f4' .npy data needs a little-endian host");
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening .npy file: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(NPY_PREAMBLE_SIZE)) {
+        ::close(fd);
+        throw std::runtime_error("Invalid .npy file: " + path);
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map .npy file: " + path);
+    }
+
+    NpyArray result;
+    result.mapping = mapping;
+    result.mapping_size = size;
+
+    const auto* bytes = static_cast<const uint8_t*>(mapping);
+    if (std::memcmp(bytes, NPY_MAGIC, sizeof(NPY_MAGIC)) != 0) {
+        throw std::runtime_error("Not a .npy file: " + path);
+    }
+
+    // Version 1.0 stores the header size in 2 bytes, 2.0 and 3.0 in 4
+    uint8_t major = bytes[6];
+    size_t header_pos = major == 1 ? NPY_PREAMBLE_SIZE : NPY_PREAMBLE_SIZE + 2;
+    if (major < 1 || major > 3 || size < header_pos) {
+        throw std::runtime_error("Unsupported .npy version in: " + path);
+    }
+    size_t header_size = bytes[8] | (bytes[9] << 8);
+    if (major > 1) {
+        header_size |= (static_cast<size_t>(bytes[10]) << 16) | (static_cast<size_t>(bytes[11]) << 24);
+    }
+
+    size_t data_pos = header_pos + header_size;
+    if (data_pos > size || data_pos % alignof(float) != 0) {
+        throw std::runtime_error("Invalid .npy header in: " + path);
+    }
+
+    try {
+        result.dims = parse_header(std::string(reinterpret_cast<const char*>(bytes) + header_pos, header_size));
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + ": " + path);
+    }
+    if (result.numel() > (size - data_pos) / sizeof(float)) {
+        throw std::runtime_error("Truncated .npy file: " + path);
+    }
+
+    result.values = reinterpret_cast<float*>(static_cast<uint8_t*>(mapping) + data_pos);
+    return result;
+}
+
+/**
+ * Write a version 1.0 .npy file that np.load() reads back unchanged
+ *
+ * @param[in] path str: Output path
+ * @param[in] data float*: TensorView::numel(shape) values in C order
+ * @param[in] shape vector<int64_t>: Dimensions
+ */
+void NpyArray::save(const std::string& path, const float* data, const std::vector<int64_t>& shape) {
+    if constexpr (std::endian::native != std::endian::little) {
+        throw std::runtime_error("Writing '<f4' .npy data needs a little-endian host");
+    }
+
+    std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (";
+    for (int64_t dim : shape) {
+        header += std::to_string(dim) + ", ";
+    }
+    if (shape.size() > 1) {
+        header.pop_back();  // numpy writes "(3,)" but "(1, 3)"
+    }
+    if (!shape.empty()) {
+        header.back() = ')';
+    } else {
+        header += ')';
+    }
+    header += ", }";
+
+    // Pad with spaces so the data starts aligned, and end with a newline
+    size_t total = NPY_PREAMBLE_SIZE + header.size() + 1;
+    header.append((NPY_ALIGNMENT - total % NPY_ALIGNMENT) % NPY_ALIGNMENT, ' ');
+    header += '\n';
+    if (header.size() > 0xFFFF) {
+        throw std::runtime_error("Shape too long for a version 1.0 .npy header");
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const char preamble[NPY_PREAMBLE_SIZE] = {
+        NPY_MAGIC[0], NPY_MAGIC[1], NPY_MAGIC[2], NPY_MAGIC[3], NPY_MAGIC[4], NPY_MAGIC[5], 1, 0,
+        static_cast<char>(header.size() & 0xFF), static_cast<char>(header.size() >> 8)};
+    file.write(preamble, sizeof(preamble));
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char*>(data),
+               static_cast<std::streamsize>(TensorView::numel(shape) * sizeof(float)));
+    if (!file) {
+        throw std::runtime_error("Error writing .npy file: " + path);
+    }
+}
+
+void NpyArray::save(const std::string& path, const TensorView& tensor) {
+    save(path, tensor.data(), tensor.shape());
+}
+
+Tensor NpyArray::to_tensor() const {
+    Tensor tensor(dims);
+    if (numel() > 0) {
+        std::memcpy(tensor.data(), values, numel() * sizeof(float));
+    }
+    return tensor;
+}
+
+NpyArray::NpyArray(NpyArray&& other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      mapping_size(std::exchange(other.mapping_size, 0)),
+      values(std::exchange(other.values, nullptr)),
+      dims(std::move(other.dims)) {}
+
+NpyArray& NpyArray::operator=(NpyArray&& other) noexcept {
+    if (this != &other) {
+        if (mapping) {
+            ::munmap(mapping, mapping_size);
+        }
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        values = std::exchange(other.values, nullptr);
+        dims = std::move(other.dims);
+    }
+    return *this;
+}
+
+NpyArray::~NpyArray() {
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef CLIP_NPY_H
+#define CLIP_NPY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tensor.hpp"
+
+/**
+ * NumPy .npy file holding a float32 array, memory-mapped.
+ *
+ * Reads versions 1.0 to 3.0 of the format with a little-endian float32
+ * ('<f4') C-order array, which is what np.save writes for the references
+ * produced by the Python CLIP pipeline. The data is used in place: view()
+ * points into the mapping, so loading costs no parsing or copying. The
+ * mapping is private, so writes through the view never reach the file.
+ */
+class NpyArray {
+public:
+    // Map `path`; throws std::runtime_error if it is not a '<f4' C-order .npy
+    static NpyArray load(const std::string& path);
+
+    // Write `data` (numel(shape) floats) as a version 1.0 '<f4' .npy file
+    static void     save(const std::string& path, const float* data, const std::vector<int64_t>& shape);
+    static void     save(const std::string& path, const TensorView& tensor);
+
+    NpyArray(NpyArray&& other) noexcept;
+    NpyArray& operator=(NpyArray&& other) noexcept;
+    NpyArray(const NpyArray&) = delete;
+    NpyArray& operator=(const NpyArray&) = delete;
+    ~NpyArray();
+
+    const std::vector<int64_t>& shape() const { return dims; }
+    size_t                      numel() const { return TensorView::numel(dims); }
+    const float*                data() const { return values; }
+    TensorView                  view() const { return TensorView(values, dims); }
+
+    // Owned copy, e.g. to keep past the lifetime of the mapping
+    Tensor                      to_tensor() const;
+
+private:
+    NpyArray() = default;
+
+    void*                   mapping {nullptr};
+    size_t                  mapping_size {0};
+    float*                  values {nullptr};
+    std::vector<int64_t>    dims;
+};
+
+#endif // CLIP_NPY_H
@@ -0,0 +1,88 @@
+#ifndef CLIP_OBJECT_POOL_H
+#define CLIP_OBJECT_POOL_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Pool of reusable per-call state, e.g. scratch buffers that grow to the
+ * largest batch seen.
+ *
+ * acquire() hands out an idle object, or makes one with the factory when
+ * all are in use, and the returned Lease gives it back on destruction. So
+ * at most as many objects exist as there were concurrent callers, and a
+ * thread never sees another thread's object while it holds the lease.
+ * The pool must outlive its leases.
+ */
+template <typename T>
+class ObjectPool {
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept
+            : pool(std::exchange(other.pool, nullptr)), object(std::move(other.object)) {}
+        Lease& operator=(Lease&&) = delete;
+        Lease(const Lease&) = delete;
+        ~Lease() {
+            if (pool && object) {
+                pool->release(std::move(object));
+            }
+        }
+
+        T&      operator*() const { return *object; }
+        T*      operator->() const { return object.get(); }
+
+    private:
+        friend class ObjectPool;
+        Lease(ObjectPool* pool, std::unique_ptr<T> object) : pool(pool), object(std::move(object)) {}
+
+        ObjectPool*         pool;
+        std::unique_ptr<T>  object;
+    };
+
+    explicit ObjectPool(Factory factory = []() { return std::make_unique<T>(); })
+        : factory(std::move(factory)) {}
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    Lease acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                std::unique_ptr<T> object = std::move(idle.back());
+                idle.pop_back();
+                return Lease(this, std::move(object));
+            }
+        }
+
+        std::unique_ptr<T> object = factory();
+        std::lock_guard<std::mutex> lock(mutex);
+        ++created_count;
+        return Lease(this, std::move(object));
+    }
+
+    // Objects made so far, idle or leased
+    size_t  created() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return created_count;
+    }
+
+private:
+    void release(std::unique_ptr<T> object) {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(object));
+    }
+
+    Factory                         factory;
+    std::vector<std::unique_ptr<T>> idle;
+    size_t                          created_count {0};
+    mutable std::mutex              mutex;
+};
+
+#endif // CLIP_OBJECT_POOL_H
@@ -0,0 +1,290 @@
+#include "pixel_cache.hpp"
+#include "content_hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+static const char       SHARD_MAGIC[8] = {'C', 'L', 'I', 'P', 'P', 'I', 'X', '\0'};
+static const char       INDEX_MAGIC[8] = {'C', 'L', 'I', 'P', 'P', 'I', 'D', 'X'};
+static const uint32_t   BYTE_ORDER_MARK = 0x01020304;
+
+// Key of an encoded image, see content_hash.hpp
+PixelCache::Key PixelCache::key(std::span<const uint8_t> bytes) {
+    return Key {xxh64(bytes), bytes.size()};
+}
+
+PixelCache::PixelCache(const std::string& directory, int width, int height)
+    : record_width(width), record_height(height) {
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument("Pixel cache records need a positive size.");
+    }
+    std::filesystem::create_directories(directory);
+    try {
+        open_shard((std::filesystem::path(directory) / "pixels.bin").string());
+        load_index((std::filesystem::path(directory) / "pixels.idx").string());
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+PixelCache::~PixelCache() {
+    close();
+}
+
+void PixelCache::close() {
+    if (mapping) {
+        ::munmap(const_cast<uint8_t*>(mapping), mapping_size);
+        mapping = nullptr;
+    }
+    if (shard_fd >= 0) {
+        ::close(shard_fd);
+        shard_fd = -1;
+    }
+    if (index_fd >= 0) {
+        ::close(index_fd);
+        index_fd = -1;
+    }
+}
+
+/**
+ * Open or create the record shard and check it holds records of our size.
+ * A partial record at the end, from an interrupted write, is skipped.
+ */
+void PixelCache::open_shard(const std::string& path) {
+    shard_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (shard_fd < 0) {
+        throw std::runtime_error("Error opening pixel cache shard: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(shard_fd, &st) != 0) {
+        throw std::runtime_error("Error reading pixel cache shard: " + path);
+    }
+
+    Header header {};
+    if (st.st_size == 0) {
+        std::memcpy(header.magic, SHARD_MAGIC, sizeof(SHARD_MAGIC));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.version = FORMAT_VERSION;
+        header.width = static_cast<uint32_t>(record_width);
+        header.height = static_cast<uint32_t>(record_height);
+        header.channels = 3;
+        header.record_size = record_size();
+        if (::pwrite(shard_fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header))) {
+            throw std::runtime_error("Error writing pixel cache shard: " + path);
+        }
+        return;
+    }
+
+    if (::pread(shard_fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header)) ||
+        std::memcmp(header.magic, SHARD_MAGIC, sizeof(SHARD_MAGIC)) != 0) {
+        throw std::runtime_error("Not a pixel cache shard: " + path);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK || header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Pixel cache shard has the wrong byte order or version: " + path);
+    }
+    if (header.width != static_cast<uint32_t>(record_width) || header.height != static_cast<uint32_t>(record_height) ||
+        header.channels != 3 || header.record_size != record_size()) {
+        throw std::runtime_error("Pixel cache shard holds " + std::to_string(header.width) + "x" +
+                                 std::to_string(header.height) + " records: " + path);
+    }
+
+    uint64_t payload = static_cast<uint64_t>(st.st_size) - sizeof(Header);
+    record_count = (payload + record_size() - 1) / record_size();
+    remap(payload / record_size());
+}
+
+/**
+ * Read every index entry whose record is complete in the shard. A torn
+ * entry at the end is cut off, so the next append starts on an entry
+ * boundary again.
+ */
+void PixelCache::load_index(const std::string& path) {
+    index_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (index_fd < 0) {
+        throw std::runtime_error("Error opening pixel cache index: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(index_fd, &st) != 0) {
+        throw std::runtime_error("Error reading pixel cache index: " + path);
+    }
+
+    struct IndexHeader {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+    } header {};
+
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.version = FORMAT_VERSION;
+        if (::pwrite(index_fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+            throw std::runtime_error("Error writing pixel cache index: " + path);
+        }
+        ::lseek(index_fd, 0, SEEK_END);
+        return;
+    }
+
+    if (::pread(index_fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header.byte_order != BYTE_ORDER_MARK || header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Not a compatible pixel cache index: " + path);
+    }
+
+    size_t count = (size - sizeof(header)) / sizeof(Entry);
+    std::vector<Entry> entries(count);
+    size_t bytes = count * sizeof(Entry);
+    if (bytes && ::pread(index_fd, entries.data(), bytes, sizeof(header)) != static_cast<ssize_t>(bytes)) {
+        throw std::runtime_error("Error reading pixel cache index: " + path);
+    }
+    if (sizeof(header) + bytes != size && ::ftruncate(index_fd, static_cast<off_t>(sizeof(header) + bytes)) != 0) {
+        throw std::runtime_error("Error repairing pixel cache index: " + path);
+    }
+    ::lseek(index_fd, 0, SEEK_END);
+
+    uint64_t complete = (mapping_size - std::min(mapping_size, sizeof(Header))) / record_size();
+    records.reserve(count);
+    for (const Entry& entry : entries) {
+        if (entry.record < complete) {
+            records[Key {entry.hash, entry.size}] = entry.record;
+        }
+    }
+}
+
+void PixelCache::remap(uint64_t records_needed) {
+    size_t needed = sizeof(Header) + records_needed * record_size();
+    if (mapping_size >= needed) {
+        return;
+    }
+
+    struct stat st;
+    if (::fstat(shard_fd, &st) != 0 || static_cast<size_t>(st.st_size) < needed) {
+        throw std::runtime_error("Pixel cache shard is shorter than its index.");
+    }
+
+    // Map everything written so far, so later lookups rarely need to remap
+    void* fresh = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, shard_fd, 0);
+    if (fresh == MAP_FAILED) {
+        throw std::runtime_error("Failed to map pixel cache shard.");
+    }
+    if (mapping) {
+        ::munmap(const_cast<uint8_t*>(mapping), mapping_size);
+    }
+    mapping = static_cast<const uint8_t*>(fresh);
+    mapping_size = static_cast<size_t>(st.st_size);
+}
+
+bool PixelCache::lookup(const Key& key, uint8_t* pixels) {
+    uint64_t record;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = records.find(key);
+        if (it == records.end()) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        record = it->second;
+        if (sizeof(Header) + (record + 1) * record_size() <= mapping_size) {
+            std::memcpy(pixels, mapping + sizeof(Header) + record * record_size(), record_size());
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Written since the shard was last mapped
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    remap(record + 1);
+    std::memcpy(pixels, mapping + sizeof(Header) + record * record_size(), record_size());
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void PixelCache::insert(const Key& key, const uint8_t* pixels, size_t stride) {
+    if (!writable.load(std::memory_order_relaxed)) {
+        return;
+    }
+    try {
+        write_record(key, pixels, stride);
+    } catch (const std::exception& e) {
+        disable_writes(e);
+    }
+}
+
+/**
+ * Stop inserting after an I/O error, so a full or failing disk costs the
+ * cache its new records rather than the caller its image. Records already
+ * indexed stay readable. A record slot reserved by the failed write is never
+ * indexed, and a torn index entry is cut off on the next open.
+ */
+void PixelCache::disable_writes(const std::exception& error) {
+    write_errors.fetch_add(1, std::memory_order_relaxed);
+    if (writable.exchange(false)) {
+        spdlog::warn("Pixel cache: {} Inserts disabled.", error.what());
+    }
+}
+
+/**
+ * The record slot is reserved under the lock but written outside it, so
+ * concurrent inserts do not serialise on I/O. The index entry is appended
+ * only once the record is in the file.
+ */
+void PixelCache::write_record(const Key& key, const uint8_t* pixels, size_t stride) {
+    uint64_t record;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (records.count(key)) {
+            return;
+        }
+        record = record_count++;
+    }
+
+    const size_t row_bytes = static_cast<size_t>(record_width) * 3;
+    std::vector<uint8_t> packed;
+    const uint8_t* data = pixels;
+    if (stride != row_bytes) {
+        packed.resize(record_size());
+        for (int y = 0; y < record_height; ++y) {
+            std::memcpy(packed.data() + y * row_bytes, pixels + y * stride, row_bytes);
+        }
+        data = packed.data();
+    }
+
+    off_t offset = static_cast<off_t>(sizeof(Header) + record * record_size());
+    if (::pwrite(shard_fd, data, record_size(), offset) != static_cast<ssize_t>(record_size())) {
+        throw std::runtime_error("Error writing pixel cache shard.");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (records.count(key)) {
+        return;  // another thread stored the same image meanwhile; the record stays unused
+    }
+    Entry entry {key.hash, key.size, record};
+    if (::write(index_fd, &entry, sizeof(Entry)) != static_cast<ssize_t>(sizeof(Entry))) {
+        throw std::runtime_error("Error writing pixel cache index.");
+    }
+    records[key] = record;
+    inserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+PixelCache::Stats PixelCache::stats() const {
+    Stats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.inserts = inserts.load(std::memory_order_relaxed);
+    stats.write_errors = write_errors.load(std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    stats.entries = records.size();
+    return stats;
+}
@@ -0,0 +1,126 @@
+#ifndef CLIP_PIXEL_CACHE_H
+#define CLIP_PIXEL_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Persistent cache of preprocessed images: source bytes -> the 8-bit crop
+ * that normalization starts from.
+ *
+ * A cache directory holds two append-only files. `pixels.bin` is a shard of
+ * fixed-size records, width x height x 3 BGR bytes each, after a small
+ * header; it is memory-mapped for lookups. `pixels.idx` lists (key, record)
+ * pairs and is read into a hash map on open. A record is written before its
+ * index entry, so an interrupted run leaves at worst an unreferenced record.
+ *
+ * Keys are a 64-bit content hash of the encoded image plus its length, so
+ * re-runs over the same files hit no matter the path they are read from.
+ * Lookups and inserts are thread-safe; only one process should write to a
+ * directory at a time. Files use the native byte order and are rejected on
+ * a mismatch. The cache only saves work, so a failed write (a full disk, say)
+ * is logged and turns inserts off instead of failing the image.
+ */
+class PixelCache {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct Key {
+        uint64_t    hash {0};
+        uint64_t    size {0};
+
+        bool        operator==(const Key& other) const { return hash == other.hash && size == other.size; }
+    };
+
+    struct Stats {
+        uint64_t    hits {0};
+        uint64_t    misses {0};
+        uint64_t    inserts {0};
+        size_t      entries {0};
+        uint64_t    write_errors {0};       // inserts are off after the first
+
+        double      hit_rate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    // Key of an encoded image; XXH64 of the bytes, a few GB/s
+    static Key      key(std::span<const uint8_t> bytes);
+
+    /**
+     * Open the cache in `directory`, creating it if needed. Records are
+     * width x height BGR pixels; an existing cache with another geometry is
+     * rejected with std::runtime_error.
+     */
+    PixelCache(const std::string& directory, int width = 224, int height = 224);
+    ~PixelCache();
+    PixelCache(const PixelCache&) = delete;
+    PixelCache& operator=(const PixelCache&) = delete;
+
+    // Copy the record of `key` to `pixels` (record_size() bytes, rows packed);
+    // returns false on a miss
+    bool            lookup(const Key& key, uint8_t* pixels);
+
+    // Store width x height BGR pixels `stride` bytes apart; no-op if `key`
+    // is already present or inserts were disabled by a write error
+    void            insert(const Key& key, const uint8_t* pixels, size_t stride);
+
+    int             width() const { return record_width; }
+    int             height() const { return record_height; }
+    size_t          record_size() const { return static_cast<size_t>(record_width) * record_height * 3; }
+    Stats           stats() const;
+
+private:
+    struct Header {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    channels;
+        uint32_t    reserved;
+        uint64_t    record_size;
+        char        padding[24];    // records start 64-byte aligned
+    };
+
+    struct Entry {
+        uint64_t    hash;
+        uint64_t    size;
+        uint64_t    record;
+    };
+
+    struct KeyHash {
+        size_t      operator()(const Key& key) const { return key.hash; }
+    };
+
+    void            open_shard(const std::string& path);
+    void            close();
+    void            load_index(const std::string& path);
+    void            write_record(const Key& key, const uint8_t* pixels, size_t stride);
+    void            disable_writes(const std::exception& error);
+
+    // Map at least the first `records` records; caller holds the lock exclusively
+    void            remap(uint64_t records);
+
+    int                                         record_width;
+    int                                         record_height;
+    int                                         shard_fd {-1};
+    int                                         index_fd {-1};
+    const uint8_t*                              mapping {nullptr};
+    size_t                                      mapping_size {0};
+    uint64_t                                    record_count {0};   // next record to write
+    std::unordered_map<Key, uint64_t, KeyHash>  records;
+    mutable std::shared_mutex                   mutex;
+    std::atomic<uint64_t>                       hits {0};
+    std::atomic<uint64_t>                       misses {0};
+    std::atomic<uint64_t>                       inserts {0};
+    std::atomic<uint64_t>                       write_errors {0};
+    std::atomic<bool>                           writable {true};
+};
+
+#endif // CLIP_PIXEL_CACHE_H
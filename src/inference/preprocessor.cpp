@@ -1,74 +1,437 @@
 #include "preprocessor.hpp"
+#include "image_kernels.hpp"
+#include <algorithm>
+#include <mutex>
 
 const std::vector<float> CLIPpreprocessor::NORM_MEAN = {0.48145466f, 0.4578275f, 0.40821073f};
 const std::vector<float> CLIPpreprocessor::NORM_STD = {0.26862954f, 0.26130258f, 0.27577711f};
 
-torch::Tensor CLIPpreprocessor::encode_image(const cv::Mat& img) {
-    cv::Mat float_img = _image_to_float_array(img);
-    cv::Mat resized_img = _crop_and_resize(float_img);
+Tensor CLIPpreprocessor::encode_image(const cv::Mat& img) {
+    Tensor tensor_img({1, 3, CLIP_INPUT_SIZE, CLIP_INPUT_SIZE});
+    encode_image(img, tensor_img.data());
+    return tensor_img;
+}
+
+void CLIPpreprocessor::encode_image(const cv::Mat& img, float* out) {
+    encode_pixels(_to_bgr(img), PixelOrder::BGR, out);
+}
+
+Tensor CLIPpreprocessor::encode_pixels(const cv::Mat& img, PixelOrder order) {
+    Tensor tensor_img({1, 3, CLIP_INPUT_SIZE, CLIP_INPUT_SIZE});
+    encode_pixels(img, order, tensor_img.data());
+    return tensor_img;
+}
 
-    // Normalize channels
-    cv::Mat normalized_img;
-    cv::subtract(resized_img, cv::Scalar(NORM_MEAN[0], NORM_MEAN[1], NORM_MEAN[2]), normalized_img);
-    cv::divide(normalized_img, cv::Scalar(NORM_STD[0], NORM_STD[1], NORM_STD[2]), normalized_img);
+void CLIPpreprocessor::encode_pixels(const cv::Mat& img, PixelOrder order, float* out) {
+    if (img.depth() != CV_8U) {
+        throw std::invalid_argument("The image should have 8-bit unsigned pixels (CV_8U).");
+    }
+    bool alpha = order == PixelOrder::BGRA || order == PixelOrder::RGBA;
+    if (img.channels() != (alpha ? 4 : 3)) {
+        throw std::invalid_argument("The number of image channels does not match the pixel order.");
+    }
 
-    // Convert to torch tensor
-    torch::Tensor tensor_img = torch::from_blob(normalized_img.data, {1, resized_img.rows, resized_img.cols, 3}, torch::kFloat32);
-    tensor_img = tensor_img.permute({0, 3, 1, 2}); // Change to (C, H, W)
+    // Resize and crop on 8-bit pixels, 4x less data than float; alpha is
+    // dropped by the horizontal pass
+    cv::Mat resized_img = _crop_and_resize(img);
+    _normalize(resized_img, order == PixelOrder::BGR || order == PixelOrder::BGRA, out);
+}
 
+/**
+ * Start of every tile along one axis of the resized image: every `stride`
+ * pixels, plus one ending at the border if the steps fall short of it.
+ * None if the axis is shorter than a tile
+ */
+static std::vector<int> tile_offsets(int length, int tile, int stride) {
+    std::vector<int> offsets;
+    if (length < tile) {
+        return offsets;
+    }
+    for (int pos = 0; pos + tile < length; pos += stride) {
+        offsets.push_back(pos);
+    }
+    offsets.push_back(length - tile);
+    return offsets;
+}
+
+/**
+ * Tiles share the 8-bit resize of the whole image; each one is then
+ * normalised straight from its window of that image into its batch slot.
+ *
+ * @param[in] img cv::Mat: 8-bit grayscale or BGR image
+ * @param[in] tiling Tiling: Grid or stride layout
+ * @param[out] tiles vector<Rect2d>: Source area of each tile
+ * @returns batch Tensor: [tiles.size(), 3, 224, 224]
+ */
+Tensor CLIPpreprocessor::encode_tiles(const cv::Mat& img, const Tiling& tiling, std::vector<cv::Rect2d>& tiles) {
+    cv::Mat bgr_img = _to_bgr(img);
+    if (bgr_img.rows * bgr_img.cols == 0) {
+        throw std::invalid_argument("Height and width of the image should both be non-zero.");
+    }
+
+    const int tile = CLIP_INPUT_SIZE;
+    int resized_w, resized_h;
+    std::vector<int> xs, ys;
+    if (tiling.columns != 0 || tiling.rows != 0) {
+        if (tiling.columns <= 0 || tiling.rows <= 0) {
+            throw std::invalid_argument("A tile grid needs at least one column and one row, got " +
+                                        std::to_string(tiling.columns) + "x" + std::to_string(tiling.rows) + ".");
+        }
+        resized_w = tiling.columns * tile;
+        resized_h = tiling.rows * tile;
+        xs = tile_offsets(resized_w, tile, tile);
+        ys = tile_offsets(resized_h, tile, tile);
+    } else if (tiling.short_side >= tile && tiling.stride > 0) {
+        // Long side in double precision, as for the centre crop
+        if (bgr_img.rows < bgr_img.cols) {
+            resized_h = tiling.short_side;
+            resized_w = static_cast<int>(resized_h * static_cast<double>(bgr_img.cols) / bgr_img.rows);
+        } else {
+            resized_w = tiling.short_side;
+            resized_h = static_cast<int>(resized_w * static_cast<double>(bgr_img.rows) / bgr_img.cols);
+        }
+        xs = tile_offsets(resized_w, tile, tiling.stride);
+        ys = tile_offsets(resized_h, tile, tiling.stride);
+    } else {
+        throw std::invalid_argument("A tiling needs a grid of columns x rows, or a short side of at least "
+                                    "CLIP_INPUT_SIZE and a positive stride.");
+    }
+    if (xs.empty() || ys.empty()) {
+        throw std::invalid_argument("The tiling yields no tiles for a " + std::to_string(bgr_img.cols) + "x" +
+                                    std::to_string(bgr_img.rows) + " image.");
+    }
+
+    cv::Mat resized_img(resized_h, resized_w, CV_8UC3);
+    ResizePlan(bgr_img.cols, bgr_img.rows, 3, resized_w, resized_h, 0, 0, resized_w, resized_h)
+        .apply(bgr_img.data, bgr_img.step, resized_img.data, resized_img.step);
+
+    const size_t slot_size = 3 * tile * tile;
+    const double scale_x = static_cast<double>(bgr_img.cols) / resized_w;
+    const double scale_y = static_cast<double>(bgr_img.rows) / resized_h;
+    Tensor batch({static_cast<int64_t>(xs.size() * ys.size()), 3, tile, tile});
+    tiles.clear();
+    for (int y : ys) {
+        for (int x : xs) {
+            ImageKernels::normalize_to_chw(resized_img.ptr<uint8_t>(y) + 3 * x, resized_img.step, tile, tile,
+                                           true, NORM_MEAN.data(), NORM_STD.data(),
+                                           batch.data() + tiles.size() * slot_size);
+            tiles.emplace_back(x * scale_x, y * scale_y, tile * scale_x, tile * scale_y);
+        }
+    }
+    return batch;
+}
+
+Tensor CLIPpreprocessor::encode_nv12(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                                     int width, int height) {
+    Tensor tensor_img({1, 3, CLIP_INPUT_SIZE, CLIP_INPUT_SIZE});
+    encode_nv12(y, y_stride, uv, uv_stride, width, height, tensor_img.data());
     return tensor_img;
 }
 
-cv::Mat CLIPpreprocessor::_crop_and_resize(const cv::Mat& img) {
-    int h = img.rows;
-    int w = img.cols;
+void CLIPpreprocessor::encode_nv12(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                                   int width, int height, float* out) {
+    _encode_yuv420(y, y_stride, uv, uv_stride, uv + 1, uv_stride, 2, width, height, out);
+}
 
-    if (h * w == 0) {
+Tensor CLIPpreprocessor::encode_i420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                                     const uint8_t* v, size_t v_stride, int width, int height) {
+    Tensor tensor_img({1, 3, CLIP_INPUT_SIZE, CLIP_INPUT_SIZE});
+    encode_i420(y, y_stride, u, u_stride, v, v_stride, width, height, tensor_img.data());
+    return tensor_img;
+}
+
+void CLIPpreprocessor::encode_i420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                                   const uint8_t* v, size_t v_stride, int width, int height, float* out) {
+    _encode_yuv420(y, y_stride, u, u_stride, v, v_stride, 1, width, height, out);
+}
+
+/**
+ * The resize plan pulls source rows through a reader instead of an image, and
+ * each row is converted only across the columns its taps cover. The resize
+ * then sees exactly the RGB that a full cvtColor would have produced.
+ *
+ * @param[in] uv_step int: Bytes between chroma samples, 1 (I420) or 2 (NV12)
+ * @param[out] out float*: 3 * 224 * 224 floats, CHW
+ */
+void CLIPpreprocessor::_encode_yuv420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                                      const uint8_t* v, size_t v_stride, int uv_step, int width, int height,
+                                      float* out) {
+    if (width <= 0 || height <= 0) {
         throw std::invalid_argument("Height and width of the image should both be non-zero.");
     }
+    if (!y || !u || !v) {
+        throw std::invalid_argument("The YUV planes should not be null.");
+    }
+
+    auto read = [&](int row, int first, int last, uint8_t* rgb) {
+        ImageKernels::yuv420_to_rgb(y + row * y_stride, u + (row / 2) * u_stride, v + (row / 2) * v_stride,
+                                    uv_step, width, first, last - first, rgb);
+    };
+
+    cv::Mat resized_img(CLIP_INPUT_SIZE, CLIP_INPUT_SIZE, CV_8UC3);
+    resize_plan(width, height, 3)->apply(read, resized_img.data, resized_img.step);
+    _normalize(resized_img, false, out);
+}
+
+void CLIPpreprocessor::_normalize(const cv::Mat& crop, bool bgr, float* out) {
+    // Scale, normalize, swap to RGB if needed and lay out as CHW in one pass,
+    // straight into the caller's memory
+    ImageKernels::normalize_to_chw(crop.data, crop.step, crop.cols, crop.rows,
+                                   bgr, NORM_MEAN.data(), NORM_STD.data(), out);
+}
+
+std::vector<std::string> CLIPpreprocessor::encode_batch(std::span<const cv::Mat> images, float* out,
+                                                        ThreadPool& pool) {
+    return _encode_all(images.size(), out, pool, [&](size_t i, float* slot) { encode_image(images[i], slot); });
+}
+
+Tensor CLIPpreprocessor::encode_image_bytes(std::span<const uint8_t> bytes, PixelCache* cache) {
+    Tensor tensor_img({1, 3, CLIP_INPUT_SIZE, CLIP_INPUT_SIZE});
+    encode_image_bytes(bytes, tensor_img.data(), cache);
+    return tensor_img;
+}
+
+/**
+ * The cache holds the crop right before normalization, so a hit costs one
+ * hash of the encoded bytes, a 150 KB copy and the normalize pass.
+ *
+ * @param[in] bytes span<uint8_t>: Encoded image
+ * @param[out] out float*: 3 * 224 * 224 floats, CHW
+ * @param[in] cache PixelCache*: Optional crop cache of CLIP_INPUT_SIZE records
+ */
+void CLIPpreprocessor::encode_image_bytes(std::span<const uint8_t> bytes, float* out, PixelCache* cache) {
+    if (cache && (cache->width() != CLIP_INPUT_SIZE || cache->height() != CLIP_INPUT_SIZE)) {
+        throw std::invalid_argument("The pixel cache should hold CLIP_INPUT_SIZE x CLIP_INPUT_SIZE records.");
+    }
+
+    PixelCache::Key key;
+    if (cache) {
+        key = PixelCache::key(bytes);
+        cv::Mat cropped_img(CLIP_INPUT_SIZE, CLIP_INPUT_SIZE, CV_8UC3);
+        if (cache->lookup(key, cropped_img.data)) {
+            _normalize(cropped_img, true, out);
+            return;
+        }
+    }
+
+    cv::Mat img = decode_image(bytes);
+    if (img.empty()) {
+        throw std::invalid_argument("Could not decode the image bytes.");
+    }
+    cv::Mat cropped_img = _crop_and_resize(img);
+    if (cache) {
+        cache->insert(key, cropped_img.data, cropped_img.step);
+    }
+    _normalize(cropped_img, true, out);
+}
+
+std::vector<std::string> CLIPpreprocessor::encode_batch_bytes(std::span<const std::span<const uint8_t>> images,
+                                                              float* out, PixelCache* cache, ThreadPool& pool) {
+    return _encode_all(images.size(), out, pool,
+                       [&](size_t i, float* slot) { encode_image_bytes(images[i], slot, cache); });
+}
+
+/**
+ * Slots are disjoint, so workers need no synchronisation beyond the pool's own;
+ * errors are collected per index rather than thrown, which would abandon the
+ * rest of the batch.
+ *
+ * @param[in] count size_t: Number of images
+ * @param[out] out float*: count * 3 * 224 * 224 floats
+ * @param[in] pool ThreadPool&: Pool to run on
+ * @param[in] encode function<void(size_t, float*)>: Encodes image i into its slot
+ * @returns errors vector<string>: One entry per image, empty on success
+ */
+std::vector<std::string> CLIPpreprocessor::_encode_all(size_t count, float* out, ThreadPool& pool,
+                                                       const std::function<void(size_t, float*)>& encode) {
+    const size_t slot_size = 3 * CLIP_INPUT_SIZE * CLIP_INPUT_SIZE;
+    std::vector<std::string> errors(count);
+
+    pool.parallel_for(count, [&](size_t i) {
+        float* slot = out + i * slot_size;
+        try {
+            encode(i, slot);
+        } catch (const std::exception& e) {
+            std::fill(slot, slot + slot_size, 0.0f);
+            errors[i] = e.what();
+            if (errors[i].empty()) {
+                errors[i] = "Unknown preprocessing error.";
+            }
+        }
+    });
+
+    return errors;
+}
+
+/**
+ * libjpeg can run the inverse DCT at 1/2, 1/4 or 1/8 scale, which skips most
+ * of the decode work. The factor is chosen from the frame header so that the
+ * decoded short side, ceil(side / factor), still covers the CLIP input.
+ *
+ * @param[in] bytes span<uint8_t>: Encoded image
+ * @param[in] min_side int: Smallest acceptable short side after scaling
+ * @returns img cv::Mat: BGR image, empty if the bytes cannot be decoded
+ */
+cv::Mat CLIPpreprocessor::decode_image(std::span<const uint8_t> bytes, int min_side) {
+    int flags = cv::IMREAD_COLOR;
+
+    int width, height;
+    if (_jpeg_size(bytes, width, height)) {
+        int short_side = std::min(width, height);
+        const std::pair<int, int> reductions[] = {
+            {8, cv::IMREAD_REDUCED_COLOR_8},
+            {4, cv::IMREAD_REDUCED_COLOR_4},
+            {2, cv::IMREAD_REDUCED_COLOR_2},
+        };
+        for (const auto& [factor, reduced_flags] : reductions) {
+            if ((short_side + factor - 1) / factor >= min_side) {
+                flags = reduced_flags;
+                break;
+            }
+        }
+    }
+
+    cv::Mat buffer(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<uint8_t*>(bytes.data()));
+    return cv::imdecode(buffer, flags);
+}
+
+/**
+ * Read the frame size from the SOFn segment of a JPEG without decoding it
+ *
+ * @returns bool: false if the bytes are not a JPEG or have no frame header
+ */
+bool CLIPpreprocessor::_jpeg_size(std::span<const uint8_t> bytes, int& width, int& height) {
+    if (bytes.size() < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= bytes.size()) {
+        if (bytes[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = bytes[pos + 1];
+        if (marker == 0xFF) {
+            ++pos;  // fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2;  // no payload
+            continue;
+        }
+
+        size_t length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+        bool frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (frame) {
+            if (pos + 9 > bytes.size()) {
+                return false;
+            }
+            height = (bytes[pos + 5] << 8) | bytes[pos + 6];
+            width = (bytes[pos + 7] << 8) | bytes[pos + 8];
+            return width > 0 && height > 0;
+        }
+        if (marker == 0xDA || length < 2) {
+            return false;  // scan data before any frame header
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+/**
+ * Resize so the short side is CLIP_INPUT_SIZE and take the centre square, like
+ * torchvision's Resize + CenterCrop in the CLIP reference. Only the pixels of
+ * the square are computed, on 8-bit data, with Pillow's antialiased bicubic.
+ *
+ * @param[in] img cv::Mat: 8-bit, 3- or 4-channel image
+ * @returns cropped_img cv::Mat: CLIP_INPUT_SIZE x CLIP_INPUT_SIZE, CV_8UC3
+ */
+cv::Mat CLIPpreprocessor::_crop_and_resize(const cv::Mat& img) {
+    if (img.rows * img.cols == 0) {
+        throw std::invalid_argument("Height and width of the image should both be non-zero.");
+    }
+
+    cv::Mat cropped_img(CLIP_INPUT_SIZE, CLIP_INPUT_SIZE, CV_8UC3);
+    resize_plan(img.cols, img.rows, img.channels())->apply(img.data, img.step, cropped_img.data, cropped_img.step);
+
+    return cropped_img;
+}
+
+/**
+ * Plans for the last few source geometries, most recently used first. A
+ * camera feed keeps hitting the front entry, so the taps and weights are
+ * computed once per stream instead of once per frame.
+ *
+ * @param[in] width int: Source width
+ * @param[in] height int: Source height
+ * @param[in] channels int: Interleaved source channels, 3 or 4
+ * @returns plan shared_ptr<ResizePlan>: Resize + centre crop to CLIP_INPUT_SIZE
+ */
+std::shared_ptr<const ResizePlan> CLIPpreprocessor::resize_plan(int width, int height, int channels) {
+    static const size_t cache_size = 8;
+    static std::mutex mutex;
+    static std::vector<std::shared_ptr<const ResizePlan>> plans;
+
+    auto matches = [&](const std::shared_ptr<const ResizePlan>& plan) {
+        return plan->src_width() == width && plan->src_height() == height && plan->channels() == channels;
+    };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(plans.begin(), plans.end(), matches);
+        if (it != plans.end()) {
+            std::rotate(plans.begin(), it, it + 1);
+            return plans.front();
+        }
+    }
 
     int target_size = CLIP_INPUT_SIZE;
     int resized_h, resized_w;
 
-    if (h < w) {
+    // Long side in double precision, as Python computes it
+    if (height < width) {
         resized_h = target_size;
-        resized_w = static_cast<int>(resized_h * static_cast<float>(w) / h);
+        resized_w = static_cast<int>(resized_h * static_cast<double>(width) / height);
     } else {
         resized_w = target_size;
-        resized_h = static_cast<int>(resized_w * static_cast<float>(h) / w);
+        resized_h = static_cast<int>(resized_w * static_cast<double>(height) / width);
     }
 
-    cv::Mat resized_img;
-    cv::resize(img, resized_img, cv::Size(resized_w, resized_h), 0, 0, cv::INTER_CUBIC);
+    // Crop offsets of the centre square, rounded half to even like Python's round()
+    auto centre_offset = [](int overflow) {
+        int half = overflow / 2;
+        return half + ((overflow & 1) && (half & 1));
+    };
+    int y_from = centre_offset(resized_h - target_size);
+    int x_from = centre_offset(resized_w - target_size);
 
-    // Crop to a square
-    int y_from = (resized_h - target_size) / 2;
-    int x_from = (resized_w - target_size) / 2;
-    cv::Rect roi(x_from, y_from, target_size, target_size);
-    cv::Mat cropped_img = resized_img(roi);
+    // Built outside the lock, so other geometries are not held up meanwhile
+    auto plan = std::make_shared<const ResizePlan>(width, height, channels, resized_w, resized_h,
+                                                   x_from, y_from, target_size, target_size);
 
-    return cropped_img;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::find_if(plans.begin(), plans.end(), matches) != plans.end()) {
+        return plan;  // another thread got there first
+    }
+    plans.insert(plans.begin(), plan);
+    if (plans.size() > cache_size) {
+        plans.pop_back();
+    }
+    return plan;
 }
 
-cv::Mat CLIPpreprocessor::_image_to_float_array(const cv::Mat& img) {
+cv::Mat CLIPpreprocessor::_to_bgr(const cv::Mat& img) {
+    // Pixel range follows from the type: 8-bit values are always in [0, 255]
+    if (img.depth() != CV_8U) {
+        throw std::invalid_argument("The image should have 8-bit unsigned pixels (CV_8U).");
+    }
     if (img.channels() != 3 && img.channels() != 1) {
         throw std::invalid_argument("The image should have 1 or 3 channels.");
     }
 
-    cv::Mat float_img;
     if (img.channels() == 1) {
-        cv::cvtColor(img, float_img, cv::COLOR_GRAY2RGB);
-    } else {
-        img.convertTo(float_img, CV_32FC3, 1.0 / 255.0);
+        cv::Mat bgr_img;
+        cv::cvtColor(img, bgr_img, cv::COLOR_GRAY2BGR);
+        return bgr_img;
     }
-
-    if (cv::sum(float_img < 0.0)[0] > 0) {
-        throw std::invalid_argument("Images should have non-negative pixel values.");
-    }
-
-    if (cv::sum(float_img > 1.0)[0] > 0) {
-        throw std::invalid_argument("Images should have values in [0, 1].");
-    }
-
-    return float_img;
+    return img;
 }
@@ -2,9 +2,20 @@
 #define PREPROCESSOR_H
 
 #include <opencv2/opencv.hpp>
-#include <torch/torch.h>
 #include <stdexcept>
 #include <vector>
+#include <span>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "image_kernels.hpp"
+#include "pixel_cache.hpp"
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+// Channel order of interleaved 8-bit pixels handed to CLIPpreprocessor
+enum class PixelOrder { BGR, RGB, BGRA, RGBA };
 
 class CLIPpreprocessor {
 public:
@@ -12,11 +23,93 @@ public:
     static const std::vector<float> NORM_MEAN;
     static const std::vector<float> NORM_STD;
 
-    static torch::Tensor encode_image(const cv::Mat& img);
+    // How encode_tiles lays tiles of CLIP_INPUT_SIZE over an image
+    struct Tiling {
+        int     columns {0};        // grid: the image is resized to columns x rows
+        int     rows {0};           // tiles, each covering an equal share of it
+        int     short_side {0};     // stride: the image is resized keeping its aspect
+        int     stride {0};         // ratio, and tiles start every `stride` pixels
+
+        static Tiling grid(int columns, int rows) { return {columns, rows, 0, 0}; }
+        static Tiling strided(int short_side, int stride) { return {0, 0, short_side, stride}; }
+    };
+
+    // 8-bit grayscale or BGR image (OpenCV channel order) -> [1, 3, 224, 224]
+    // RGB tensor, normalised with NORM_MEAN / NORM_STD
+    static Tensor encode_image(const cv::Mat& img);
+
+    // Same, written to `out` (3 * CLIP_INPUT_SIZE * CLIP_INPUT_SIZE floats, CHW)
+    static void encode_image(const cv::Mat& img, float* out);
+
+    // 3- or 4-channel 8-bit image in an explicit channel order -> [1, 3, 224, 224].
+    // Swizzling and dropping alpha happen inside the resize and normalize passes,
+    // so RGB(A) frames from decoders and capture APIs need no cvtColor first
+    static Tensor encode_pixels(const cv::Mat& img, PixelOrder order);
+    static void encode_pixels(const cv::Mat& img, PixelOrder order, float* out);
+
+    // 4:2:0 YUV frames (BT.601 video range, as cv::cvtColor converts them) ->
+    // [1, 3, 224, 224]. NV12 has a full-size Y plane and a half-size plane of
+    // interleaved U/V pairs; I420 has separate U and V planes. Chroma planes
+    // are (width + 1) / 2 x (height + 1) / 2. Only the source pixels under the
+    // resize taps of the centre crop are converted, a row at a time, so no
+    // full-size RGB frame is ever built
+    static Tensor encode_nv12(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                              int width, int height);
+    static void encode_nv12(const uint8_t* y, size_t y_stride, const uint8_t* uv, size_t uv_stride,
+                            int width, int height, float* out);
+    static Tensor encode_i420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                              const uint8_t* v, size_t v_stride, int width, int height);
+    static void encode_i420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                            const uint8_t* v, size_t v_stride, int width, int height, float* out);
+
+    // Tiles of an 8-bit grayscale or BGR image -> [N, 3, 224, 224]. The image
+    // is resized once to the scale the tiling needs and every tile normalised
+    // from that single resize. In stride mode the last tile of each row and
+    // column is moved in to end at the border. `tiles` receives the area of
+    // each tile in source pixel coordinates, in batch order (row-major).
+    // std::invalid_argument for a tiling that yields no tiles
+    static Tensor encode_tiles(const cv::Mat& img, const Tiling& tiling, std::vector<cv::Rect2d>& tiles);
+
+    // encode_image for every image into one contiguous [N, 3, 224, 224] buffer,
+    // ready to hand to the model. Images are spread over `pool`, each worker
+    // writing its own slot of `out`. A failing image does not stop the batch:
+    // its slot is zero-filled and its message returned at its index; successful
+    // images get an empty string
+    static std::vector<std::string> encode_batch(std::span<const cv::Mat> images, float* out,
+                                                 ThreadPool& pool = ThreadPool::global());
+
+    // Same from compressed image bytes. JPEGs are decoded at the smallest
+    // DCT scale (1/2, 1/4, 1/8) that keeps the short side >= CLIP_INPUT_SIZE;
+    // much cheaper, but close to rather than equal with a full-size decode.
+    // With a `cache`, the 8-bit crop is looked up by content hash first and
+    // stored after a miss, so repeated images skip decode and resize
+    static Tensor encode_image_bytes(std::span<const uint8_t> bytes, PixelCache* cache = nullptr);
+    static void encode_image_bytes(std::span<const uint8_t> bytes, float* out, PixelCache* cache = nullptr);
+
+    // encode_image_bytes for every image into one [N, 3, 224, 224] buffer,
+    // with the same per-image error handling as encode_batch
+    static std::vector<std::string> encode_batch_bytes(std::span<const std::span<const uint8_t>> images,
+                                                       float* out, PixelCache* cache = nullptr,
+                                                       ThreadPool& pool = ThreadPool::global());
+
+    // Decode to BGR, scaling JPEGs down in the decoder as long as the short
+    // side stays >= min_side; other formats are decoded at full size
+    static cv::Mat decode_image(std::span<const uint8_t> bytes, int min_side = CLIP_INPUT_SIZE);
+
+    // Cached resize + centre crop plan the encoders use for a source of this
+    // size and channel count (3 or 4)
+    static std::shared_ptr<const ResizePlan> resize_plan(int width, int height, int channels);
 
 private:
+    static bool _jpeg_size(std::span<const uint8_t> bytes, int& width, int& height);
     static cv::Mat _crop_and_resize(const cv::Mat& img);
-    static cv::Mat _image_to_float_array(const cv::Mat& img);
+    static void _encode_yuv420(const uint8_t* y, size_t y_stride, const uint8_t* u, size_t u_stride,
+                               const uint8_t* v, size_t v_stride, int uv_step, int width, int height,
+                               float* out);
+    static void _normalize(const cv::Mat& crop, bool bgr, float* out);
+    static std::vector<std::string> _encode_all(size_t count, float* out, ThreadPool& pool,
+                                                const std::function<void(size_t, float*)>& encode);
+    static cv::Mat _to_bgr(const cv::Mat& img);
 };
 
 #endif // PREPROCESSOR_H
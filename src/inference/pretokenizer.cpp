@@ -0,0 +1,291 @@
+#include "pretokenizer.hpp"
+#include "unicode_tables.hpp"
+#include <algorithm>
+#include <iterator>
+
+// Literal alternatives of the split pattern, tried in pattern order
+static const std::string_view SPECIAL_TOKENS[] = {"<|startoftext|>", "<|endoftext|>"};
+static const std::string_view CONTRACTIONS[] = {"'s", "'t", "'re", "'ve", "'m", "'ll", "'d"};
+
+// Marker for a byte that does not start a valid UTF-8 sequence
+static const char32_t INVALID_CODE_POINT = 0xFFFFFFFF;
+
+template <size_t N>
+static bool in_ranges(const CodePointRange (&ranges)[N], char32_t cp) {
+    auto it = std::upper_bound(std::begin(ranges), std::end(ranges), cp,
+                               [](char32_t c, const CodePointRange& r) { return c < r.first; });
+    return it != std::begin(ranges) && cp <= std::prev(it)->last;
+}
+
+bool PreTokenizer::is_letter(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp | 0x20) >= 'a' && (cp | 0x20) <= 'z';
+    }
+    return in_ranges(LETTER_RANGES, cp);
+}
+
+bool PreTokenizer::is_number(char32_t cp) {
+    if (cp < 0x80) {
+        return cp >= '0' && cp <= '9';
+    }
+    return in_ranges(NUMBER_RANGES, cp);
+}
+
+bool PreTokenizer::is_space(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp >= 0x09 && cp <= 0x0D) || (cp >= 0x1C && cp <= 0x20);
+    }
+    return in_ranges(SPACE_RANGES, cp);
+}
+
+bool PreTokenizer::is_cased(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp | 0x20) >= 'a' && (cp | 0x20) <= 'z';
+    }
+    return in_ranges(CASED_RANGES, cp);
+}
+
+bool PreTokenizer::is_case_ignorable(char32_t cp) {
+    if (cp < 0x80) {
+        return cp == '\'' || cp == '.' || cp == ':' || cp == '^' || cp == '`';
+    }
+    return in_ranges(CASE_IGNORABLE_RANGES, cp);
+}
+
+char32_t PreTokenizer::to_lower(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp >= 'A' && cp <= 'Z') ? cp + 0x20 : cp;
+    }
+
+    auto it = std::upper_bound(std::begin(LOWER_RUNS), std::end(LOWER_RUNS), cp,
+                               [](char32_t c, const LowerRun& r) { return c < r.first; });
+    if (it == std::begin(LOWER_RUNS)) {
+        return cp;
+    }
+    const LowerRun& run = *std::prev(it);
+    if (cp > run.last || (cp - run.first) % run.stride != 0) {
+        return cp;
+    }
+    return static_cast<char32_t>(static_cast<int32_t>(cp) + run.delta);
+}
+
+/**
+ * Decode the code point starting at text[i]
+ *
+ * @param[in] text str: UTF-8 input
+ * @param[in] i size_t: byte offset of the lead byte
+ * @param[out] cp char32_t: decoded code point, INVALID_CODE_POINT on bad input
+ * @returns size_t: number of bytes consumed (1 for invalid sequences)
+ */
+static size_t decode_utf8(std::string_view text, size_t i, char32_t& cp) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    size_t len;
+    if (c < 0x80) {
+        cp = c;
+        return 1;
+    } else if ((c & 0xE0) == 0xC0) {
+        cp = c & 0x1F;
+        len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+        cp = c & 0x0F;
+        len = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+        cp = c & 0x07;
+        len = 4;
+    } else {
+        cp = INVALID_CODE_POINT;
+        return 1;
+    }
+
+    if (i + len > text.size()) {
+        cp = INVALID_CODE_POINT;
+        return 1;
+    }
+    for (size_t k = 1; k < len; ++k) {
+        unsigned char cc = static_cast<unsigned char>(text[i + k]);
+        if ((cc & 0xC0) != 0x80) {
+            cp = INVALID_CODE_POINT;
+            return 1;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    return len;
+}
+
+static void append_utf8(std::string& out, char32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Case-insensitive match of an ASCII literal at text[i]
+static bool match_literal(std::string_view text, size_t i, std::string_view literal) {
+    if (text.size() - i < literal.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < literal.size(); ++k) {
+        char c = text[i + k];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != literal[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Walk the UTF-8 input once, trimming and collapsing whitespace, lowercasing
+ * and cutting pieces exactly where the CLIP split pattern would.
+ *
+ * @param[in] text str: Raw input text
+ * @param[out] buffer str: Receives the cleaned, lowercased text
+ * @param[out] pieces vector<string_view>: Receives views into `buffer`
+ */
+void PreTokenizer::split(std::string_view text,
+                         std::string& buffer,
+                         std::vector<std::string_view>& pieces) {
+    buffer.clear();
+    pieces.clear();
+
+    // Lowercasing grows a code point by at most half of its UTF-8 length, so
+    // reserving up front keeps the views handed out below stable
+    buffer.reserve(text.size() + text.size() / 2 + 1);
+
+    enum class Run { NONE, LETTERS, OTHERS };
+    Run run = Run::NONE;
+    size_t run_start = 0;
+    bool pending_space = false;
+
+    // Whether the last code point that is not case-ignorable was cased
+    bool prev_cased = false;
+
+    auto close_run = [&]() {
+        if (run != Run::NONE) {
+            pieces.emplace_back(buffer.data() + run_start, buffer.size() - run_start);
+            run = Run::NONE;
+        }
+    };
+
+    // Collapsed whitespace is only written once something follows it, which
+    // also trims both ends
+    auto flush_space = [&]() {
+        if (pending_space) {
+            buffer.push_back(' ');
+            pending_space = false;
+        }
+    };
+
+    auto push_code_point = [&](char32_t cp, char raw) {
+        bool letter = cp != INVALID_CODE_POINT && is_letter(cp);
+        bool number = !letter && cp != INVALID_CODE_POINT && is_number(cp);
+
+        if (letter) {
+            if (run != Run::LETTERS) {
+                close_run();
+                flush_space();
+                run = Run::LETTERS;
+                run_start = buffer.size();
+            }
+        } else if (number) {
+            close_run();
+            flush_space();
+            run_start = buffer.size();
+        } else if (run != Run::OTHERS) {
+            close_run();
+            flush_space();
+            run = Run::OTHERS;
+            run_start = buffer.size();
+        }
+
+        if (cp == INVALID_CODE_POINT) {
+            buffer.push_back(raw);
+        } else {
+            append_utf8(buffer, cp);
+        }
+
+        // [\p{N}] matches a single code point
+        if (number) {
+            pieces.emplace_back(buffer.data() + run_start, buffer.size() - run_start);
+        }
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        // A new match attempt starts here unless a [^\s\p{L}\p{N}]+ run is
+        // still consuming, so try the literal alternatives first
+        char c = text[i];
+        if ((c == '<' || c == '\'') && run != Run::OTHERS) {
+            std::string_view literal;
+            const std::string_view* first = c == '<' ? std::begin(SPECIAL_TOKENS) : std::begin(CONTRACTIONS);
+            const std::string_view* last = c == '<' ? std::end(SPECIAL_TOKENS) : std::end(CONTRACTIONS);
+            for (const std::string_view* it = first; it != last; ++it) {
+                if (match_literal(text, i, *it)) {
+                    literal = *it;
+                    break;
+                }
+            }
+
+            if (!literal.empty()) {
+                close_run();
+                flush_space();
+                size_t start = buffer.size();
+                buffer.append(literal);
+                pieces.emplace_back(buffer.data() + start, literal.size());
+                prev_cased = c == '\'';
+                i += literal.size();
+                continue;
+            }
+        }
+
+        char32_t cp;
+        size_t len = decode_utf8(text, i, cp);
+        i += len;
+
+        if (cp != INVALID_CODE_POINT && is_space(cp)) {
+            close_run();
+            pending_space = !buffer.empty();
+            prev_cased = false;
+            continue;
+        }
+
+        if (cp == 0x0130) {
+            // The one code point whose lowercase form is two code points
+            push_code_point(U'i', c);
+            push_code_point(0x0307, c);
+        } else if (cp == 0x03A3) {
+            // str.lower() picks the final form of sigma when it follows a cased
+            // letter and no cased letter follows, skipping case-ignorables
+            bool final_sigma = prev_cased;
+            for (size_t j = i; final_sigma && j < text.size();) {
+                char32_t next;
+                j += decode_utf8(text, j, next);
+                if (next == INVALID_CODE_POINT || !is_case_ignorable(next)) {
+                    final_sigma = next == INVALID_CODE_POINT || !is_cased(next);
+                    break;
+                }
+            }
+            push_code_point(final_sigma ? 0x03C2 : 0x03C3, c);
+        } else {
+            push_code_point(cp == INVALID_CODE_POINT ? cp : to_lower(cp), c);
+        }
+
+        if (cp == INVALID_CODE_POINT || !is_case_ignorable(cp)) {
+            prev_cased = cp != INVALID_CODE_POINT && is_cased(cp);
+        }
+    }
+    close_run();
+}
@@ -0,0 +1,37 @@
+#ifndef CLIP_PRETOKENIZER_H
+#define CLIP_PRETOKENIZER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Single-pass UTF-8 scanner standing in for the CLIP split pattern
+ *
+ *     <\|startoftext\|>|<\|endoftext\|>|'s|'t|'re|'ve|'m|'ll|'d|[\p{L}]+|[\p{N}]|[^\s\p{L}\p{N}]+
+ *
+ * applied to whitespace_clean(basic_clean(text)).lower(). Trimming, whitespace
+ * collapsing and lowercasing happen while the text is scanned, and pieces are
+ * returned as views into the normalised buffer.
+ */
+class PreTokenizer {
+public:
+    /**
+     * Normalise `text` into `buffer` and append one view per piece to `pieces`.
+     * Both containers are cleared first; reusing them across calls avoids any
+     * allocation once they have grown. Views are valid until `buffer` changes.
+     */
+    static void     split(std::string_view text,
+                          std::string& buffer,
+                          std::vector<std::string_view>& pieces);
+
+    // Code point classes of the split pattern
+    static bool     is_letter(char32_t cp);
+    static bool     is_number(char32_t cp);
+    static bool     is_space(char32_t cp);
+    static bool     is_cased(char32_t cp);
+    static bool     is_case_ignorable(char32_t cp);
+    static char32_t to_lower(char32_t cp);
+};
+
+#endif // CLIP_PRETOKENIZER_H
@@ -0,0 +1,122 @@
+#ifndef CLIP_TENSOR_H
+#define CLIP_TENSOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef CLIP_WITH_TORCH
+#include <torch/torch.h>
+#endif
+
+/**
+ * Non-owning view of a dense, row-major float tensor.
+ *
+ * Shapes are int64_t so they can be handed to ONNX Runtime as they are.
+ * Indexing the leading dimension gives the view of one sub-tensor, e.g. one
+ * image of an NCHW batch.
+ */
+class TensorView {
+public:
+    TensorView() = default;
+    TensorView(float* data, std::vector<int64_t> shape)
+        : ptr(data), dims(std::move(shape)) {}
+
+    float*                          data() const { return ptr; }
+    const std::vector<int64_t>&     shape() const { return dims; }
+    int64_t                         size(size_t dim) const { return dims.at(dim); }
+    size_t                          numel() const { return numel(dims); }
+    bool                            empty() const { return numel() == 0; }
+
+    float*                          begin() const { return ptr; }
+    float*                          end() const { return ptr + numel(); }
+
+    // Sub-tensor `i` along the leading dimension
+    TensorView operator[](int64_t i) const {
+        if (dims.empty() || i < 0 || i >= dims[0]) {
+            throw std::out_of_range("Tensor index out of range.");
+        }
+        std::vector<int64_t> inner(dims.begin() + 1, dims.end());
+        size_t stride = numel(inner);
+        return TensorView(ptr + i * stride, std::move(inner));
+    }
+
+    // Element at a full index, e.g. at({0, c, y, x})
+    float& at(std::initializer_list<int64_t> index) const {
+        if (index.size() != dims.size()) {
+            throw std::out_of_range("Tensor index has the wrong rank.");
+        }
+        size_t offset = 0;
+        size_t d = 0;
+        for (int64_t i : index) {
+            if (i < 0 || i >= dims[d]) {
+                throw std::out_of_range("Tensor index out of range.");
+            }
+            offset = offset * dims[d++] + i;
+        }
+        return ptr[offset];
+    }
+
+    static size_t numel(const std::vector<int64_t>& shape) {
+        size_t count = 1;
+        for (int64_t dim : shape) {
+            count *= static_cast<size_t>(dim);
+        }
+        return count;
+    }
+
+private:
+    float*                  ptr {nullptr};
+    std::vector<int64_t>    dims;
+};
+
+/**
+ * Dense, row-major float tensor owning its storage.
+ *
+ * Storage is allocated uninitialised, since producers overwrite every value.
+ * Moves transfer the buffer without copying; data() stays valid for the
+ * lifetime of the tensor, so it can back an Ort::Value directly.
+ */
+class Tensor {
+public:
+    Tensor() = default;
+    explicit Tensor(std::vector<int64_t> shape)
+        : storage(new float[TensorView::numel(shape)]), dims(std::move(shape)) {}
+
+    float*                          data() { return storage.get(); }
+    const float*                    data() const { return storage.get(); }
+    const std::vector<int64_t>&     shape() const { return dims; }
+    int64_t                         size(size_t dim) const { return dims.at(dim); }
+    size_t                          numel() const { return TensorView::numel(dims); }
+    bool                            empty() const { return !storage || numel() == 0; }
+
+    float*                          begin() { return data(); }
+    float*                          end() { return data() + numel(); }
+    const float*                    begin() const { return data(); }
+    const float*                    end() const { return data() + numel(); }
+
+    TensorView                      view() const { return TensorView(storage.get(), dims); }
+    TensorView                      operator[](int64_t i) const { return view()[i]; }
+    float&                          at(std::initializer_list<int64_t> index) const { return view().at(index); }
+
+#ifdef CLIP_WITH_TORCH
+    // Hand the storage over to a torch::Tensor without copying
+    torch::Tensor to_torch() && {
+        std::vector<int64_t> sizes = dims;
+        float* raw = storage.release();
+        dims.clear();
+        return torch::from_blob(raw, sizes, [](void* p) { delete[] static_cast<float*>(p); },
+                                torch::kFloat32);
+    }
+#endif
+
+private:
+    std::unique_ptr<float[]>    storage;
+    std::vector<int64_t>        dims;
+};
+
+#endif // CLIP_TENSOR_H
@@ -0,0 +1,222 @@
+#include "text_embedding_cache.hpp"
+#include "pretokenizer.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+static const char       SNAPSHOT_MAGIC[8] = {'C', 'L', 'I', 'P', 'T', 'X', 'E', '\0'};
+static const uint32_t   BYTE_ORDER_MARK = 0x01020304;
+
+// Sanity limits for snapshot records, well above any real prompt or model
+static const uint32_t   MAX_KEY_SIZE = 1 << 20;
+static const uint32_t   MAX_DIM = 1 << 16;
+
+/**
+ * Split the byte budget over the shards. Small budgets use fewer shards so
+ * that each still holds a useful number of entries.
+ *
+ * @param[in] config Config: byte budget and requested shard count
+ */
+TextEmbeddingCache::TextEmbeddingCache(const Config& config) {
+    shard_count = 1;
+    while (shard_count * 2 <= config.shards) {
+        shard_count *= 2;
+    }
+    // Keep shards big enough for a few thousand-float embeddings each
+    while (shard_count > 1 && config.max_bytes / shard_count < (64 << 10)) {
+        shard_count /= 2;
+    }
+
+    shard_max_bytes = config.max_bytes / shard_count;
+    shards.reset(new Shard[shard_count]);
+}
+
+/**
+ * Model id, a NUL separator and the text as the tokenizer normalizes it
+ *
+ * @param[in] model str: Model id, e.g. "ViT-B/32"
+ * @param[in] text str: Raw prompt
+ * @param[out] key str: Cache key, overwritten
+ */
+void TextEmbeddingCache::key(std::string_view model, std::string_view text, std::string& key) {
+    thread_local std::string normalized;
+    thread_local std::vector<std::string_view> pieces;
+    PreTokenizer::split(text, normalized, pieces);
+
+    key.assign(model);
+    key += '\0';
+    key += normalized;
+}
+
+size_t TextEmbeddingCache::entry_bytes(size_t key_size, size_t dim) {
+    // Rough cost of the list node, index slot and the two heap buffers
+    return sizeof(Node) + 64 + key_size + dim * sizeof(float);
+}
+
+TextEmbeddingCache::Shard& TextEmbeddingCache::shard_for(std::string_view key) const {
+    size_t h = std::hash<std::string_view>{}(key);
+    // Mix the high bits in, std::hash may leave the low bits weak
+    return shards[(h ^ (h >> 29)) & (shard_count - 1)];
+}
+
+bool TextEmbeddingCache::lookup(std::string_view key, float* out, size_t dim) {
+    if (shard_max_bytes == 0) {
+        return false;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end() || it->second->embedding.size() != dim) {
+        ++shard.misses;
+        return false;
+    }
+
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    std::memcpy(out, it->second->embedding.data(), dim * sizeof(float));
+    return true;
+}
+
+void TextEmbeddingCache::insert(std::string_view key, const float* embedding, size_t dim) {
+    size_t bytes = entry_bytes(key.size(), dim);
+    if (bytes > shard_max_bytes) {
+        return;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have embedded the same prompt meanwhile
+    if (shard.index.count(key)) {
+        return;
+    }
+
+    while (!shard.lru.empty() && shard.bytes + bytes > shard_max_bytes) {
+        const Node& victim = shard.lru.back();
+        shard.bytes -= entry_bytes(victim.key.size(), victim.embedding.size());
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+        ++shard.evictions;
+    }
+
+    shard.lru.push_front(Node{std::string(key), std::vector<float>(embedding, embedding + dim)});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += bytes;
+}
+
+/**
+ * Snapshot the cache: header, then (key size, dim, key, floats) per entry.
+ * Written to a temporary file first so readers never see a partial snapshot.
+ *
+ * @param[in] path str: Output path
+ */
+void TextEmbeddingCache::save(const std::string& path) const {
+    const std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Error opening text embedding snapshot for writing: " + temp_path);
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = FORMAT_VERSION;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // Oldest first: loading re-inserts at the front, restoring the order
+        for (auto it = shard.lru.rbegin(); it != shard.lru.rend(); ++it) {
+            const uint32_t sizes[2] = {static_cast<uint32_t>(it->key.size()),
+                                       static_cast<uint32_t>(it->embedding.size())};
+            file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+            file.write(it->key.data(), static_cast<std::streamsize>(it->key.size()));
+            file.write(reinterpret_cast<const char*>(it->embedding.data()),
+                       static_cast<std::streamsize>(it->embedding.size() * sizeof(float)));
+            ++header.entry_count;
+        }
+    }
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Error writing text embedding snapshot: " + temp_path);
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+/**
+ * Read a snapshot written by save() into the cache
+ *
+ * @param[in] path str: Snapshot path
+ * @returns size_t: Number of entries read; some may be evicted by the budget
+ */
+size_t TextEmbeddingCache::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error opening text embedding snapshot: " + path);
+    }
+
+    Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::runtime_error("Not a text embedding snapshot: " + path);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Text embedding snapshot has the wrong byte order: " + path);
+    }
+    if (header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported text embedding snapshot version " +
+                                 std::to_string(header.version) + ": " + path);
+    }
+
+    std::string key;
+    std::vector<float> embedding;
+    for (uint64_t i = 0; i < header.entry_count; ++i) {
+        uint32_t sizes[2];
+        if (!file.read(reinterpret_cast<char*>(sizes), sizeof(sizes)) ||
+            sizes[0] > MAX_KEY_SIZE || sizes[1] == 0 || sizes[1] > MAX_DIM) {
+            throw std::runtime_error("Corrupt text embedding snapshot: " + path);
+        }
+
+        key.resize(sizes[0]);
+        embedding.resize(sizes[1]);
+        if (!file.read(key.data(), sizes[0]) ||
+            !file.read(reinterpret_cast<char*>(embedding.data()), sizes[1] * sizeof(float))) {
+            throw std::runtime_error("Truncated text embedding snapshot: " + path);
+        }
+        insert(key, embedding.data(), embedding.size());
+    }
+    return header.entry_count;
+}
+
+TextEmbeddingCache::Stats TextEmbeddingCache::stats() const {
+    Stats total;
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.evictions += shard.evictions;
+        total.entries += shard.lru.size();
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
+
+void TextEmbeddingCache::clear() {
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef CLIP_TEXT_EMBEDDING_CACHE_H
+#define CLIP_TEXT_EMBEDDING_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Bounded, thread-safe cache of text embeddings keyed by (model id,
+ * normalized text).
+ *
+ * Texts are normalized the way the tokenizer sees them (trimmed, whitespace
+ * collapsed, lowercased), so prompts differing only in those respects share
+ * an entry. Like BPECache, keys are spread over independently locked shards
+ * that evict their least recently used entries past their share of the byte
+ * budget.
+ *
+ * save() writes a compact snapshot: a header, then per entry the key and the
+ * raw floats, least recently used first, so load() restores the LRU order.
+ * Snapshots use the native byte order and are rejected on a mismatch.
+ */
+class TextEmbeddingCache {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct Config {
+        size_t      max_bytes {64 << 20};   // keys, embeddings and per-entry overhead; 0 disables
+        size_t      shards {16};            // rounded down to a power of two
+    };
+
+    struct Stats {
+        uint64_t    hits {0};
+        uint64_t    misses {0};
+        uint64_t    evictions {0};
+        size_t      entries {0};
+        size_t      bytes {0};
+
+        double      hit_rate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    TextEmbeddingCache() : TextEmbeddingCache(Config()) {}
+    explicit TextEmbeddingCache(const Config& config);
+
+    // Cache key of `text` for `model`, written to `key` to reuse its buffer
+    static void     key(std::string_view model, std::string_view text, std::string& key);
+
+    // Copy the `dim` floats cached for `key` to `out`; returns false on a miss
+    // or if the cached embedding has another size
+    bool            lookup(std::string_view key, float* out, size_t dim);
+
+    // Remember an embedding of `dim` floats, evicting old entries as needed
+    void            insert(std::string_view key, const float* embedding, size_t dim);
+
+    /**
+     * Write every entry to `path`, replacing it atomically, and read a
+     * snapshot back in. load() inserts into the current contents under the
+     * usual budget and returns the number of entries read; std::runtime_error
+     * for unreadable or foreign files.
+     */
+    void            save(const std::string& path) const;
+    size_t          load(const std::string& path);
+
+    Stats           stats() const;
+    void            clear();
+
+private:
+    struct Header {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+        uint64_t    entry_count;
+    };
+
+    struct Node {
+        std::string         key;
+        std::vector<float>  embedding;
+    };
+
+    struct Shard {
+        std::mutex                                      mutex;
+        std::list<Node>                                 lru;    // front is most recent
+        std::unordered_map<std::string_view,
+                           std::list<Node>::iterator>   index;  // views into lru keys
+        size_t                                          bytes {0};
+        uint64_t                                        hits {0};
+        uint64_t                                        misses {0};
+        uint64_t                                        evictions {0};
+    };
+
+    static size_t   entry_bytes(size_t key_size, size_t dim);
+    Shard&          shard_for(std::string_view key) const;
+
+    std::unique_ptr<Shard[]>    shards;
+    size_t                      shard_count;
+    size_t                      shard_max_bytes;
+};
+
+#endif // CLIP_TEXT_EMBEDDING_CACHE_H
@@ -0,0 +1,63 @@
+#ifndef CLIP_THREAD_POOL_H
+#define CLIP_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running parallel_for() jobs.
+ *
+ * The calling thread works on its own job too, so a pool of size N uses N - 1
+ * background threads and a pool of size 1 runs everything inline. Jobs from
+ * several callers queue up and are served in order.
+ */
+class ThreadPool {
+public:
+    // `threads` counts the caller; 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t          size() const { return workers.size() + 1; }
+
+    /**
+     * Call fn(i) for every i in [0, count) across the pool and return once all
+     * calls finished. The first exception thrown by fn is rethrown here after
+     * the remaining indices have still run.
+     */
+    void            parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+    // Process-wide pool sized to the machine, created on first use
+    static ThreadPool&  global();
+
+private:
+    struct Job {
+        const std::function<void(size_t)>*  fn;
+        size_t                              count;
+        std::atomic<size_t>                 next {0};
+        std::atomic<size_t>                 done {0};
+        std::exception_ptr                  error;
+        std::mutex                          mutex;
+        std::condition_variable             finished;
+    };
+
+    void            worker_loop();
+    static void     work(Job& job);
+
+    std::vector<std::thread>            workers;
+    std::mutex                          mutex;
+    std::condition_variable             wake;
+    std::deque<std::shared_ptr<Job>>    jobs;
+    bool                                stopping {false};
+};
+
+#endif // CLIP_THREAD_POOL_H
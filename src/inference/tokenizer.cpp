@@ -2,12 +2,15 @@
 #include <codecvt>
 #include <locale>
 #include <cmath>
+#include <queue>
+#include <functional>
+#include <unordered_set>
 
 /*
 TODO:   
-%   Properly implement byte_decoder, wstring is such a headache
 %   C++ ftfy workaround
 DONE:
+%   byte_decoder: token bytes are decoded once when the vocab is built
 %   bpe() infinite loop
 %       -Update 24/01/13: 
 %       -bpe() still running loop, changed constructor to init bpe_ranks
@@ -19,66 +22,37 @@ DONE:
 /**
  * Header function: initialise required variables and set up bpe
  *
- * @param[in] bpe_path str: path to .txt file containing bpe encodings
+ * @param[in] bpe_path str: path to the bpe merges (.txt or .txt.gz) or to a
+ *                compiled vocab file produced by compile_vocab; a word table
+ *                at WordTable::path_for(bpe_path) is mapped as well
+ * @param[in] cache_config BPECache::Config: budget of the BPE result cache
  * */
-CLIPTokenizer::CLIPTokenizer(const std::string bpe_path) {
-    // Default pattern matching tokens
-    pat = std::regex(R"(<\|startoftext\|>|<\|endoftext\|>|'s|'t|'re|'ve|'m|'ll|'d|[\p{L}]+|[\p{N}]|[^\s\p{L}\p{N}]+)", 
-                     std::regex::icase);
-
-    // Byte encoding
-    std::unordered_map<int, std::string> byte_encoder = bytes_to_unicode();
-    /*
-    byte_decoder = {};
-
-    // Converter for UTF-8 to UTF-32
-    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> utf8_to_utf32;
-
-    for (const auto& [k, v] : byte_encoder) {
-        // Convert string to wide string
-        std::wstring wide_string = bytes_to_wide(v);
-
-        // Ensure the string is not empty and extract the first code point
-        if (!wide_string.empty()) {
-            int unicode_code_point = static_cast<int>(wide_string[0]);
-            byte_decoder[unicode_code_point] = k;
+CLIPTokenizer::CLIPTokenizer(const std::string bpe_path, const BPECache::Config& cache_config)
+    : CLIPTokenizer(BPEVocab::load(bpe_path), cache_config) {
+    // Like a stale compiled vocab, a table from an older compile_vocab or
+    // built for another vocab is ignored and words go through the merge loop
+    std::string words_path = WordTable::path_for(bpe_path);
+    if (WordTable::is_word_table(words_path)) {
+        try {
+            words = WordTable::from_file(words_path, bpe_vocab->fingerprint(), bpe_vocab->size());
+        } catch (const std::runtime_error&) {
         }
-    } */
-    // Load BPE merges (you'll need to implement this part)
-    // For now, this is a placeholder
-    std::vector<std::pair<std::string, std::string>> merges;
-    merges = open_bpe(bpe_path);
-
-    // Initialize bpe_ranks with the merges
-    for (size_t i = 0; i < merges.size(); ++i) {
-        const auto& pair = merges[i];
-        bpe_ranks[pair.first][pair.second] = i;
     }
+}
 
-    // Initialize vocabulary
-    std::vector<std::string> vocab;
-    for (const auto& v : byte_encoder) {
-        vocab.push_back(v.second);
-        vocab.push_back(v.second + "</w>");
-    }
-
-    for (const auto& merge : merges) {
-        vocab.push_back(merge.first + merge.second);
-    }
-
-    // Add special tokens
-    vocab.push_back("<|startoftext|>");
-    vocab.push_back("<|endoftext|>");
-
-    // Create encoder and decoder
-    for (size_t i = 0; i < vocab.size(); ++i) {
-        encoder[vocab[i]] = i;
-        decoder[i] = vocab[i];
+/**
+ * Construct on top of an already loaded vocabulary. With a compiled vocab from
+ * BPEVocab::from_compiled this does no parsing at all, and the same vocab can
+ * back any number of tokenizers.
+ *
+ * @param[in] vocab BPEVocab: shared, immutable vocabulary and merge ranks
+ * @param[in] cache_config BPECache::Config: budget of the BPE result cache
+ * */
+CLIPTokenizer::CLIPTokenizer(std::shared_ptr<const BPEVocab> vocab, const BPECache::Config& cache_config)
+    : bpe_vocab(std::move(vocab)), cache(cache_config) {
+    if (!bpe_vocab) {
+        throw std::invalid_argument("CLIPTokenizer requires a vocabulary");
     }
-
-    // Initialize cache with special tokens
-    cache["<|startoftext|>"] = "<|startoftext|>";
-    cache["<|endoftext|>"] = "<|endoftext|>";
 }
 
 /* Deprecated function that was supposed to convert to unicode
@@ -97,324 +71,420 @@ std::wstring CLIPTokenizer::bytes_to_wide(const std::string& input) {
 */ 
 
 /**
- * Default function to open a byte-pair encoding .txt file.                
- *                                                        
- * @param[in] path str: Path to BPE.txt file                                                                                                              
- * @param[out] merges vector<byte, char>: vector of string pairs containing the BPE
- *                 encondings               
+ * Modification of bpe() function in OpenAI's CLIP module:                  
+ * https://github.com/openai/CLIP/blob/main/clip/simple_tokenizer.py#L62    
+ * Performs the byte-pair encoding to help encode some text.                
+ *                                                             
+ * @param[in] token str: Pre-tokenized piece to encode
+ * @param[out] ids vector<int>: Token ids of the piece are appended here
  */
-std::vector<std::pair<std::string, std::string>> CLIPTokenizer::open_bpe(std::string path)
-{
-    // init merges data structure and line
-    std::vector <std::pair<std::string,std::string>> merges;
-    std::string line;
-
-    // Open file and check opening was successful
-    std::ifstream bpe_file(path);
-    if (!bpe_file.is_open()) {
-        std::cerr << "Error opening vocab file" << std::endl;
-        merges.push_back({"", ""});
-        return merges;
+void CLIPTokenizer::bpe(std::string_view token, std::vector<int>& ids) const {
+    // Special tokens are whole vocabulary entries
+    if (token == "<|startoftext|>") {
+        ids.push_back(bpe_vocab->sot_id());
+        return;
+    }
+    if (token == "<|endoftext|>") {
+        ids.push_back(bpe_vocab->eot_id());
+        return;
     }
 
-    // Waste first line
-    std::getline(bpe_file, line);
-
-    // Read file line-by-line
-    while (std::getline(bpe_file, line)) {
-        std::istringstream iss(line);
-        std::string first, second;
-
-        // Split line into byte pair encoding
-        if (iss >> first >> second) {
-            merges.push_back({first, second});
-        }
+    // Frozen common words first, then the cache, memoization
+    if (words && words->lookup(token, ids)) {
+        return;
+    }
+    if (cache.lookup(token, ids)) {
+        return;
     }
 
-    // Close file, return merges
-    bpe_file.close();
+    size_t start = ids.size();
+    bpe_merge(token, ids);
 
-    return merges;
+    // Cache and return
+    cache.insert(token, ids.data() + start, ids.size() - start);
 }
 
 /**
- * Function to convert byte string to unicode
+ * Merge engine behind bpe(). The word is held as a linked list of symbol ids
+ * (one per byte, the last carrying "</w>") and every adjacent pair with a known
+ * rank sits in a min-heap ordered by (rank, position). Popping the heap applies
+ * merges in the same order as the reference loop, which repeatedly merges the
+ * lowest ranked bigram left to right, in O(n log n) with no string building.
  *
- * @param[out] byte_encoder map<int, str>: byte value->character mapping
+ * @param[in] token str: Raw UTF-8 piece to merge
+ * @param[out] ids vector<int>: Receives the vocabulary ids of the merged word
  */
-std::unordered_map<int, std::string> CLIPTokenizer::bytes_to_unicode() {
-    std::unordered_map<int, std::string> byte_encoder;
-    
-    // Ranges of bytes to encode
-    std::vector<int> bs;
-    for (int b = 33; b <= 126; ++b) bs.push_back(b);
-    for (int b = 161; b <= 172; ++b) bs.push_back(b);
-    for (int b = 174; b <= 255; ++b) bs.push_back(b);
-
-    // Go through 
-    int n = 0;
-    for (int b = 0; b < 256; ++b) {
-        if (std::find(bs.begin(), bs.end(), b) == bs.end()) {
-            bs.push_back(b);
-            byte_encoder[b] = static_cast<char>(256 + n);
-            ++n;
-        }
+void CLIPTokenizer::bpe_merge(std::string_view token, std::vector<int>& ids) const {
+    if (token.empty()) {
+        return;
     }
 
-    // Link byte as key to character representation as value in map 
-    for (int b : bs) {
-        byte_encoder[b] = static_cast<char>(b);
+    struct Symbol {
+        int id;
+        int prev;
+        int next;
+    };
+
+    struct Candidate {
+        int32_t rank;
+        int32_t pos;
+        int32_t left;
+        int32_t right;
+        int32_t merged;
+
+        bool operator>(const Candidate& other) const {
+            return rank != other.rank ? rank > other.rank : pos > other.pos;
+        }
+    };
+
+    // Byte-level encoding: each raw byte starts as the id of its
+    // bytes_to_unicode() character
+    const int n = static_cast<int>(token.size());
+    std::vector<Symbol> word(n);
+    for (int i = 0; i < n; ++i) {
+        unsigned char c = static_cast<unsigned char>(token[i]);
+        word[i] = {i == n - 1 ? bpe_vocab->byte_eow_id(c) : bpe_vocab->byte_id(c), i - 1, i + 1 < n ? i + 1 : -1};
     }
 
-    return byte_encoder;
-}
+    const MergeTable& bpe_ranks = bpe_vocab->merges();
 
-/**
- * Create pairs map of two tokens in a word stream
- *
- * @param[in] word vector<str>: word stream
- * 
- * @returns pairs set<pair<str, str>>: map of pair.first -> pair.second tokens
- */
-std::set<std::pair<std::string, std::string>> CLIPTokenizer::get_pairs(const std::vector<std::string>& word) {
-    std::set<std::pair<std::string, std::string>> pairs;
-    for (size_t i = 0; i < word.size() - 1; ++i) {
-        pairs.insert({word[i], word[i+1]});
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    auto push_pair = [&](int pos) {
+        int next = word[pos].next;
+        if (next < 0) {
+            return;
+        }
+        const MergeTable::Entry* merge = bpe_ranks.find(word[pos].id, word[next].id);
+        if (merge) {
+            queue.push({merge->rank, pos, word[pos].id, word[next].id, merge->merged});
+        }
+    };
+
+    for (int i = 0; i + 1 < n; ++i) {
+        push_pair(i);
     }
-    return pairs;
-}
 
-std::string CLIPTokenizer::basic_clean(const std::string& text) {
-    // Demo function implemented to emultate ftfy python library
-    // Note: Full implementation of ftfy.fix_text would require additional library
-    // This is a simplified version
-    std::string cleaned = text;
-    
-    // Remove leading/trailing whitespace
-    cleaned.erase(0, cleaned.find_first_not_of(" \t\n\r\f\v"));
-    cleaned.erase(cleaned.find_last_not_of(" \t\n\r\f\v") + 1);
-    
-    return cleaned;
-}
+    while (!queue.empty()) {
+        Candidate best = queue.top();
+        queue.pop();
 
-std::string CLIPTokenizer::whitespace_clean(const std::string& text) {
-    // Replace multiple whitespaces with a single space
-    std::regex ws_regex(R"(\s+)");
-    return std::regex_replace(text, ws_regex, " ");
-}
+        // Skip candidates made stale by an earlier merge
+        Symbol& left = word[best.pos];
+        if (left.id != best.left || left.next < 0) {
+            continue;
+        }
+        Symbol& right = word[left.next];
+        if (right.id != best.right) {
+            continue;
+        }
 
-/**
- * Determines if a nested map contains a combination of two keys type<str>  
- *                                               
- * @param[in] mapping map<str, map<str, int>>: Outer-most map to search 
- *                through                                   
- * @param[in] key1 str: key to use for finding outer map                                   
- * @param[in] key2 str: key to use for finding inner map                                   
- * @returns bool: `true` if both keys exist, else `false`                                
- */
-bool check_keys(std::unordered_map<std::string, std::unordered_map<std::string, int>> mapping, std::string key1, std::string key2) {
-    // Find first key in outer map
-    auto it_inner = mapping.find(key1);
+        // Merge right into left and unlink it
+        left.id = best.merged;
+        left.next = right.next;
+        if (right.next >= 0) {
+            word[right.next].prev = best.pos;
+        }
+        right.id = -1;
 
-    if (it_inner != mapping.end()) {
-        // Return wether second key is in inner map  
-        return it_inner->second.find(key2) != it_inner->second.end();
+        // New bigrams formed with the neighbours
+        if (left.prev >= 0) {
+            push_pair(left.prev);
+        }
+        push_pair(best.pos);
     }
 
-    // First key does not exist in outer map
-    return false;
+    for (int i = 0; i >= 0; i = word[i].next) {
+        ids.push_back(word[i].id);
+    }
 }
 
 /**
- * Modification of bpe() function in OpenAI's CLIP module:                  
- * https://github.com/openai/CLIP/blob/main/clip/simple_tokenizer.py#L62    
- * Performs the byte-pair encoding to help encode some text.                
- *                                                             
- * @param[in] token str: Tokens to convert to word                                          
- *                                                                
- * @returns word str: Converted word                                                     
+ * Run the merge loop over every word that should never wait for it: the
+ * vocabulary entries ending in "</w>" that pre-tokenize to themselves, and
+ * the pieces of a representative corpus. Entries are mapped back from their
+ * bytes_to_unicode() form to the raw bytes the pre-tokenizer produces.
+ *
+ * @param[in] corpus span<string_view>: Extra texts whose words to include
+ * @returns WordTable: Frozen word -> ids table
  */
-std::string CLIPTokenizer::bpe(const std::string& token) {
-    // Check cache first, memoization
-    auto cache_it = cache.find(token);
-    if (cache_it != cache.end()) {
-        return cache_it->second;
-    }
-
-    // Prepare the word
-    std::vector<std::string> word;
-    for (size_t i = 0; i < token.length() - 1; ++i) {
-        word.push_back(std::string(1, token[i]));
+std::shared_ptr<const WordTable> CLIPTokenizer::build_word_table(
+    std::span<const std::string_view> corpus
+) const {
+    std::unordered_map<std::string, char> byte_decoder;
+    for (const auto& [b, ch] : BPEVocab::bytes_to_unicode()) {
+        byte_decoder[ch] = static_cast<char>(b);
     }
-    word.push_back(token.substr(token.length() - 1) + "</w>");
 
-    // Get initial pairs
-    std::set<std::pair<std::string, std::string>> pairs = get_pairs(word);
-    
-    if (pairs.empty()) {
-        return token + "</w>";
-    }
-
-    int iteration = 0;
-
-    while (!pairs.empty() 
-            // && iteration < _max_iters
-            ) {
-        // Set min to maximum possible intiger
-        int min = 1 << 31;
-        min = min - 1; // Computes 2^31 as an integer
-        std::pair<std::string, std::string> best_pair = {"", ""};
-        bool found_pair = false;
-        
-        // Iterate through set and get minimum value
-        for (auto it = pairs.begin(); it != pairs.end(); ++it) {
-            // Check if element exists
-            if (check_keys(bpe_ranks, it->first, it->second)) {
-                if (bpe_ranks[it->first][it->second] < min) {
-                    // Update min value and best pair if better than existing
-                    found_pair = true;
-                    min = bpe_ranks[it->first][it->second];
-                    best_pair.first = it->first;
-                    best_pair.second = it->second;
-                }
-            } else {
-                // pair does not exist
-                std::cerr << "Pair : " <<it->first << ", " << it->second << " does not exist in bpe_ranks" << std::endl;
-                break;
-            }
+    std::vector<std::pair<std::string, std::vector<int>>> entries;
+    std::unordered_set<std::string> seen;
+    std::string cleaned_text;
+    std::vector<std::string_view> pieces;
+    auto add = [&](std::string_view word) {
+        if (word.empty() || word == "<|startoftext|>" || word == "<|endoftext|>" ||
+            !seen.emplace(word).second) {
+            return;
         }
-
-        if (!found_pair) {
-            break;
+        std::vector<int> ids;
+        bpe_merge(word, ids);
+        entries.emplace_back(std::string(word), std::move(ids));
+    };
+
+    const std::string_view eow = "</w>";
+    for (int id = 0; id < bpe_vocab->size(); ++id) {
+        std::string_view token = bpe_vocab->token(id);
+        if (token.size() <= eow.size() || token.substr(token.size() - eow.size()) != eow) {
+            continue;
         }
-
-        std::vector<std::string> new_word;
-        size_t i = 0;
-        while (i < word.size()) {
-            auto it = std::find(word.begin() + i, word.end(), best_pair.first);
-            if (it == word.end()) {
-                // Add the remaining part of the word
-                new_word.insert(new_word.end(), word.begin() + i, word.end());
-                break;
-            }
-
-            size_t j = std::distance(word.begin(), it);
-            new_word.insert(new_word.end(), word.begin() + i, word.begin() + j);
-
-            // Check if the bigram is found
-            if (j < word.size() - 1 && word[j] == best_pair.first && word[j + 1] == best_pair.second) {
-                new_word.push_back(best_pair.first + best_pair.second);
-                i = j + 2; // Skip the merged pair
-            } else {
-                new_word.push_back(word[j]);
-                i = j + 1;
+        token.remove_suffix(eow.size());
+
+        // Symbols are one or two byte UTF-8 characters
+        std::string word;
+        bool valid = true;
+        for (size_t i = 0; i < token.size() && valid;) {
+            size_t len = (static_cast<unsigned char>(token[i]) & 0xE0) == 0xC0 ? 2 : 1;
+            auto it = byte_decoder.find(std::string(token.substr(i, len)));
+            valid = it != byte_decoder.end();
+            if (valid) {
+                word += it->second;
             }
+            i += len;
         }
 
-        word = new_word;
-
-        // Break if only one symbol remains
-        if (word.size() == 1) {
-            break;
+        PreTokenizer::split(word, cleaned_text, pieces);
+        if (valid && pieces.size() == 1 && pieces[0] == word) {
+            add(word);
         }
-
-        // Else, update pairs
-        pairs = get_pairs(word);
-        iteration++;
     }
 
-    // Convert word back to string
-    std::string result = word[0];
-
-    for (size_t i = 1; i < word.size(); ++i) {
-        result += " " + word[i];
+    for (std::string_view text : corpus) {
+        PreTokenizer::split(text, cleaned_text, pieces);
+        for (std::string_view piece : pieces) {
+            add(piece);
+        }
     }
 
-    // Cache and return
-    cache[token] = result;
-    return result;
+    return WordTable::build(entries, bpe_vocab->fingerprint(), bpe_vocab->size());
 }
 
-std::vector<int> CLIPTokenizer::encode(const std::string& text) {
+std::vector<int> CLIPTokenizer::encode(const std::string& text) const {
     std::vector<int> bpe_tokens;
-    
-    // Clean and lowercase the text
-    std::string cleaned_text = whitespace_clean(basic_clean(text));
-    std::transform(cleaned_text.begin(), cleaned_text.end(), cleaned_text.begin(), ::tolower);
-
-    // Tokenize using regex
-    std::sregex_iterator it(cleaned_text.begin(), cleaned_text.end(), pat);
-    std::sregex_iterator end;
-
-    while (it != end) {
-        std::string token = it->str();
-        
-        // Encode token to bytes
-        std::string byte_encoded_token;
-        for (unsigned char c : token) {
-            // Use byte encoder (simplified)
-            byte_encoded_token += static_cast<char>(c);
-        }
+    std::string cleaned_text;
+    std::vector<std::string_view> pieces;
+    encode_into(text, bpe_tokens, cleaned_text, pieces);
+    return bpe_tokens;
+}
 
-        // Apply BPE
-        std::string bpe_token = bpe(byte_encoded_token);
+/**
+ * encode() with caller-provided scratch, so repeated calls from one thread
+ * stop allocating once the buffers have grown.
+ *
+ * @param[in] text str: Text to encode
+ * @param[out] bpe_tokens vector<int>: Cleared, then receives the token ids
+ * @param[out] cleaned_text str: Scratch for the normalised text
+ * @param[out] pieces vector<string_view>: Scratch for the pre-tokenized pieces
+ */
+void CLIPTokenizer::encode_into(
+    std::string_view text,
+    std::vector<int>& bpe_tokens,
+    std::string& cleaned_text,
+    std::vector<std::string_view>& pieces
+) const {
+    bpe_tokens.clear();
+
+    // Clean, lowercase and split the text in a single pass
+    PreTokenizer::split(text, cleaned_text, pieces);
+
+    for (std::string_view piece : pieces) {
+        // Apply BPE, bytes are mapped to their unicode symbols inside
+        bpe(piece, bpe_tokens);
+    }
+}
 
-        // Convert to token IDs
-        std::istringstream iss(bpe_token);
-        std::string sub_token;
-        while (iss >> sub_token) {
-            if (encoder.find(sub_token) != encoder.end()) {
-                bpe_tokens.push_back(encoder[sub_token]);
+/**
+ * Python's bytes.decode("utf-8", errors="replace"): every maximal invalid
+ * subsequence becomes one U+FFFD. Valid text is returned untouched.
+ *
+ * @param[in,out] text str: Bytes to repair in place
+ */
+static void replace_invalid_utf8(std::string& text) {
+    auto valid_length = [&](size_t i) -> size_t {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t need;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c < 0x80) {
+            return 1;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            lo = c == 0xE0 ? 0xA0 : 0x80;
+            hi = c == 0xED ? 0x9F : 0xBF;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            lo = c == 0xF0 ? 0x90 : 0x80;
+            hi = c == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return 0;
+        }
+        for (size_t k = 1; k <= need; ++k) {
+            if (i + k >= text.size()) {
+                return 0;
+            }
+            unsigned char next = static_cast<unsigned char>(text[i + k]);
+            if (next < (k == 1 ? lo : 0x80) || next > (k == 1 ? hi : 0xBF)) {
+                return 0;
             }
         }
+        return need + 1;
+    };
 
-        ++it;
+    size_t i = 0;
+    while (i < text.size() && valid_length(i) != 0) {
+        i += valid_length(i);
+    }
+    if (i == text.size()) {
+        return;
     }
 
-    return bpe_tokens;
-}
+    std::string repaired(text, 0, i);
+    while (i < text.size()) {
+        size_t len = valid_length(i);
+        if (len != 0) {
+            repaired.append(text, i, len);
+            i += len;
+            continue;
+        }
 
-std::string CLIPTokenizer::decode(const std::vector<int>& tokens) {
-    // Convert tokens back to text
-    std::string text;
-    for (int token : tokens) {
-        if (decoder.find(token) != decoder.end()) {
-            text += decoder[token];
+        // Skip the lead byte and the continuation bytes that were still valid
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t skip = 1;
+        if (c >= 0xC2 && c <= 0xF4) {
+            unsigned char lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+            unsigned char hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+            size_t need = c <= 0xDF ? 1 : c <= 0xEF ? 2 : 3;
+            while (skip <= need && i + skip < text.size()) {
+                unsigned char next = static_cast<unsigned char>(text[i + skip]);
+                if (next < (skip == 1 ? lo : 0x80) || next > (skip == 1 ? hi : 0xBF)) {
+                    break;
+                }
+                ++skip;
+            }
         }
+        repaired += "\xEF\xBF\xBD";
+        i += skip;
     }
+    text.swap(repaired);
+}
 
-    // Remove "</w>" and handle decoding
-    text = std::regex_replace(text, std::regex("</w>"), " ");
-    
+/**
+ * Port of decode() in OpenAI's CLIP module: token bytes are joined, words
+ * end with a space and invalid UTF-8 is replaced.
+ *
+ * @param[in] tokens vector<int>: Token ids; unknown ids are skipped
+ * @returns text str: Decoded text
+ */
+std::string CLIPTokenizer::decode(const std::vector<int>& tokens) const {
+    std::string text;
+    decode_into(tokens, text);
+    replace_invalid_utf8(text);
     return text;
 }
 
-std::vector<int> CLIPTokenizer::encode_text(
-    const std::string& text, 
-    int context_length, 
-    bool truncate
-) {
-    // Get start and end of text tokens
-    int sot_token = encoder["<|startoftext|>"];
-    int eot_token = encoder["<|endoftext|>"];
+/**
+ * Append the decoded bytes of `tokens` to `out`. Sizes come from the decode
+ * table, so the buffer is grown once and filled with plain copies.
+ *
+ * @param[in] tokens span<int>: Token ids; unknown ids are skipped
+ * @param[in,out] out str: Buffer to append to
+ */
+void CLIPTokenizer::decode_into(std::span<const int> tokens, std::string& out) const {
+    size_t size = 0;
+    for (int token : tokens) {
+        size += bpe_vocab->token_bytes(token).size() + bpe_vocab->ends_word(token);
+    }
 
-    // Encode the text
-    std::vector<int> tokens = encode(text);
+    size_t start = out.size();
+    out.resize(start + size);
+    decode_to(tokens, out.begin() + start);
+}
 
-    // Prepare result vector
-    std::vector<int> result(context_length, 0);
+/**
+ * Lay out one context row: start token, as many ids as fit, end token, zero
+ * padding.
+ *
+ * @param[in] tokens vector<int>: Encoded text without special tokens
+ * @param[out] row T*: context_length entries to fill
+ * @param[in] context_length int: Row length
+ * @returns int: Number of non-padding entries written
+ */
+template <typename T>
+int CLIPTokenizer::fill_row(const std::vector<int>& tokens, T* row, int context_length) const {
+    if (context_length < 2) {
+        throw std::invalid_argument("context_length must leave room for the start and end tokens");
+    }
 
     // Add start of text token
-    result[0] = sot_token;
+    row[0] = bpe_vocab->sot_id();
 
     // Add encoded tokens
     size_t max_tokens = std::min(tokens.size(), static_cast<size_t>(context_length - 2));
     for (size_t i = 0; i < max_tokens; ++i) {
-        result[i + 1] = tokens[i];
+        row[i + 1] = tokens[i];
     }
 
-    // Add end of text token
-    result[max_tokens + 1] = eot_token;
+    // Add end of text token, pad the rest
+    row[max_tokens + 1] = bpe_vocab->eot_id();
+    std::fill(row + max_tokens + 2, row + context_length, T(0));
+
+    return static_cast<int>(max_tokens + 2);
+}
+
+std::vector<int> CLIPTokenizer::encode_text(
+    const std::string& text, 
+    int context_length, 
+    bool truncate
+) const {
+    // Encode the text
+    std::vector<int> tokens = encode(text);
+
+    // Prepare result vector
+    std::vector<int> result(std::max(context_length, 0), 0);
+    fill_row(tokens, result.data(), context_length);
 
     return result;
 }
+
+/**
+ * Tokenize a batch straight into a row-major [N, context_length] int64 buffer,
+ * the layout the ONNX text model takes, so no per-prompt vectors or flattening
+ * copy are needed. Each row is identical to encode_text(). Rows are handed to
+ * the pool in small chunks; each pool thread keeps its own scratch.
+ *
+ * @param[in] texts span<string_view>: The N texts to encode
+ * @param[out] out int64*: Caller-owned buffer of N * context_length ids
+ * @param[in] context_length int: Row length including start/end tokens
+ * @param[in] pool ThreadPool&: Pool to run on; the caller works on it too
+ * @returns lengths vector<int>: Number of non-padding ids in each row
+ */
+std::vector<int> CLIPTokenizer::encode_batch(
+    std::span<const std::string_view> texts,
+    int64_t* out,
+    int context_length,
+    ThreadPool& pool
+) const {
+    const size_t n = texts.size();
+    std::vector<int> lengths(n, 0);
+
+    const size_t chunk = 16;
+    pool.parallel_for((n + chunk - 1) / chunk, [&](size_t c) {
+        thread_local std::vector<int> tokens;
+        thread_local std::string cleaned_text;
+        thread_local std::vector<std::string_view> pieces;
+        for (size_t i = c * chunk; i < std::min((c + 1) * chunk, n); ++i) {
+            encode_into(texts[i], tokens, cleaned_text, pieces);
+            lengths[i] = fill_row(tokens, out + i * context_length, context_length);
+        }
+    });
+
+    return lengths;
+}
@@ -4,69 +4,110 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <set>
-#include <regex>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <iterator>
+#include <string_view>
+#include <memory>
+#include <span>
+#include <cstdint>
+#include "bpe_vocab.hpp"
+#include "bpe_cache.hpp"
+#include "word_table.hpp"
+#include "pretokenizer.hpp"
+#include "thread_pool.hpp"
 
 class CLIPTokenizer {
 public:
-    CLIPTokenizer(const std::string bpe_path = "");
+    CLIPTokenizer(const std::string bpe_path = "",
+                  const BPECache::Config& cache_config = BPECache::Config());
+    explicit CLIPTokenizer(std::shared_ptr<const BPEVocab> vocab,
+                           const BPECache::Config& cache_config = BPECache::Config());
     
-    // Main encoding methods
-    std::vector<int>                        encode(const std::string& text);
-    std::string                             decode(const std::vector<int>& tokens);
+    // Main encoding methods, safe to call from several threads at once
+    std::vector<int>                        encode(const std::string& text) const;
+    std::string                             decode(const std::vector<int>& tokens) const;
+
+    // Streaming decode: append the bytes of each token, plus a space after
+    // every word, to `out` (grown at most once) or through an output iterator.
+    // Bytes are raw; only decode() repairs invalid UTF-8 like Python does
+    void                                    decode_into(std::span<const int> tokens,
+                                                        std::string& out) const;
+    template <typename OutputIt>
+    OutputIt                                decode_to(std::span<const int> tokens,
+                                                      OutputIt out) const {
+                                                for (int token : tokens) {
+                                                    std::string_view bytes = bpe_vocab->token_bytes(token);
+                                                    out = std::copy(bytes.begin(), bytes.end(), out);
+                                                    if (bpe_vocab->ends_word(token)) {
+                                                        *out++ = ' ';
+                                                    }
+                                                }
+                                                return out;
+                                            }
     
     // Encode text with context length and truncation
     std::vector<int>                        encode_text(
                                             const std::string& text, 
                                             int context_length = 77, 
                                             bool truncate = false
-                                            );
+                                            ) const;
+
+    // Encode N texts into a caller-owned int64 [N, context_length] buffer
+    // on `pool`; returns row lengths
+    std::vector<int>                        encode_batch(
+                                            std::span<const std::string_view> texts,
+                                            int64_t* out,
+                                            int context_length = 77,
+                                            ThreadPool& pool = ThreadPool::global()
+                                            ) const;
+
+    // Vocabulary and merge ranks backing this tokenizer
+    const BPEVocab&                         vocab() const { return *bpe_vocab; }
+
+    // Precompute BPE for every single-word vocabulary entry and every word of
+    // `corpus`; the result can be saved and handed to set_word_table()
+    std::shared_ptr<const WordTable>        build_word_table(
+                                            std::span<const std::string_view> corpus = {}
+                                            ) const;
+
+    // Frozen word -> ids table consulted before the cache and merge loop.
+    // Not synchronised: set it before sharing the tokenizer between threads
+    void                                    set_word_table(std::shared_ptr<const WordTable> table) {
+                                                words = std::move(table);
+                                            }
+    const WordTable*                        word_table() const { return words.get(); }
+
+    // Hit, miss and eviction counters of the BPE cache
+    BPECache::Stats                         cache_stats() const { return cache.stats(); }
 private:
     // Internal helper methods
-    std::unordered_map<int, std::string>            bytes_to_unicode();
-    std::set<std::pair<std::string, std::string>>   get_pairs(const std::vector<std::string>& word);
-    std::string                                     bpe(const std::string& token);
-    std::string                                     basic_clean(const std::string& text);
-    std::string                                     whitespace_clean(const std::string& text);
-    std::vector<std::pair<std::string, 
-                            std::string>>           open_bpe(const std::string bpe_path);
-    // std::unordered_map<int, std::string> bytes_to_unicode();
-
-    // Hash function for pair hashing
-    struct PairHash {
-        template <class T1, class T2>
-        std::size_t operator () (const std::pair<T1, T2>& p) const {
-            auto h1 = std::hash<T1>{}(p.first);
-            auto h2 = std::hash<T2>{}(p.second);
-            return h1 ^ h2;
-        }
-    };
+    void                                            bpe(std::string_view token,
+                                                        std::vector<int>& ids) const;
+    void                                            bpe_merge(std::string_view token, 
+                                                            std::vector<int>& ids) const;
+    void                                            encode_into(std::string_view text,
+                                                            std::vector<int>& bpe_tokens,
+                                                            std::string& cleaned_text,
+                                                            std::vector<std::string_view>& pieces) const;
+    template <typename T>
+    int                                             fill_row(const std::vector<int>& tokens,
+                                                            T* row, int context_length) const;
 
-public:
-    std::unordered_map<int, std::string>    decoder;
-    std::unordered_map<std::string, int>    encoder;
 private:
-    // Byte encoding helpers
-    std::unordered_map<int, char>           byte_decoder;
-    std::unordered_map<std::string, 
-                        std::unordered_map
-                        <std::string, int>> bpe_ranks;
+    // Vocabulary, byte symbols and merge ranks; immutable and shareable
+    std::shared_ptr<const BPEVocab>         bpe_vocab;
     
-    // Cache for BPE results
-    std::unordered_map<std::string, 
-                    std::string>            cache;
-    
-    // Regex pattern for tokenization
-    std::regex                              pat;
+    // Optional precomputed whole-word results, read-only
+    std::shared_ptr<const WordTable>        words;
+
+    // Bounded, sharded cache of BPE results (token ids per piece)
+    mutable BPECache                        cache;
 
     // Debugging mode
     bool                                    _debug {true};
-    int                                     _max_iters {100};
 };
 
 #endif // CLIP_TOKENIZER_H
@@ -0,0 +1,276 @@
+#include "word_table.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char       WORDS_MAGIC[8] = {'C', 'L', 'I', 'P', 'W', 'R', 'D', '\0'};
+static const uint32_t   BYTE_ORDER_MARK = 0x01020304;
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+/**
+ * FNV-1a over the word bytes. The hash is stored in the file, so it must not
+ * depend on the standard library the table is loaded with.
+ */
+uint64_t WordTable::hash(std::string_view word) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (unsigned char c : word) {
+        h = (h ^ c) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+std::string WordTable::path_for(const std::string& vocab_path) {
+    std::string stem = vocab_path;
+    for (const std::string ext : {".gz", ".txt", ".bin"}) {
+        if (stem.size() > ext.size() && stem.compare(stem.size() - ext.size(), ext.size(), ext) == 0) {
+            stem.erase(stem.size() - ext.size());
+        }
+    }
+    return stem + ".words.bin";
+}
+
+bool WordTable::is_word_table(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(WORDS_MAGIC)] = {};
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, WORDS_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Lay out the words in a heap image. The table is kept at most half full so
+ * that misses, which go on to the merge loop, end after a short probe.
+ *
+ * @param[in] words vector<pair<str, vector<int>>>: word -> final BPE ids
+ * @param[in] vocab BPEVocab::Fingerprint: vocab the ids come from
+ * @param[in] vocab_size size_t: number of ids in that vocab
+ */
+std::shared_ptr<const WordTable> WordTable::build(
+    const std::vector<std::pair<std::string, std::vector<int>>>& words,
+    const BPEVocab::Fingerprint& vocab,
+    size_t vocab_size
+) {
+    std::unordered_set<std::string_view> seen;
+    std::vector<size_t> kept;
+    size_t arena_size = 0;
+    size_t id_total = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        const auto& [word, word_ids] = words[i];
+        if (word.empty() || word_ids.empty() || !seen.insert(word).second) {
+            continue;
+        }
+        kept.push_back(i);
+        arena_size += word.size();
+        id_total += word_ids.size();
+    }
+    if (arena_size > UINT32_MAX || id_total > UINT32_MAX) {
+        throw std::length_error("Word table too large");
+    }
+
+    uint64_t capacity = 16;
+    while (capacity < kept.size() * 2) {
+        capacity *= 2;
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, WORDS_MAGIC, sizeof(WORDS_MAGIC));
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = FORMAT_VERSION;
+    header.vocab_merge_count = vocab.merge_count;
+    header.vocab_hash = vocab.hash;
+    header.word_count = kept.size();
+    header.capacity = capacity;
+
+    size_t pos = align8(sizeof(Header));
+    header.slots_pos = pos;
+    pos = align8(pos + capacity * sizeof(Slot));
+    header.ids_pos = pos;
+    header.id_total = id_total;
+    pos = align8(pos + id_total * sizeof(int32_t));
+    header.arena_pos = pos;
+    header.arena_size = arena_size;
+    header.file_size = align8(pos + arena_size);
+
+    std::shared_ptr<WordTable> result(new WordTable());
+    result->owned.assign(header.file_size / sizeof(uint64_t), 0);
+    char* image = reinterpret_cast<char*>(result->owned.data());
+    std::memcpy(image, &header, sizeof(Header));
+
+    Slot* slots = reinterpret_cast<Slot*>(image + header.slots_pos);
+    int32_t* ids = reinterpret_cast<int32_t*>(image + header.ids_pos);
+    char* arena = image + header.arena_pos;
+    uint32_t key_pos = 0;
+    uint32_t ids_pos = 0;
+    for (size_t i : kept) {
+        const auto& [word, word_ids] = words[i];
+        uint64_t h = hash(word);
+        size_t slot = h & (capacity - 1);
+        while (slots[slot].id_count != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        slots[slot] = {h, key_pos, static_cast<uint32_t>(word.size()),
+                       ids_pos, static_cast<uint32_t>(word_ids.size())};
+        std::memcpy(arena + key_pos, word.data(), word.size());
+        std::copy(word_ids.begin(), word_ids.end(), ids + ids_pos);
+        key_pos += static_cast<uint32_t>(word.size());
+        ids_pos += static_cast<uint32_t>(word_ids.size());
+    }
+
+    result->attach(image, header.file_size, vocab_size);
+    return result;
+}
+
+/**
+ * Map a saved table read-only, shared with every process using the same file.
+ * Ids are only meaningful for the vocab the table was built from, so a table
+ * built from any other is rejected.
+ *
+ * @param[in] path str: Path to a file written by save()
+ * @param[in] vocab BPEVocab::Fingerprint: vocab the table will be used with
+ * @param[in] vocab_size size_t: number of ids in that vocab
+ */
+std::shared_ptr<const WordTable> WordTable::from_file(const std::string& path,
+                                                      const BPEVocab::Fingerprint& vocab,
+                                                      size_t vocab_size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening word table file: " + path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        throw std::runtime_error("Invalid word table file: " + path);
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map word table file: " + path);
+    }
+
+    std::shared_ptr<WordTable> result(new WordTable());
+    result->mapping = mapping;
+    result->mapping_size = size;
+    try {
+        result->attach(static_cast<const char*>(mapping), size, vocab_size);
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + ": " + path);
+    }
+    if (result->vocab != vocab) {
+        throw std::runtime_error("Word table was built from another vocab: " + path);
+    }
+    return result;
+}
+
+WordTable::~WordTable() {
+    if (mapping) {
+        ::munmap(mapping, mapping_size);
+    }
+}
+
+/**
+ * Validate an image and point the accessors into it. Images usually come from
+ * a file, so every slot is checked once here and lookup() can trust them: at
+ * least one slot must be empty or a probe for a missing word never ends, and
+ * every id must index the vocab.
+ *
+ * @param[in] image char*: start of the image, 8-byte aligned
+ * @param[in] image_size size_t: bytes available at `image`
+ * @param[in] vocab_size size_t: number of ids in the vocab the table is used with
+ */
+void WordTable::attach(const char* image, size_t image_size, size_t vocab_size) {
+    Header header;
+    std::memcpy(&header, image, sizeof(Header));
+
+    if (std::memcmp(header.magic, WORDS_MAGIC, sizeof(WORDS_MAGIC)) != 0) {
+        throw std::runtime_error("Not a word table file");
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Word table file has the wrong byte order");
+    }
+    if (header.version != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported word table version " + std::to_string(header.version));
+    }
+    if (header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+        header.word_count >= header.capacity) {
+        throw std::runtime_error("Corrupt word table file");
+    }
+    if (header.file_size != image_size ||
+        header.slots_pos + header.capacity * sizeof(Slot) > image_size ||
+        header.ids_pos + header.id_total * sizeof(int32_t) > image_size ||
+        header.arena_pos + header.arena_size > image_size) {
+        throw std::runtime_error("Truncated word table file");
+    }
+
+    vocab = {header.vocab_merge_count, header.vocab_hash};
+    word_count = header.word_count;
+    mask = header.capacity - 1;
+    slots = reinterpret_cast<const Slot*>(image + header.slots_pos);
+    ids = reinterpret_cast<const int32_t*>(image + header.ids_pos);
+    arena = image + header.arena_pos;
+
+    // Bound every slot once so lookups need no checks
+    uint64_t occupied = 0;
+    for (uint64_t i = 0; i < header.capacity; ++i) {
+        const Slot& slot = slots[i];
+        if (slot.id_count == 0) {
+            continue;
+        }
+        ++occupied;
+        if (uint64_t(slot.key_pos) + slot.key_size > header.arena_size ||
+            uint64_t(slot.ids_pos) + slot.id_count > header.id_total) {
+            throw std::runtime_error("Corrupt word table file");
+        }
+        for (uint32_t j = 0; j < slot.id_count; ++j) {
+            if (ids[slot.ids_pos + j] < 0 || static_cast<size_t>(ids[slot.ids_pos + j]) >= vocab_size) {
+                throw std::runtime_error("Word table refers to unknown tokens");
+            }
+        }
+    }
+    if (occupied != header.word_count) {
+        throw std::runtime_error("Word table holds " + std::to_string(occupied) + " words, expected " +
+                                 std::to_string(header.word_count));
+    }
+}
+
+void WordTable::save(const std::string& path) const {
+    const char* image = mapping ? static_cast<const char*>(mapping)
+                                : reinterpret_cast<const char*>(owned.data());
+    size_t size = mapping ? mapping_size : owned.size() * sizeof(uint64_t);
+
+    // Write beside the target and rename so readers never map a partial file
+    std::string temp_path = path + ".part";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(image, static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("Error writing word table file: " + temp_path);
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+bool WordTable::lookup(std::string_view word, std::vector<int>& out) const {
+    uint64_t h = hash(word);
+    for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.id_count == 0) {
+            return false;
+        }
+        if (slot.hash == h && slot.key_size == word.size() &&
+            std::memcmp(arena + slot.key_pos, word.data(), word.size()) == 0) {
+            out.insert(out.end(), ids + slot.ids_pos, ids + slot.ids_pos + slot.id_count);
+            return true;
+        }
+    }
+}
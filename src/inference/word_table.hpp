@@ -0,0 +1,102 @@
+#ifndef CLIP_WORD_TABLE_H
+#define CLIP_WORD_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "bpe_vocab.hpp"
+
+/**
+ * Frozen dictionary from whole pre-tokenized words to their final BPE ids.
+ *
+ * Built offline (see CLIPTokenizer::build_word_table and compile_vocab) and
+ * never modified afterwards, so lookups take no locks. Slots are one flat
+ * open-addressing array holding the word hash and where its bytes and ids
+ * live; a probe usually touches a single slot before comparing the key.
+ * Like BPEVocab the image has the same layout in memory and on disk and a
+ * saved table is memory-mapped read-only. The fingerprint of the vocab a
+ * table was built from is stored with it, and loading checks it.
+ */
+class WordTable {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 2;
+
+    // Freeze (word, ids) pairs of `vocab`, which has `vocab_size` ids; later
+    // duplicates of a word are ignored
+    static std::shared_ptr<const WordTable> build(
+        const std::vector<std::pair<std::string, std::vector<int>>>& words,
+        const BPEVocab::Fingerprint& vocab, size_t vocab_size);
+
+    // Memory-map a file written by save(); std::runtime_error if it was
+    // built from another vocab than `vocab` or is corrupt
+    static std::shared_ptr<const WordTable> from_file(const std::string& path,
+                                                      const BPEVocab::Fingerprint& vocab,
+                                                      size_t vocab_size);
+
+    // Conventional table path next to a vocab: "x.txt.gz" or "x.bin" -> "x.words.bin"
+    static std::string                      path_for(const std::string& vocab_path);
+
+    // True if the file at `path` starts with the word table magic
+    static bool                             is_word_table(const std::string& path);
+
+    ~WordTable();
+    WordTable(const WordTable&) = delete;
+    WordTable& operator=(const WordTable&) = delete;
+
+    void                save(const std::string& path) const;
+
+    // Append the ids of `word` to `ids`; returns false if it is not in the table
+    bool                lookup(std::string_view word, std::vector<int>& ids) const;
+
+    size_t              size() const { return word_count; }
+    const BPEVocab::Fingerprint& vocab_fingerprint() const { return vocab; }
+    bool                is_mapped() const { return mapping != nullptr; }
+
+private:
+    struct Header {
+        char        magic[8];
+        uint32_t    byte_order;
+        uint32_t    version;
+        uint64_t    vocab_merge_count;  // BPEVocab::Fingerprint of the source vocab
+        uint64_t    vocab_hash;
+        uint64_t    word_count;
+        uint64_t    capacity;       // power of two
+        uint64_t    slots_pos;      // Slot[capacity]
+        uint64_t    ids_pos;        // int32_t[id_total]
+        uint64_t    id_total;
+        uint64_t    arena_pos;      // word bytes
+        uint64_t    arena_size;
+        uint64_t    file_size;
+    };
+
+    // id_count == 0 marks an empty slot; every word has at least one id
+    struct Slot {
+        uint64_t    hash;
+        uint32_t    key_pos;
+        uint32_t    key_size;
+        uint32_t    ids_pos;
+        uint32_t    id_count;
+    };
+
+    static uint64_t     hash(std::string_view word);
+
+    WordTable() = default;
+
+    void                attach(const char* image, size_t image_size, size_t vocab_size);
+
+    std::vector<uint64_t>   owned;
+    void*                   mapping {nullptr};
+    size_t                  mapping_size {0};
+
+    BPEVocab::Fingerprint   vocab;
+    size_t                  word_count {0};
+    uint64_t                mask {0};
+    const Slot*             slots {nullptr};
+    const int32_t*          ids {nullptr};
+    const char*             arena {nullptr};
+};
+
+#endif // CLIP_WORD_TABLE_H
@@ -11,9 +11,6 @@
 #include <tokenizer.hpp>
 
 int main(int argc, char* argv[]) {
-    std::unordered_map<int, char> byte_decoder;
-    static CLIPTokenizer tokenizer;
-
     std::setlocale(LC_ALL, "en_US.UTF-8");
 
     if (argc != 2) {
@@ -47,6 +44,7 @@ int main(int argc, char* argv[]) {
 
     bpe_file.close();
 
+    CLIPTokenizer tokenizer(path);
     std::string text = "a photo of clip";
     std::vector<int> tokens = tokenizer.encode(text);
 
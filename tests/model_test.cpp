@@ -0,0 +1,1007 @@
+#include "../src/inference/model.hpp"
+#include "../src/inference/pixel_cache.hpp"
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <thread>
+#include <cmath>
+#include <csignal>
+#include <filesystem>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <fstream>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace cv;
+
+// Stand-in models written by scripts/gen_test_models.py. Instead of an
+// embedding, each row holds features of its input in the first columns
+const std::string MODELS_PATH = "../tests/data/";
+const std::string VOCAB_PATH = "../src/data/bpe_simple_vocab_16e6.txt";
+
+enum ImageColumn { IMAGE_MEAN = 0, IMAGE_ROWS = 3 };
+enum TextColumn { TEXT_SUM = 0, TEXT_COUNT = 1, TEXT_LENGTH = 2, TEXT_ROWS = 3 };
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions /////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<OnnxClip> load_clip(const std::string& models = "tiny_clip", int batch_size = 0,
+                                    const OnnxClipConfig& config = {}) {
+    return std::make_unique<OnnxClip>("ViT-B/32", batch_size, true, MODELS_PATH + models, 2, config);
+}
+
+cv::Mat random_image(int rows, int cols, int seed) {
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::RNG rng(seed);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    return image;
+}
+
+// What the image model returns for `image`: the mean of each preprocessed channel
+std::vector<double> image_features(const cv::Mat& image) {
+    Tensor pixels = CLIPpreprocessor::encode_image(image);
+    size_t plane = pixels.numel() / 3;
+    std::vector<double> means(3);
+    for (size_t c = 0; c < 3; ++c) {
+        means[c] = std::accumulate(pixels.data() + c * plane, pixels.data() + (c + 1) * plane, 0.0) / plane;
+    }
+    return means;
+}
+
+// What the text model returns for `text`: the sum and count of its token ids
+std::vector<double> text_features(const CLIPTokenizer& tokenizer, const std::string& text) {
+    std::vector<int> ids = tokenizer.encode_text(text);
+    return {std::accumulate(ids.begin(), ids.end(), 0.0),
+            static_cast<double>(std::count_if(ids.begin(), ids.end(), [](int id) { return id > 0; }))};
+}
+
+bool equal(const Tensor& a, const Tensor& b) {
+    return a.shape() == b.shape() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+bool near(double a, double b, double tolerance = 1e-4) {
+    return std::abs(a - b) <= tolerance * std::max(1.0, std::abs(b));
+}
+
+// Plain Session::Run of one model, the path OnnxClip ran before IoBinding
+template <typename T>
+std::vector<float> run_session(Ort::Session& session, const char* input_name, T* input,
+                               const std::vector<int64_t>& shape) {
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    size_t count = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>());
+    Ort::Value tensor = Ort::Value::CreateTensor<T>(memory_info, input, count, shape.data(), shape.size());
+
+    const char* output_name = "OUTPUT";
+    std::vector<Ort::Value> outputs = session.Run(Ort::RunOptions{nullptr}, &input_name, &tensor, 1, &output_name, 1);
+    const float* data = outputs[0].GetTensorData<float>();
+    return std::vector<float>(data, data + outputs[0].GetTensorTypeAndShapeInfo().GetElementCount());
+}
+
+bool all_near(const float* a, const std::vector<float>& b) {
+    for (size_t i = 0; i < b.size(); ++i) {
+        if (!near(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Test functions ///////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////
+bool test_load_models() {
+    std::cout << "=== Running test: LoadModels ===" << std::endl;
+    auto dynamic_clip = load_clip("tiny_clip");
+    auto static_clip = load_clip("tiny_clip_static");
+
+    if (dynamic_clip->getEmbeddingSize() != 512 || static_clip->getEmbeddingSize() != 512) {
+        std::cerr << "Error: Unexpected embedding size." << std::endl;
+        return false;
+    }
+    if (!dynamic_clip->hasDynamicTextLength() || static_clip->hasDynamicTextLength()) {
+        std::cerr << "Error: Dynamic text length not detected from the model inputs." << std::endl;
+        return false;
+    }
+    if (dynamic_clip->getImageEmbeddings(std::vector<cv::Mat>()).rows != 0 ||
+        dynamic_clip->getTextEmbeddings(std::vector<std::string>()).rows != 0) {
+        std::cerr << "Error: Empty input did not give an empty result." << std::endl;
+        return false;
+    }
+
+    std::cout << "Both model pairs loaded." << std::endl;
+    return true;
+}
+
+bool test_image_embeddings() {
+    std::cout << "=== Running test: ImageEmbeddings ===" << std::endl;
+    auto clip = load_clip("tiny_clip", 2);
+
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < 5; ++i) {
+        images.push_back(random_image(240 + 31 * i, 320 - 17 * i, i));
+    }
+    cv::Mat batched = clip->getImageEmbeddings(images);
+    cv::Mat whole = clip->getImageEmbeddings(images, false);
+
+    if (batched.rows != 5 || batched.cols != 512) {
+        std::cerr << "Error: Unexpected result shape." << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 5; ++i) {
+        std::vector<double> expected = image_features(images[i]);
+        for (int c = 0; c < 3; ++c) {
+            if (!near(batched.at<float>(i, IMAGE_MEAN + c), expected[c]) ||
+                !near(whole.at<float>(i, IMAGE_MEAN + c), expected[c])) {
+                std::cerr << "Error: Image " << i << " got another image's embedding." << std::endl;
+                return false;
+            }
+        }
+
+        // batch_size 2 splits five images 2 + 2 + 1; without batching they run at once
+        if (batched.at<float>(i, IMAGE_ROWS) != (i < 4 ? 2.0f : 1.0f) || whole.at<float>(i, IMAGE_ROWS) != 5.0f) {
+            std::cerr << "Error: Image " << i << " ran in a batch of the wrong size." << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Image embeddings match their inputs and batches." << std::endl;
+    return true;
+}
+
+bool test_text_embeddings() {
+    std::cout << "=== Running test: TextEmbeddings ===" << std::endl;
+    auto clip = load_clip();
+    CLIPTokenizer tokenizer(VOCAB_PATH);
+
+    std::vector<std::string> texts = {"a photo of a cat", "a diagram", "two dogs playing in the snow", "x"};
+    cv::Mat result = clip->getTextEmbeddings(texts);
+
+    if (result.rows != 4 || result.cols != 512) {
+        std::cerr << "Error: Unexpected result shape." << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        std::vector<double> expected = text_features(tokenizer, texts[i]);
+        if (!near(result.at<float>(i, TEXT_SUM), expected[0]) || result.at<float>(i, TEXT_COUNT) != expected[1]) {
+            std::cerr << "Error: Text " << i << " got another text's embedding." << std::endl;
+            return false;
+        }
+        if (result.at<float>(i, TEXT_LENGTH) != 77.0f || result.at<float>(i, TEXT_ROWS) != 4.0f) {
+            std::cerr << "Error: Text " << i << " did not run as one padded batch." << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Text embeddings match their inputs." << std::endl;
+    return true;
+}
+
+bool test_image_failures() {
+    std::cout << "=== Running test: ImageFailures ===" << std::endl;
+    auto clip = load_clip();
+    clip->setImageCache(std::make_shared<ImageEmbeddingCache>(clip->getEmbeddingSize()));
+
+    // Images 1 and 3 are the same unusable image
+    cv::Mat good = random_image(300, 200, 1);
+    std::vector<cv::Mat> images = {good, cv::Mat(), random_image(200, 300, 2), cv::Mat()};
+    std::vector<float> out(images.size() * 512, 1.0f);
+    std::vector<std::string> errors = clip->getImageEmbeddings(images, out.data());
+
+    if (errors.size() != 4 || !errors[0].empty() || errors[1].empty() || !errors[2].empty() ||
+        errors[3] != errors[1]) {
+        std::cerr << "Error: Preprocessing failures were not reported per image." << std::endl;
+        return false;
+    }
+    for (size_t i : {1, 3}) {
+        if (std::any_of(out.begin() + i * 512, out.begin() + (i + 1) * 512, [](float v) { return v != 0.0f; })) {
+            std::cerr << "Error: Failed image " << i << " has a non-zero row." << std::endl;
+            return false;
+        }
+    }
+    if (!near(out[IMAGE_MEAN], image_features(good)[0]) || clip->imageCache()->stats().entries != 2) {
+        std::cerr << "Error: Successful images were not embedded and cached alone." << std::endl;
+        return false;
+    }
+
+    // Still failing once the good images come from the cache
+    errors = clip->getImageEmbeddings(images, out.data());
+    if (errors[1].empty() || errors[3].empty() || !errors[0].empty()) {
+        std::cerr << "Error: A failure was lost on the cached path." << std::endl;
+        return false;
+    }
+
+    try {
+        clip->getImageEmbeddings(images);
+        std::cerr << "Error: The cv::Mat overload returned a zeroed row." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::cout << "Failed images are reported: " << errors[1] << std::endl;
+    return true;
+}
+
+bool test_scheduler() {
+    std::cout << "=== Running test: Scheduler ===" << std::endl;
+    auto clip = load_clip();
+    CLIPTokenizer tokenizer(VOCAB_PATH);
+
+    OnnxClipScheduler::Config config;
+    config.max_batch_size = 4;
+    config.max_delay = std::chrono::milliseconds(20);
+    OnnxClipScheduler scheduler(*clip, config, config);
+
+    // Every third image cannot be preprocessed; it fails alone
+    std::vector<cv::Mat> images;
+    std::vector<std::future<std::vector<float>>> results;
+    for (int i = 0; i < 9; ++i) {
+        images.push_back(i % 3 == 1 ? cv::Mat() : random_image(200 + 10 * i, 260, i));
+        results.push_back(scheduler.submitImage(images.back()));
+    }
+    auto text = scheduler.submitText("a photo of a cat");
+
+    for (int i = 0; i < 9; ++i) {
+        try {
+            std::vector<float> embedding = results[i].get();
+            if (i % 3 == 1 || !near(embedding[IMAGE_MEAN], image_features(images[i])[0])) {
+                std::cerr << "Error: Request " << i << " got the wrong embedding." << std::endl;
+                return false;
+            }
+        } catch (const std::runtime_error& e) {
+            if (i % 3 != 1) {
+                std::cerr << "Error: Request " << i << " failed with another request: " << e.what() << std::endl;
+                return false;
+            }
+        }
+    }
+    if (!near(text.get()[TEXT_SUM], text_features(tokenizer, "a photo of a cat")[0])) {
+        std::cerr << "Error: Wrong text embedding." << std::endl;
+        return false;
+    }
+
+    OnnxClipScheduler::Stats stats = scheduler.imageStats();
+    if (stats.requests != 9 || stats.failed_requests != 3 || stats.failed_batches != 0) {
+        std::cerr << "Error: Unexpected scheduler stats." << std::endl;
+        return false;
+    }
+
+    std::cout << stats.batches << " image batches, only the 3 unusable images failed." << std::endl;
+    return true;
+}
+
+bool test_bucketed_text() {
+    std::cout << "=== Running test: BucketedText ===" << std::endl;
+    auto dynamic_clip = load_clip("tiny_clip");
+    auto static_clip = load_clip("tiny_clip_static");
+    CLIPTokenizer tokenizer(VOCAB_PATH);
+
+    // Short, long and medium prompts interleaved, so sorting by length reorders them
+    std::vector<std::string> texts = {
+        "a cat",
+        "a long caption about a large brown dog sleeping on a red sofa next to the open window "
+        "of a small house in the warm light of the early morning sun",
+        "a photo of a dog in the snow next to a wooden fence",
+        "x",
+        "a diagram of the water cycle with clouds rain rivers and the sea",
+        "a photo of a dog",
+    };
+    std::vector<int> counts;
+    for (const std::string& text : texts) {
+        counts.push_back(static_cast<int>(text_features(tokenizer, text)[1]));
+    }
+
+    cv::Mat trimmed = dynamic_clip->getTextEmbeddingsBucketed(texts);
+    cv::Mat padded = static_clip->getTextEmbeddingsBucketed(texts);
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        std::vector<double> expected = text_features(tokenizer, texts[i]);
+        for (const cv::Mat& result : {trimmed, padded}) {
+            if (!near(result.at<float>(i, TEXT_SUM), expected[0]) || result.at<float>(i, TEXT_COUNT) != expected[1]) {
+                std::cerr << "Error: Bucketed text " << i << " came back out of order." << std::endl;
+                return false;
+            }
+        }
+
+        // Each bucket is trimmed to its longest member, 16 token counts per bucket
+        int longest = 0;
+        for (int count : counts) {
+            if ((count - 1) / 16 == (counts[i] - 1) / 16) {
+                longest = std::max(longest, count);
+            }
+        }
+        if (trimmed.at<float>(i, TEXT_LENGTH) != longest) {
+            std::cerr << "Error: Text " << i << " ran with length " << trimmed.at<float>(i, TEXT_LENGTH)
+                      << " instead of " << longest << std::endl;
+            return false;
+        }
+        if (padded.at<float>(i, TEXT_LENGTH) != 77.0f) {
+            std::cerr << "Error: The static model did not get the full context length." << std::endl;
+            return false;
+        }
+    }
+
+    // Buckets are split at batch_size
+    auto small_batches = load_clip("tiny_clip", 2);
+    cv::Mat split = small_batches->getTextEmbeddingsBucketed(texts);
+    for (int i = 0; i < split.rows; ++i) {
+        if (split.at<float>(i, TEXT_ROWS) > 2.0f || !near(split.at<float>(i, TEXT_SUM), trimmed.at<float>(i, TEXT_SUM))) {
+            std::cerr << "Error: Bucket of text " << i << " exceeds batch_size." << std::endl;
+            return false;
+        }
+    }
+
+    // Duplicates run once and the text cache is shared with getTextEmbeddings
+    auto cache = std::make_shared<TextEmbeddingCache>();
+    dynamic_clip->setTextCache(cache);
+    std::vector<std::string> repeated = {"a cat", "A  cat ", "a photo of a dog", "a cat"};
+    cv::Mat deduplicated = dynamic_clip->getTextEmbeddingsBucketed(repeated);
+    if (deduplicated.at<float>(0, TEXT_ROWS) != 2.0f || cache->stats().misses != 2 || cache->stats().entries != 2 ||
+        cv::norm(deduplicated.row(0), deduplicated.row(1)) != 0.0 || cv::norm(deduplicated.row(0), deduplicated.row(3)) != 0.0) {
+        std::cerr << "Error: Bucketed prompts were not deduplicated and cached." << std::endl;
+        return false;
+    }
+    cv::Mat cached = dynamic_clip->getTextEmbeddings(repeated);
+    if (cache->stats().hits != 2 || cv::norm(cached, deduplicated) != 0.0) {
+        std::cerr << "Error: getTextEmbeddings did not reuse the bucketed embeddings." << std::endl;
+        return false;
+    }
+
+    std::cout << "Buckets keep input order, trim only dynamic models and share the cache." << std::endl;
+    return true;
+}
+
+bool test_text_deduplication() {
+    std::cout << "=== Running test: TextDeduplication ===" << std::endl;
+    CLIPTokenizer tokenizer(VOCAB_PATH);
+
+    // Without a cache, repeated prompts of a call run once
+    auto uncached = load_clip();
+    cv::Mat repeated = uncached->getTextEmbeddings({"a cat", "a dog", "A cat", "a cat "});
+    for (int i = 0; i < 4; ++i) {
+        if (repeated.at<float>(i, TEXT_ROWS) != 2.0f ||
+            !near(repeated.at<float>(i, TEXT_SUM), text_features(tokenizer, i == 1 ? "a dog" : "a cat")[0])) {
+            std::cerr << "Error: Duplicate prompts were not run once each." << std::endl;
+            return false;
+        }
+    }
+
+    // With a warm cache, only unseen distinct prompts reach the model
+    auto clip = load_clip();
+    auto cache = std::make_shared<TextEmbeddingCache>();
+    clip->setTextCache(cache);
+    clip->getTextEmbeddings({"a cat", "a dog"});
+
+    std::vector<std::string> texts = {"a bird", "a cat", "A Bird", "a dog", "a fish", "a bird", " a  fish"};
+    const std::vector<std::string> normalized = {"a bird", "a cat", "a bird", "a dog", "a fish", "a bird", "a fish"};
+    cv::Mat result = clip->getTextEmbeddings(texts);
+    TextEmbeddingCache::Stats stats = cache->stats();
+
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        std::vector<double> expected = text_features(tokenizer, normalized[i]);
+        if (!near(result.at<float>(i, TEXT_SUM), expected[0]) || result.at<float>(i, TEXT_COUNT) != expected[1]) {
+            std::cerr << "Error: Text " << i << " got another prompt's row." << std::endl;
+            return false;
+        }
+
+        // Hits carry the batch of the warm-up call, misses the single run of "a bird" and "a fish"
+        bool hit = normalized[i] == "a cat" || normalized[i] == "a dog";
+        if (result.at<float>(i, TEXT_ROWS) != 2.0f) {
+            std::cerr << "Error: Text " << i << (hit ? " (hit)" : " (miss)") << " ran in a batch of "
+                      << result.at<float>(i, TEXT_ROWS) << std::endl;
+            return false;
+        }
+    }
+    if (stats.hits != 2 || stats.misses != 4 || stats.entries != 4) {
+        std::cerr << "Error: Expected 2 hits and 2 new misses, got " << stats.hits << " hits, "
+                  << stats.misses << " misses." << std::endl;
+        return false;
+    }
+
+    // Misses are still split at batch_size after deduplication
+    auto one_at_a_time = load_clip("tiny_clip", 1);
+    one_at_a_time->setTextCache(cache);
+    cv::Mat single = one_at_a_time->getTextEmbeddings({"a cat", "a horse", "a cow", "a horse"});
+    if (single.at<float>(1, TEXT_ROWS) != 1.0f || single.at<float>(2, TEXT_ROWS) != 1.0f ||
+        cv::norm(single.row(1), single.row(3)) != 0.0 || cv::norm(single.row(0), result.row(1)) != 0.0) {
+        std::cerr << "Error: Deduplicated misses were not batched by batch_size." << std::endl;
+        return false;
+    }
+
+    std::cout << "Each distinct prompt ran once, cache hit rate " << cache->stats().hit_rate() << std::endl;
+    return true;
+}
+
+bool test_bound_matches_run() {
+    std::cout << "=== Running test: BoundMatchesRun ===" << std::endl;
+    const int64_t size = CLIPpreprocessor::CLIP_INPUT_SIZE;
+    auto clip = load_clip();
+    CLIPTokenizer tokenizer(VOCAB_PATH);
+
+    Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "model_test");
+    Ort::Session image_session(env, (MODELS_PATH + "tiny_clip/clip_image_model_vitb32.onnx").c_str(),
+                               Ort::SessionOptions());
+    Ort::Session text_session(env, (MODELS_PATH + "tiny_clip/clip_text_model_vitb32.onnx").c_str(),
+                              Ort::SessionOptions());
+
+    // Growing and shrinking batches on one instance reuse its scratch buffers
+    std::vector<cv::Mat> pool_images;
+    for (int i = 0; i < 7; ++i) {
+        pool_images.push_back(random_image(230 + 13 * i, 300 - 9 * i, 100 + i));
+    }
+    const std::vector<std::string> prompts = {"a cat", "a photo of a dog", "x", "two birds on a wire",
+                                              "a diagram", "a red car parked outside", "snow"};
+
+    for (size_t rows : {3, 7, 1, 5, 2}) {
+        std::vector<cv::Mat> images(pool_images.begin() + (7 - rows), pool_images.end());
+        std::vector<float> pixels(rows * 3 * size * size);
+        CLIPpreprocessor::encode_batch(images, pixels.data());
+        std::vector<float> expected = run_session(image_session, "IMAGE", pixels.data(),
+                                                  {static_cast<int64_t>(rows), 3, size, size});
+
+        std::vector<float> bound(rows * 512);
+        clip->getImageEmbeddings(images, bound.data());
+        if (!all_near(bound.data(), expected)) {
+            std::cerr << "Error: Bound image run of " << rows << " differs from Session::Run." << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> texts(prompts.begin(), prompts.begin() + rows);
+        std::vector<std::string_view> views(texts.begin(), texts.end());
+        std::vector<int64_t> tokens(rows * 77);
+        tokenizer.encode_batch(views, tokens.data());
+        expected = run_session(text_session, "TEXT", tokens.data(), {static_cast<int64_t>(rows), 77});
+
+        clip->getTextEmbeddings(texts, bound.data());
+        if (!all_near(bound.data(), expected)) {
+            std::cerr << "Error: Bound text run of " << rows << " differs from Session::Run." << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "IoBinding runs match Session::Run across batch sizes 3, 7, 1, 5, 2." << std::endl;
+    return true;
+}
+
+// Many threads on one OnnxClip: every call must match the same call made alone
+bool test_concurrent_calls() {
+    std::cout << "=== Running test: ConcurrentCalls ===" << std::endl;
+    const int thread_count = 8;
+    const int iterations = 20;
+    auto clip = load_clip("tiny_clip", 3);
+
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < 6; ++i) {
+        images.push_back(random_image(210 + 29 * i, 330 - 21 * i, 200 + i));
+    }
+    const std::vector<std::string> prompts = {"a cat", "a photo of a dog in the snow", "x", "two birds on a wire",
+                                              "a diagram of the water cycle with clouds rain and rivers", "snow"};
+
+    // Calls differ in which inputs they take and how many, so batches differ in size
+    struct Call {
+        std::vector<cv::Mat>        images;
+        std::vector<std::string>    texts;
+        std::vector<float>          image_expected;
+        std::vector<float>          text_expected;
+        cv::Mat                     bucketed_expected;
+    };
+    std::vector<Call> calls;
+    for (size_t first = 0; first < 3; ++first) {
+        for (size_t rows = 1; rows <= 4; ++rows) {
+            Call call;
+            call.images.assign(images.begin() + first, images.begin() + first + rows);
+            call.texts.assign(prompts.begin() + first, prompts.begin() + first + rows);
+            call.image_expected.resize(rows * 512);
+            call.text_expected.resize(rows * 512);
+            clip->getImageEmbeddings(call.images, call.image_expected.data());
+            clip->getTextEmbeddings(call.texts, call.text_expected.data());
+            call.bucketed_expected = clip->getTextEmbeddingsBucketed(call.texts);
+            calls.push_back(std::move(call));
+        }
+    }
+
+    std::atomic<int> mismatches {0};
+    std::atomic<int> failures {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<float> out;
+            for (int it = 0; it < iterations; ++it) {
+                const Call& call = calls[(t * 5 + it) % calls.size()];
+                try {
+                    out.resize(call.images.size() * 512);
+                    clip->getImageEmbeddings(call.images, out.data());
+                    if (!all_near(out.data(), call.image_expected)) {
+                        ++mismatches;
+                    }
+                    clip->getTextEmbeddings(call.texts, out.data());
+                    if (!all_near(out.data(), call.text_expected)) {
+                        ++mismatches;
+                    }
+                    cv::Mat bucketed = clip->getTextEmbeddingsBucketed(call.texts);
+                    if (cv::norm(bucketed, call.bucketed_expected, cv::NORM_INF) > 1e-3) {
+                        ++mismatches;
+                    }
+                } catch (const std::exception&) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (failures != 0 || mismatches != 0) {
+        std::cerr << "Error: " << failures << " concurrent calls threw, " << mismatches
+                  << " differ from the same call made alone." << std::endl;
+        return false;
+    }
+
+    std::cout << thread_count << " threads x " << iterations * 3 << " calls matched single-threaded results."
+              << std::endl;
+    return true;
+}
+
+bool test_tiles() {
+    std::cout << "=== Running test: Tiles ===" << std::endl;
+    auto clip = load_clip("tiny_clip", 4);
+    cv::Mat image = random_image(450, 680, 7);
+
+    // Six tiles run 4 + 2 at batch_size 4, each row from its own tile
+    std::vector<cv::Rect2d> tiles, expected_tiles;
+    cv::Mat result = clip->getImageEmbeddings(image, CLIPpreprocessor::Tiling::grid(3, 2), tiles);
+    Tensor pixels = CLIPpreprocessor::encode_tiles(image, CLIPpreprocessor::Tiling::grid(3, 2), expected_tiles);
+    if (result.rows != 6 || tiles.size() != 6) {
+        std::cerr << "Error: Expected 6 tile embeddings, got " << result.rows << std::endl;
+        return false;
+    }
+    const size_t plane = CLIPpreprocessor::CLIP_INPUT_SIZE * CLIPpreprocessor::CLIP_INPUT_SIZE;
+    for (int i = 0; i < 6; ++i) {
+        const float* slot = pixels[i].data();
+        double mean = std::accumulate(slot, slot + plane, 0.0) / plane;
+        if (!near(result.at<float>(i, IMAGE_MEAN), mean) || result.at<float>(i, IMAGE_ROWS) != (i < 4 ? 4.0f : 2.0f)) {
+            std::cerr << "Error: Tile " << i << " has the wrong embedding or batch." << std::endl;
+            return false;
+        }
+    }
+
+    try {
+        clip->getImageEmbeddings(image, CLIPpreprocessor::Tiling::grid(0, 2), tiles);
+        std::cerr << "Error: An empty grid was run." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    std::cout << "Tiles run in batches of batch_size." << std::endl;
+    return true;
+}
+
+bool test_batch_scheduler() {
+    std::cout << "=== Running test: BatchScheduler ===" << std::endl;
+    const size_t slot_size = 3 * CLIPpreprocessor::CLIP_INPUT_SIZE * CLIPpreprocessor::CLIP_INPUT_SIZE;
+
+    // Stand-in model: embedding = first value of each channel plane and the batch size
+    std::vector<float> pixels;
+    auto runner = [&](const std::vector<cv::Mat>& images, float* out) {
+        if (std::any_of(images.begin(), images.end(), [](const cv::Mat& m) { return m.rows == 13; })) {
+            throw std::runtime_error("bad batch");
+        }
+        pixels.resize(images.size() * slot_size);
+        std::vector<std::string> errors = CLIPpreprocessor::encode_batch(images, pixels.data());
+        for (size_t i = 0; i < images.size(); ++i) {
+            for (size_t c = 0; c < 3; ++c) {
+                out[i * 4 + c] = pixels[i * slot_size + c * slot_size / 3];
+            }
+            out[i * 4 + 3] = static_cast<float>(images.size());
+        }
+        return errors;
+    };
+
+    BatchScheduler<cv::Mat>::Config config;
+    config.max_batch_size = 4;
+    config.max_delay = std::chrono::milliseconds(20);
+    BatchScheduler<cv::Mat> scheduler(4, runner, config);
+
+    // 4 threads submit 3 distinct images each
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < 12; ++i) {
+        images.push_back(cv::Mat(100 + i, 120, CV_8UC3, cv::Scalar(i * 20, 255 - i * 20, i * 5)));
+    }
+    std::vector<std::future<std::vector<float>>> results(images.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < images.size(); i += 4) {
+                results[i] = scheduler.submit(images[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        std::vector<float> embedding = results[i].get();
+        Tensor single = CLIPpreprocessor::encode_image(images[i]);
+        if (embedding.size() != 4 || embedding[3] < 1.0f || embedding[3] > 4.0f) {
+            std::cerr << "Error: Request " << i << " ran in a batch of " << embedding[3] << std::endl;
+            return false;
+        }
+        for (size_t c = 0; c < 3; ++c) {
+            if (embedding[c] != single.data()[c * slot_size / 3]) {
+                std::cerr << "Error: Request " << i << " got another request's row." << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // A failing run fails every request of its batch, and only those
+    auto bad = scheduler.submit(cv::Mat(13, 13, CV_8UC3, cv::Scalar::all(0)));
+    try {
+        bad.get();
+        std::cerr << "Error: The runner's exception was not propagated." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+    if (scheduler.submit(images[0]).get().size() != 4) {
+        std::cerr << "Error: Scheduler stopped after a failed batch." << std::endl;
+        return false;
+    }
+
+    // An input the runner reports as failed fails its own request only
+    auto unusable = scheduler.submit(cv::Mat());
+    auto usable = scheduler.submit(images[2]);
+    try {
+        unusable.get();
+        std::cerr << "Error: The runner's per-input error was not propagated." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+    if (usable.get().size() != 4) {
+        std::cerr << "Error: A per-input error failed another request." << std::endl;
+        return false;
+    }
+
+    // A lone request is flushed by the delay, not held for a full batch
+    auto start = std::chrono::steady_clock::now();
+    scheduler.submit(images[1]).get();
+    double waited_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = scheduler.stats();
+    if (stats.requests != 17 || stats.rows != 17 || stats.failed_batches != 1 || stats.failed_requests != 2 ||
+        stats.queue_depth != 0 || stats.batches < 7 || stats.peak_queue_depth == 0 || waited_ms < 15.0 ||
+        stats.batch_fill(config.max_batch_size) <= 0.0 || stats.batch_fill(config.max_batch_size) > 1.0) {
+        std::cerr << "Error: Unexpected scheduler stats." << std::endl;
+        return false;
+    }
+
+    std::cout << stats.batches << " batches, fill " << stats.batch_fill(config.max_batch_size)
+              << ", peak depth " << stats.peak_queue_depth << ", mean wait " << stats.mean_wait_us() << " us" << std::endl;
+    return true;
+}
+
+bool test_object_pool() {
+    std::cout << "=== Running test: ObjectPool ===" << std::endl;
+    struct Slot {
+        std::atomic<int>    owner {-1};
+    };
+    ObjectPool<Slot> pool;
+
+    // Leases are exclusive: nobody else sees a slot while it is held
+    const int thread_count = 8;
+    std::atomic<int> overlaps {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int it = 0; it < 2000; ++it) {
+                auto slot = pool.acquire();
+                if (slot->owner.exchange(t) != -1) {
+                    ++overlaps;
+                }
+                std::this_thread::yield();
+                if (slot->owner.exchange(-1) != t) {
+                    ++overlaps;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (overlaps != 0 || pool.created() == 0 || pool.created() > thread_count) {
+        std::cerr << "Error: " << overlaps << " shared leases, " << pool.created() << " slots." << std::endl;
+        return false;
+    }
+
+    // A fresh pool makes exactly as many objects as were ever held at once
+    ObjectPool<Slot> counted;
+    const int peak = 5;
+    std::barrier all_held(peak);
+    threads.clear();
+    for (int t = 0; t < peak; ++t) {
+        threads.emplace_back([&]() {
+            auto slot = counted.acquire();
+            all_held.arrive_and_wait();     // every lease is out here
+            all_held.arrive_and_wait();     // and stays out until all checked in
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    size_t at_peak = counted.created();
+    for (int it = 0; it < 100; ++it) {
+        auto a = counted.acquire();
+        auto b = counted.acquire();
+    }
+    if (at_peak != peak || counted.created() != peak) {
+        std::cerr << "Error: " << at_peak << " then " << counted.created() << " objects for "
+                  << peak << " concurrent leases." << std::endl;
+        return false;
+    }
+
+    // Holding one more than ever before grows the pool by one
+    {
+        std::vector<ObjectPool<Slot>::Lease> held;
+        for (int i = 0; i <= peak; ++i) {
+            held.push_back(counted.acquire());
+        }
+    }
+    if (counted.created() != peak + 1) {
+        std::cerr << "Error: Expected " << peak + 1 << " objects, got " << counted.created() << std::endl;
+        return false;
+    }
+
+    std::cout << thread_count << " threads never shared a lease, " << counted.created()
+              << " objects for a peak of " << peak + 1 << std::endl;
+    return true;
+}
+
+// Many threads on the state a shared OnnxClip uses besides its sessions:
+// one preprocessing pool, one pixel cache and pooled per-call scratch
+bool test_concurrent_stress() {
+    std::cout << "=== Running test: ConcurrentStress ===" << std::endl;
+    const std::string directory = "pixel_cache_stress";
+    const size_t slot_size = 3 * CLIPpreprocessor::CLIP_INPUT_SIZE * CLIPpreprocessor::CLIP_INPUT_SIZE;
+    const int thread_count = 8;
+    std::filesystem::remove_all(directory);
+
+    std::vector<cv::Mat> images;
+    std::vector<std::vector<uint8_t>> encoded(6);
+    std::vector<Tensor> expected, expected_bytes;
+    for (int i = 0; i < 6; ++i) {
+        images.push_back(cv::Mat(200 + 37 * i, 300 - 23 * i, CV_8UC3));
+        cv::randu(images.back(), cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::imencode(".jpg", images.back(), encoded[i]);
+        expected.push_back(CLIPpreprocessor::encode_image(images[i]));
+        expected_bytes.push_back(CLIPpreprocessor::encode_image_bytes(encoded[i]));
+    }
+
+    struct Scratch {
+        std::vector<float>  input;
+    };
+    ObjectPool<Scratch> scratch_pool;
+    ThreadPool pool(3);
+    PixelCache cache(directory);
+    std::atomic<int> mismatches {0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int it = 0; it < 20; ++it) {
+                auto scratch = scratch_pool.acquire();
+
+                // A batch of 1 to 3 images, rotating through the set
+                size_t first = (t + it) % 4;
+                size_t rows = 1 + (t + it) % 3;
+                scratch->input.resize(std::max(scratch->input.size(), rows * slot_size));
+                CLIPpreprocessor::encode_batch(std::span<const cv::Mat>(images.data() + first, rows),
+                                               scratch->input.data(), pool);
+                for (size_t i = 0; i < rows; ++i) {
+                    const float* slot = scratch->input.data() + i * slot_size;
+                    if (!std::equal(slot, slot + slot_size, expected[first + i].data())) {
+                        ++mismatches;
+                    }
+                }
+
+                size_t k = (t * 7 + it) % encoded.size();
+                if (!equal(CLIPpreprocessor::encode_image_bytes(encoded[k], &cache), expected_bytes[k])) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    PixelCache::Stats stats = cache.stats();
+    std::filesystem::remove_all(directory);
+    if (mismatches != 0) {
+        std::cerr << "Error: " << mismatches << " concurrent encodings differ." << std::endl;
+        return false;
+    }
+    if (scratch_pool.created() == 0 || scratch_pool.created() > thread_count ||
+        stats.entries != encoded.size() || stats.hits + stats.misses != thread_count * 20) {
+        std::cerr << "Error: Unexpected scratch or cache counts." << std::endl;
+        return false;
+    }
+
+    std::cout << thread_count << " threads consistent with " << scratch_pool.created()
+              << " scratch sets, cache hit rate " << stats.hit_rate() << std::endl;
+    return true;
+}
+
+bool test_image_embedding_cache() {
+    std::cout << "=== Running test: ImageEmbeddingCache ===" << std::endl;
+    const std::string directory = "image_embedding_cache_test";
+    const size_t dim = 512;
+    std::filesystem::remove_all(directory);
+
+    // Pixel keys see content, shape and model, not the memory layout
+    cv::Mat image(120, 160, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Mat padded(130, 170, CV_8UC3, cv::Scalar::all(7));
+    image.copyTo(padded(cv::Rect(5, 5, 160, 120)));
+    cv::Mat view = padded(cv::Rect(5, 5, 160, 120));
+    cv::Mat reshaped(160, 120, CV_8UC3, image.data);
+    auto key = ImageEmbeddingCache::key("ViT-B/32", image);
+    if (view.isContinuous() || !(ImageEmbeddingCache::key("ViT-B/32", view) == key) ||
+        ImageEmbeddingCache::key("ViT-B/32", reshaped) == key || ImageEmbeddingCache::key("RN50", image) == key) {
+        std::cerr << "Error: Unexpected pixel keys." << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> encoded;
+    cv::imencode(".jpg", image, encoded);
+    if (ImageEmbeddingCache::key("ViT-B/32", encoded) == ImageEmbeddingCache::key("RN50", encoded)) {
+        std::cerr << "Error: Byte keys ignore the model." << std::endl;
+        return false;
+    }
+
+    std::vector<ImageEmbeddingCache::Key> keys;
+    std::vector<float> embedding(dim), out(dim);
+    for (int i = 0; i < 200; ++i) {
+        std::vector<uint8_t> bytes(64, static_cast<uint8_t>(i));
+        keys.push_back(ImageEmbeddingCache::key("ViT-B/32", bytes));
+    }
+
+    {
+        // 256 KB of memory keeps about a hundred entries; the disk keeps all
+        ImageEmbeddingCache::Config config;
+        config.max_bytes = 256 << 10;
+        config.directory = directory;
+        ImageEmbeddingCache cache(dim, config);
+        for (int i = 0; i < 200; ++i) {
+            std::fill(embedding.begin(), embedding.end(), static_cast<float>(i));
+            cache.insert(keys[i], embedding.data());
+        }
+        bool newest = cache.lookup(keys[199], out.data()) && out[0] == 199.0f;
+        bool oldest = cache.lookup(keys[0], out.data()) && out[dim - 1] == 0.0f;
+        auto stats = cache.stats();
+        if (!newest || !oldest || stats.memory_hits != 1 || stats.disk_hits != 1 || stats.evictions == 0 ||
+            stats.bytes > config.max_bytes || stats.disk_entries != 200 || cache.lookup(key, out.data())) {
+            std::cerr << "Error: Memory and disk tiers disagree." << std::endl;
+            return false;
+        }
+    }
+
+    // A torn record is dropped on reopen; memory-less caches serve from disk
+    {
+        std::ofstream torn(directory + "/embeddings.bin", std::ios::binary | std::ios::app);
+        torn.write("torn", 4);
+    }
+    {
+        ImageEmbeddingCache::Config config;
+        config.max_bytes = 0;
+        config.directory = directory;
+        ImageEmbeddingCache cache(dim, config);
+        bool found = cache.lookup(keys[123], out.data()) && out[17] == 123.0f;
+        auto stats = cache.stats();
+        if (!found || stats.disk_entries != 200 || stats.disk_hits != 1 || stats.entries != 0 ||
+            stats.hit_rate() != 1.0) {
+            std::cerr << "Error: Reopened disk tier lost entries." << std::endl;
+            return false;
+        }
+    }
+
+    // A failed disk write switches the disk tier off instead of failing the insert
+    {
+        ImageEmbeddingCache::Config config;
+        config.directory = directory;
+        ImageEmbeddingCache cache(dim, config);
+        std::vector<float> embedding(dim, 7.0f);
+        const ImageEmbeddingCache::Key fresh[2] = {{1, 1}, {2, 2}};
+
+        // Past the file size limit writes fail with EFBIG rather than SIGXFSZ
+        struct rlimit old_limit;
+        ::getrlimit(RLIMIT_FSIZE, &old_limit);
+        struct rlimit limit = {static_cast<rlim_t>(std::filesystem::file_size(directory + "/embeddings.bin")),
+                               old_limit.rlim_max};
+        auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+        bool threw = false;
+        try {
+            cache.insert(fresh[0], embedding.data());
+            cache.insert(fresh[1], embedding.data());
+        } catch (...) {
+            threw = true;
+        }
+        ::setrlimit(RLIMIT_FSIZE, &old_limit);
+        std::signal(SIGXFSZ, old_handler);
+
+        auto stats = cache.stats();
+        bool in_memory = cache.lookup(fresh[1], out.data()) && out[0] == 7.0f;
+        if (threw || !in_memory || stats.disk_errors != 1 || stats.disk_entries != 200) {
+            std::cerr << "Error: A failed disk write was not contained." << std::endl;
+            return false;
+        }
+    }
+    {
+        ImageEmbeddingCache::Config config;
+        config.directory = directory;
+        ImageEmbeddingCache cache(dim, config);
+        if (cache.stats().disk_entries != 200 || cache.lookup({1, 1}, out.data())) {
+            std::cerr << "Error: Disk tier is inconsistent after a failed write." << std::endl;
+            return false;
+        }
+    }
+
+    try {
+        ImageEmbeddingCache::Config config;
+        config.directory = directory;
+        ImageEmbeddingCache other(1024, config);
+        std::cerr << "Error: A disk tier of another dimension was accepted." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::filesystem::remove_all(directory);
+    std::cout << "Image embedding cache serves memory and disk hits." << std::endl;
+    return true;
+}
+
+int main() {
+    int passed = 0;
+    int failed = 0;
+
+    auto run_test = [&](bool (*test_func)(), const std::string& name) {
+        bool result = false;
+        try {
+            result = test_func();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << name << " threw: " << e.what() << std::endl;
+        }
+        if (result) {
+            std::cout << "+++ PASSED +++\n" << std::endl;
+            passed++;
+        } else {
+            std::cout << "--- FAILED ---\n" << std::endl;
+            failed++;
+        }
+    };
+
+    run_test(test_load_models, "LoadModels");
+    run_test(test_image_embeddings, "ImageEmbeddings");
+    run_test(test_image_failures, "ImageFailures");
+    run_test(test_bound_matches_run, "BoundMatchesRun");
+    run_test(test_tiles, "Tiles");
+    run_test(test_text_embeddings, "TextEmbeddings");
+    run_test(test_text_deduplication, "TextDeduplication");
+    run_test(test_bucketed_text, "BucketedText");
+    run_test(test_batch_scheduler, "BatchScheduler");
+    run_test(test_object_pool, "ObjectPool");
+    run_test(test_scheduler, "Scheduler");
+    run_test(test_concurrent_stress, "ConcurrentStress");
+    run_test(test_concurrent_calls, "ConcurrentCalls");
+    run_test(test_image_embedding_cache, "ImageEmbeddingCache");
+
+    std::cout << "Test Summary:" << std::endl;
+    std::cout << "Passed: " << passed << std::endl;
+    std::cout << "Failed: " << failed << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
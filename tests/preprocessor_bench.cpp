@@ -0,0 +1,253 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include "../src/inference/preprocessor.hpp"
+#include "../src/inference/image_kernels.hpp"
+#include "../src/inference/npy.hpp"
+
+/**
+ * Image preprocessing accuracy and latency benchmark.
+ *
+ * Usage: ./preprocessor_bench [--image <jpg>] [--reference <npy>] [--iterations <n>]
+ *                             [--output <json>] [--dump <npy>]
+ *
+ * The reference is the [1, 3, 224, 224] tensor the Python CLIP preprocessing
+ * gives for the image, as saved by np.save. Both the full-size decode path
+ * (encode_image) and the scaled decode path (encode_image_bytes) are compared
+ * with it per channel. Each stage of the pipeline is then timed on its own:
+ * decode, resize + centre crop, and the fused float conversion / normalize /
+ * CHW layout pass. For scale, the same three steps are also timed as separate
+ * passes over a float buffer, the way a straightforward port would run them.
+ *
+ * Results go to stdout, or --output, as one JSON object; --dump writes the
+ * encode_image tensor as .npy for inspection in Python.
+ */
+
+struct ChannelError {
+    double  max_abs {0.0};
+    double  mean_abs {0.0};
+};
+
+struct Timing {
+    double  median_us {0.0};
+    double  p90_us {0.0};
+    double  mean_us {0.0};
+};
+
+static std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error opening " + path);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::vector<ChannelError> compare(const Tensor& actual, const NpyArray& reference) {
+    if (actual.shape() != reference.shape()) {
+        throw std::runtime_error("Reference shape does not match the [1, 3, 224, 224] output");
+    }
+
+    const size_t plane = CLIPpreprocessor::CLIP_INPUT_SIZE * CLIPpreprocessor::CLIP_INPUT_SIZE;
+    std::vector<ChannelError> errors(3);
+    for (size_t c = 0; c < 3; ++c) {
+        const float* a = actual.data() + c * plane;
+        const float* b = reference.data() + c * plane;
+        double total = 0.0;
+        for (size_t i = 0; i < plane; ++i) {
+            double error = std::abs(static_cast<double>(a[i]) - b[i]);
+            errors[c].max_abs = std::max(errors[c].max_abs, error);
+            total += error;
+        }
+        errors[c].mean_abs = total / plane;
+    }
+    return errors;
+}
+
+static Timing time(int iterations, const std::function<void()>& op) {
+    op();  // warm-up: plan cache, thread-local buffers, page faults
+
+    std::vector<double> latencies_us;
+    latencies_us.reserve(iterations);
+    for (int it = 0; it < iterations; ++it) {
+        auto start = std::chrono::steady_clock::now();
+        op();
+        latencies_us.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    Timing timing;
+    for (double latency : latencies_us) {
+        timing.mean_us += latency / iterations;
+    }
+    std::sort(latencies_us.begin(), latencies_us.end());
+    timing.median_us = latencies_us[latencies_us.size() / 2];
+    timing.p90_us = latencies_us[std::min(latencies_us.size() - 1, latencies_us.size() * 9 / 10)];
+    return timing;
+}
+
+static std::string to_json(const std::vector<ChannelError>& errors) {
+    std::ostringstream json;
+    json << std::setprecision(6) << "[";
+    for (size_t c = 0; c < errors.size(); ++c) {
+        json << (c ? ", " : "") << "{\"max_abs\": " << errors[c].max_abs
+             << ", \"mean_abs\": " << errors[c].mean_abs << "}";
+    }
+    json << "]";
+    return json.str();
+}
+
+static std::string to_json(const Timing& timing) {
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(2) << "{\"median_us\": " << timing.median_us
+         << ", \"p90_us\": " << timing.p90_us << ", \"mean_us\": " << timing.mean_us << "}";
+    return json.str();
+}
+
+// Quoted JSON string; bytes >= 0x80 pass through, so UTF-8 stays UTF-8
+static std::string to_json(const std::string& text) {
+    std::ostringstream json;
+    json << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            json << '\\' << c;
+        } else if (c < 0x20) {
+            json << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        } else {
+            json << c;
+        }
+    }
+    json << '"';
+    return json.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string image_path = "../assets/franz-kafka.jpg";
+    std::string reference_path = "../assets/expected_preprocessed_image.npy";
+    std::string output_path;
+    std::string dump_path;
+    int iterations = 50;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--image") image_path = argv[i + 1];
+        else if (flag == "--reference") reference_path = argv[i + 1];
+        else if (flag == "--iterations") iterations = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--output") output_path = argv[i + 1];
+        else if (flag == "--dump") dump_path = argv[i + 1];
+        else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        const int size = CLIPpreprocessor::CLIP_INPUT_SIZE;
+        std::vector<uint8_t> bytes = read_file(image_path);
+        NpyArray reference = NpyArray::load(reference_path);
+
+        // Accuracy of both decode paths against the Python reference
+        cv::Mat buffer(1, static_cast<int>(bytes.size()), CV_8UC1, bytes.data());
+        cv::Mat image = cv::imdecode(buffer, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            throw std::runtime_error("Could not decode " + image_path);
+        }
+        Tensor full = CLIPpreprocessor::encode_image(image);
+        Tensor scaled = CLIPpreprocessor::encode_image_bytes(bytes);
+        if (!dump_path.empty()) {
+            NpyArray::save(dump_path, full.view());
+        }
+
+        // Stage by stage, on the intermediate results of the real pipeline
+        auto plan = CLIPpreprocessor::resize_plan(image.cols, image.rows, image.channels());
+        cv::Mat crop(size, size, CV_8UC3);
+        Tensor output({1, 3, size, size});
+        const float* mean = CLIPpreprocessor::NORM_MEAN.data();
+        const float* std_dev = CLIPpreprocessor::NORM_STD.data();
+
+        Timing decode = time(iterations, [&]() { cv::imdecode(buffer, cv::IMREAD_COLOR); });
+        Timing decode_scaled = time(iterations, [&]() { CLIPpreprocessor::decode_image(bytes); });
+        Timing resize = time(iterations, [&]() {
+            plan->apply(image.data, image.step, crop.data, crop.step);
+        });
+        Timing normalize = time(iterations, [&]() {
+            ImageKernels::normalize_to_chw(crop.data, crop.step, size, size, true, mean, std_dev, output.data());
+        });
+
+        // The fused pass split into three, each a full sweep over the crop
+        std::vector<float> hwc(3 * size * size);
+        Timing split_convert = time(iterations, [&]() {
+            for (int y = 0; y < size; ++y) {
+                const uint8_t* row = crop.ptr<uint8_t>(y);
+                for (int i = 0; i < 3 * size; ++i) {
+                    hwc[y * 3 * size + i] = row[i] / 255.0f;
+                }
+            }
+        });
+        Timing split_normalize = time(iterations, [&]() {
+            for (size_t i = 0; i < hwc.size(); ++i) {
+                int c = 2 - static_cast<int>(i % 3);  // BGR pixels, RGB statistics
+                hwc[i] = (hwc[i] - mean[c]) / std_dev[c];
+            }
+        });
+        Timing split_layout = time(iterations, [&]() {
+            float* out = output.data();
+            for (int c = 0; c < 3; ++c) {
+                for (int i = 0; i < size * size; ++i) {
+                    *out++ = hwc[3 * i + 2 - c];
+                }
+            }
+        });
+
+        Timing encode = time(iterations, [&]() { CLIPpreprocessor::encode_image(image, output.data()); });
+        Timing encode_bytes = time(iterations, [&]() { CLIPpreprocessor::encode_image_bytes(bytes); });
+
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"image\": " << to_json(image_path) << ",\n"
+             << "  \"width\": " << image.cols << ",\n"
+             << "  \"height\": " << image.rows << ",\n"
+             << "  \"isa\": \"" << ImageKernels::isa() << "\",\n"
+             << "  \"iterations\": " << iterations << ",\n"
+             << "  \"accuracy\": {\n"
+             << "    \"encode_image\": " << to_json(compare(full, reference)) << ",\n"
+             << "    \"encode_image_bytes\": " << to_json(compare(scaled, reference)) << "\n"
+             << "  },\n"
+             << "  \"stages\": {\n"
+             << "    \"decode\": " << to_json(decode) << ",\n"
+             << "    \"decode_scaled\": " << to_json(decode_scaled) << ",\n"
+             << "    \"resize\": " << to_json(resize) << ",\n"
+             << "    \"convert_normalize_layout\": " << to_json(normalize) << "\n"
+             << "  },\n"
+             << "  \"split_stages\": {\n"
+             << "    \"float_conversion\": " << to_json(split_convert) << ",\n"
+             << "    \"normalize\": " << to_json(split_normalize) << ",\n"
+             << "    \"layout\": " << to_json(split_layout) << "\n"
+             << "  },\n"
+             << "  \"end_to_end\": {\n"
+             << "    \"encode_image\": " << to_json(encode) << ",\n"
+             << "    \"encode_image_bytes\": " << to_json(encode_bytes) << "\n"
+             << "  }\n"
+             << "}\n";
+
+        if (output_path.empty()) {
+            std::cout << json.str();
+        } else {
+            std::ofstream file(output_path);
+            if (!(file << json.str())) {
+                throw std::runtime_error("Error writing " + output_path);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
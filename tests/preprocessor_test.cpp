@@ -1,14 +1,22 @@
 #include "../src/inference/preprocessor.hpp"
+#include "../src/inference/image_kernels.hpp"
+#include "../src/inference/npy.hpp"
+#include "../src/inference/pixel_cache.hpp"
+#include <filesystem>
 #include <opencv2/opencv.hpp>
-#include <torch/torch.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <sys/resource.h>
 
 using namespace std;
 using namespace cv;
 
 // Forward declarations
-torch::Tensor load_tensor_from_txt(const std::string& file_path);  // Declare before use
 bool checkMatRange(const cv::Mat& mat, float min_val, float max_val);
 cv::Mat load_image(const std::string& filepath);
 
@@ -23,41 +31,21 @@ bool checkMatRange(const cv::Mat& mat, float min_val, float max_val) {
     return (minVal >= min_val && maxVal <= max_val);
 }
 
-// Fixed tensor loading function
-torch::Tensor load_tensor_from_txt(const std::string& file_path) {
-    std::ifstream file(file_path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + file_path);
-    }
-
-    // Read dimensions
-    int num_dims;
-    file >> num_dims;
-    
-    std::vector<int64_t> dims(num_dims);
-    for (int i = 0; i < num_dims; ++i) {
-        file >> dims[i];
-    }
-
-    // Read flattened data
-    std::vector<float> data;
-    float value;
-    while (file >> value) {
-        data.push_back(value);
-    }
-
-    // Verify data size matches dimensions
-    int64_t expected_size = 1;
-    for (auto dim : dims) {
-        expected_size *= dim;
+// Same shape and |a - b| <= atol + rtol * |b| everywhere, as torch::allclose
+bool allclose(const Tensor& a, const Tensor& b, double rtol, double atol) {
+    if (a.shape() != b.shape()) {
+        return false;
     }
-    
-    if (data.size() != expected_size) {
-        throw std::runtime_error("Data size mismatch in file: " + file_path);
+    for (size_t i = 0; i < a.numel(); ++i) {
+        if (std::abs(a.data()[i] - b.data()[i]) > atol + rtol * std::abs(b.data()[i])) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Create and reshape tensor
-    return torch::from_blob(data.data(), dims, torch::kFloat32).clone();
+bool equal(const Tensor& a, const Tensor& b) {
+    return a.shape() == b.shape() && std::equal(a.begin(), a.end(), b.begin());
 }
 
 cv::Mat load_image(const std::string& filepath) {
@@ -98,10 +86,10 @@ bool test_basic_preprocessing() {
         return false;
     }
 
-    torch::Tensor processed = preprocessor.encode_image(img);
+    Tensor processed = preprocessor.encode_image(img);
 
     // Correct tensor dimension check
-    auto sizes = processed.sizes();
+    const auto& sizes = processed.shape();
     if (sizes.size() != 4 || 
         sizes[0] != 1 || 
         sizes[1] != 3 || 
@@ -120,13 +108,13 @@ bool test_different_input_sizes() {
     CLIPpreprocessor preprocessor;
 
     cv::Mat tall_img(480, 320, CV_8UC3, cv::Scalar(255, 255, 255));
-    torch::Tensor processed_tall = preprocessor.encode_image(tall_img);
+    Tensor processed_tall = preprocessor.encode_image(tall_img);
 
     cv::Mat wide_img(320, 480, CV_8UC3, cv::Scalar(255, 255, 255));
-    torch::Tensor processed_wide = preprocessor.encode_image(wide_img);
+    Tensor processed_wide = preprocessor.encode_image(wide_img);
 
-    // Compare tensor sizes using dimensions()
-    if (processed_tall.sizes() != processed_wide.sizes()) {
+    // Compare tensor sizes
+    if (processed_tall.shape() != processed_wide.shape()) {
         std::cerr << "Error: Output sizes differ." << std::endl;
         return false;
     }
@@ -148,10 +136,10 @@ bool test_matches_original_clip() {
     }
 
     // Process image
-    torch::Tensor processed = preprocessor.encode_image(img);
+    Tensor processed = preprocessor.encode_image(img);
 
     // Verify output dimensions
-    auto sizes = processed.sizes();
+    const auto& sizes = processed.shape();
     if (sizes.size() != 4 || 
         sizes[0] != 1 || 
         sizes[1] != 3 || 
@@ -164,17 +152,17 @@ bool test_matches_original_clip() {
         return false;
     }
 
-    // Load expected values from text file
-    torch::Tensor expected;
+    // Load expected values written by the Python reference
+    Tensor expected;
     try {
-        expected = load_tensor_from_txt(ASSETS_PATH + "expected_preprocessed_image.txt");
+        expected = NpyArray::load(ASSETS_PATH + "expected_preprocessed_image.npy").to_tensor();
     } catch (const std::exception& e) {
         std::cerr << "Error loading expected values: " << e.what() << std::endl;
         return false;
     }
 
     // Verify numerical similarity
-    if (!torch::allclose(processed, expected, 1e-5, 1e-6)) {
+    if (!allclose(processed, expected, 1e-5, 1e-6)) {
         std::cerr << "Error: Processed values do not match expected values." << std::endl;
         return false;
     }
@@ -193,22 +181,19 @@ bool test_normalization() {
         return false;
     }
 
-    torch::Tensor processed = preprocessor.encode_image(img);
+    Tensor processed = preprocessor.encode_image(img);
 
-    // Convert tensor to cv::Mat
-    processed = processed.squeeze(0); 
-    
     // Split into channels
     std::vector<cv::Mat> channels;
     for (int i = 0; i < 3; ++i) {
-        torch::Tensor channel_tensor = processed[i];
+        TensorView channel_tensor = processed[0][i];
         
         // Create cv::Mat from tensor data
         cv::Mat channel(
             CLIPpreprocessor::CLIP_INPUT_SIZE,
             CLIPpreprocessor::CLIP_INPUT_SIZE,
             CV_32FC1,
-            channel_tensor.data_ptr<float>()
+            channel_tensor.data()
         );
         
         // Clone to maintain data ownership
@@ -237,11 +222,10 @@ bool test_output_range() {
         return false;
     }
 
-    torch::Tensor processed = preprocessor.encode_image(img);
+    Tensor processed = preprocessor.encode_image(img);
 
     // Convert tensor to cv::Mat
-    processed = processed.contiguous().to(torch::kCPU);
-    cv::Mat mat(1, processed.numel(), CV_32FC1, processed.data_ptr<float>());
+    cv::Mat mat(1, static_cast<int>(processed.numel()), CV_32FC1, processed.data());
 
     if (!checkMatRange(mat, -5.0f, 5.0f)) {
         std::cerr << "Error: Output range is incorrect." << std::endl;
@@ -252,6 +236,484 @@ bool test_output_range() {
     return true;
 }
 
+bool test_resize_tolerance() {
+    std::cout << "=== Running test: ResizeTolerance ===" << std::endl;
+    CLIPpreprocessor preprocessor;
+    cv::Mat img = load_image(ASSETS_PATH + "franz-kafka.jpg");
+    if (img.empty()) {
+        std::cerr << "Error: Could not load test image." << std::endl;
+        return false;
+    }
+
+    Tensor processed = preprocessor.encode_image(img);
+    NpyArray reference = NpyArray::load(ASSETS_PATH + "expected_preprocessed_image.npy");
+    if (reference.shape() != processed.shape()) {
+        std::cerr << "Error: Reference has " << reference.numel() << " values." << std::endl;
+        return false;
+    }
+    const float* expected = reference.data();
+
+    // The 8-bit resize follows Pillow's fixed-point arithmetic, so outputs may
+    // differ from the reference by at most one uint8 step after normalisation
+    // (1 / (255 * min std) ~= 0.0146), e.g. from a different JPEG decoder
+    const float max_tolerance = 1.0f / (255.0f * 0.26130258f) + 1e-5f;
+    const double mean_tolerance = 1e-3;
+    const float* actual = processed.data();
+    float max_error = 0.0f;
+    double total_error = 0.0;
+    for (size_t i = 0; i < reference.numel(); ++i) {
+        float error = std::abs(actual[i] - expected[i]);
+        max_error = std::max(max_error, error);
+        total_error += error;
+    }
+    double mean_error = total_error / reference.numel();
+    std::cout << "Max abs error " << max_error << ", mean abs error " << mean_error << std::endl;
+
+    if (max_error > max_tolerance || mean_error > mean_tolerance) {
+        std::cerr << "Error: Resize drifted from the reference." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool test_encode_image_bytes() {
+    std::cout << "=== Running test: EncodeImageBytes ===" << std::endl;
+    CLIPpreprocessor preprocessor;
+
+    // 1800 / 8 rounds up to 225, so the 1/8 scale still covers the input size
+    cv::Mat large(1800, 2000, CV_8UC3);
+    cv::randu(large, cv::Scalar::all(0), cv::Scalar::all(255));
+    std::vector<uint8_t> encoded;
+    cv::imencode(".jpg", large, encoded);
+    cv::Mat reduced = preprocessor.decode_image(encoded);
+    if (reduced.cols != 250 || reduced.rows != 225) {
+        std::cerr << "Error: Expected a 250x225 decode, got " << reduced.cols << "x" << reduced.rows << std::endl;
+        return false;
+    }
+
+    // 450x655 only allows 1/2; the result stays close to a full decode
+    std::ifstream file(ASSETS_PATH + "franz-kafka.jpg", std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Tensor scaled = preprocessor.encode_image_bytes(bytes);
+    Tensor full = preprocessor.encode_image(load_image(ASSETS_PATH + "franz-kafka.jpg"));
+    double mean_error = 0.0;
+    for (size_t i = 0; i < full.numel(); ++i) {
+        mean_error += std::abs(scaled.data()[i] - full.data()[i]);
+    }
+    mean_error /= full.numel();
+    std::cout << "Mean abs difference to a full decode: " << mean_error << std::endl;
+    if (mean_error > 0.05) {
+        std::cerr << "Error: Scaled decode drifted too far from the full decode." << std::endl;
+        return false;
+    }
+
+    // Bytes that are not an image are rejected
+    std::vector<uint8_t> garbage = {0xFF, 0xD8, 0xFF, 0x00, 0x01};
+    try {
+        preprocessor.encode_image_bytes(garbage);
+        std::cerr << "Error: Garbage bytes were accepted." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    std::cout << "Scaled decode handled correctly." << std::endl;
+    return true;
+}
+
+bool test_input_types() {
+    std::cout << "=== Running test: InputTypes ===" << std::endl;
+    CLIPpreprocessor preprocessor;
+
+    // Only 8-bit images are accepted; their range needs no checking
+    cv::Mat float_img(64, 64, CV_32FC3, cv::Scalar(0.5, 0.5, 0.5));
+    try {
+        preprocessor.encode_image(float_img);
+        std::cerr << "Error: Float image was accepted." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    // Grayscale input is expanded to three equal channels
+    cv::Mat gray_img(300, 260, CV_8UC1, cv::Scalar(128));
+    cv::Mat bgr_img(300, 260, CV_8UC3, cv::Scalar(128, 128, 128));
+    if (!equal(preprocessor.encode_image(gray_img), preprocessor.encode_image(bgr_img))) {
+        std::cerr << "Error: Grayscale and BGR inputs differ." << std::endl;
+        return false;
+    }
+
+    std::cout << "Input types handled correctly." << std::endl;
+    return true;
+}
+
+bool test_channel_order() {
+    std::cout << "=== Running test: ChannelOrder ===" << std::endl;
+    CLIPpreprocessor preprocessor;
+
+    // Pure red in OpenCV's BGR order must land in the first (R) plane
+    cv::Mat red_img(256, 256, CV_8UC3, cv::Scalar(0, 0, 255));
+    Tensor processed = preprocessor.encode_image(red_img);
+
+    for (int c = 0; c < 3; ++c) {
+        float value = c == 0 ? 1.0f : 0.0f;
+        float expected = (value - CLIPpreprocessor::NORM_MEAN[c]) / CLIPpreprocessor::NORM_STD[c];
+        float actual = processed.at({0, c, 112, 112});
+        if (std::abs(actual - expected) > 1e-5f) {
+            std::cerr << "Error: Channel " << c << " is " << actual << ", expected " << expected << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Channels are in RGB order." << std::endl;
+    return true;
+}
+
+bool test_encode_batch() {
+    std::cout << "=== Running test: EncodeBatch ===" << std::endl;
+    const size_t slot_size = 3 * CLIPpreprocessor::CLIP_INPUT_SIZE * CLIPpreprocessor::CLIP_INPUT_SIZE;
+
+    std::vector<cv::Mat> images;
+    images.push_back(load_image(ASSETS_PATH + "franz-kafka.jpg"));
+    images.push_back(cv::Mat(64, 64, CV_32FC3, cv::Scalar::all(0.5)));   // rejected type
+    images.push_back(cv::Mat(300, 500, CV_8UC1, cv::Scalar(90)));
+    images.push_back(cv::Mat(640, 480, CV_8UC3));
+    cv::randu(images.back(), cv::Scalar::all(0), cv::Scalar::all(255));
+
+    // Poison the buffer so unwritten slots show up
+    std::vector<float> batch(images.size() * slot_size, -100.0f);
+    ThreadPool pool(3);
+    std::vector<std::string> errors = CLIPpreprocessor::encode_batch(images, batch.data(), pool);
+
+    if (errors.size() != images.size() || errors[1].empty()) {
+        std::cerr << "Error: The bad image was not reported." << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < images.size(); ++i) {
+        const float* slot = batch.data() + i * slot_size;
+        if (i == 1) {
+            if (std::any_of(slot, slot + slot_size, [](float v) { return v != 0.0f; })) {
+                std::cerr << "Error: Slot of the failed image is not zeroed." << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        // Every other slot equals encoding the image on its own
+        Tensor single = CLIPpreprocessor::encode_image(images[i]);
+        if (!errors[i].empty() || !std::equal(slot, slot + slot_size, single.data())) {
+            std::cerr << "Error: Slot " << i << " differs from encode_image. " << errors[i] << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Batch matches single-image encoding; failure reported as: " << errors[1] << std::endl;
+    return true;
+}
+
+bool test_resize_plan() {
+    std::cout << "=== Running test: ResizePlan ===" << std::endl;
+
+    // 1080p to a 398x224 resize, as for a camera frame, and a tall image
+    const int geometries[][4] = {{1920, 1080, 398, 224}, {450, 655, 224, 326}};
+    for (const auto& g : geometries) {
+        int src_w = g[0], src_h = g[1], resized_w = g[2], resized_h = g[3];
+        cv::Mat bgra(src_h, src_w, CV_8UC4);
+        cv::randu(bgra, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::Mat bgr;
+        cv::cvtColor(bgra, bgr, cv::COLOR_BGRA2BGR);
+
+        // The crop of a full resize equals resizing only the crop window
+        int crop_x = (resized_w - 224) / 2, crop_y = (resized_h - 224) / 2;
+        cv::Mat full(resized_h, resized_w, CV_8UC3);
+        ResizePlan(src_w, src_h, 3, resized_w, resized_h, 0, 0, resized_w, resized_h)
+            .apply(bgr.data, bgr.step, full.data, full.step);
+
+        ResizePlan plan(src_w, src_h, 3, resized_w, resized_h, crop_x, crop_y, 224, 224);
+        ResizePlan plan_bgra(src_w, src_h, 4, resized_w, resized_h, crop_x, crop_y, 224, 224);
+        cv::Mat crop(224, 224, CV_8UC3), crop_again(224, 224, CV_8UC3), crop_bgra(224, 224, CV_8UC3);
+        plan.apply(bgr.data, bgr.step, crop.data, crop.step);
+        plan.apply(bgr.data, bgr.step, crop_again.data, crop_again.step);
+        plan_bgra.apply(bgra.data, bgra.step, crop_bgra.data, crop_bgra.step);
+
+        for (int y = 0; y < 224; ++y) {
+            const uint8_t* expected = full.ptr<uint8_t>(crop_y + y) + 3 * crop_x;
+            if (std::memcmp(crop.ptr<uint8_t>(y), expected, 224 * 3) != 0 ||
+                std::memcmp(crop_again.ptr<uint8_t>(y), expected, 224 * 3) != 0 ||
+                std::memcmp(crop_bgra.ptr<uint8_t>(y), expected, 224 * 3) != 0) {
+                std::cerr << "Error: Plan output differs at row " << y << " for " << src_w << "x" << src_h << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // The crop window has to fit the resized image
+    try {
+        ResizePlan(640, 480, 3, 298, 224, 100, 0, 224, 224);
+        std::cerr << "Error: Out-of-bounds crop was accepted." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    std::cout << "Resize plans are consistent (" << ImageKernels::isa() << ")." << std::endl;
+    return true;
+}
+
+bool test_yuv_and_rgba_inputs() {
+    std::cout << "=== Running test: YUV and RGBA inputs ===" << std::endl;
+
+    const int sizes[][2] = {{1280, 720}, {360, 640}};
+    for (const auto& size : sizes) {
+        int width = size[0], height = size[1];
+
+        // One buffer per layout, as a decoder hands them out
+        cv::Mat nv12(height * 3 / 2, width, CV_8UC1), i420(height * 3 / 2, width, CV_8UC1);
+        cv::randu(nv12, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::randu(i420, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::Mat nv12_bgr, i420_bgr;
+        cv::cvtColor(nv12, nv12_bgr, cv::COLOR_YUV2BGR_NV12);
+        cv::cvtColor(i420, i420_bgr, cv::COLOR_YUV2BGR_I420);
+
+        const uint8_t* y = i420.data;
+        const uint8_t* u = y + height * i420.step;
+        const uint8_t* v = u + (height / 2) * (width / 2);
+        Tensor from_nv12 = CLIPpreprocessor::encode_nv12(nv12.data, nv12.step, nv12.data + height * nv12.step,
+                                                         nv12.step, width, height);
+        Tensor from_i420 = CLIPpreprocessor::encode_i420(y, i420.step, u, width / 2, v, width / 2, width, height);
+        if (!equal(from_nv12, CLIPpreprocessor::encode_image(nv12_bgr)) ||
+            !equal(from_i420, CLIPpreprocessor::encode_image(i420_bgr))) {
+            std::cerr << "Error: YUV input differs from its BGR conversion for " << width << "x" << height << std::endl;
+            return false;
+        }
+
+        // Swizzled and alpha inputs give the same tensor as BGR
+        cv::Mat rgb, bgra, rgba;
+        cv::cvtColor(nv12_bgr, rgb, cv::COLOR_BGR2RGB);
+        cv::cvtColor(nv12_bgr, bgra, cv::COLOR_BGR2BGRA);
+        cv::cvtColor(nv12_bgr, rgba, cv::COLOR_BGR2RGBA);
+        if (!equal(CLIPpreprocessor::encode_pixels(rgb, PixelOrder::RGB), from_nv12) ||
+            !equal(CLIPpreprocessor::encode_pixels(bgra, PixelOrder::BGRA), from_nv12) ||
+            !equal(CLIPpreprocessor::encode_pixels(rgba, PixelOrder::RGBA), from_nv12)) {
+            std::cerr << "Error: Channel order changed the result for " << width << "x" << height << std::endl;
+            return false;
+        }
+    }
+
+    // The channel count has to match the order
+    try {
+        CLIPpreprocessor::encode_pixels(cv::Mat(64, 64, CV_8UC3, cv::Scalar::all(0)), PixelOrder::RGBA);
+        std::cerr << "Error: 3-channel image was accepted as RGBA." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    std::cout << "YUV and RGBA inputs match BGR." << std::endl;
+    return true;
+}
+
+bool test_npy_round_trip() {
+    std::cout << "=== Running test: NpyRoundTrip ===" << std::endl;
+
+    // Tensor -> .npy -> mapped view, for the usual and the 1-d shape spellings
+    for (const std::vector<int64_t>& shape : {std::vector<int64_t>{2, 3, 5}, std::vector<int64_t>{7}}) {
+        Tensor tensor(shape);
+        for (size_t i = 0; i < tensor.numel(); ++i) {
+            tensor.data()[i] = 0.25f * static_cast<float>(i) - 1.0f;
+        }
+        std::string path = "npy_round_trip.npy";
+        NpyArray::save(path, tensor.view());
+        NpyArray loaded = NpyArray::load(path);
+        std::remove(path.c_str());
+
+        if (loaded.shape() != shape || !equal(loaded.to_tensor(), tensor)) {
+            std::cerr << "Error: .npy round trip changed the tensor." << std::endl;
+            return false;
+        }
+    }
+
+    // numpy's own file maps to the same shape
+    NpyArray reference = NpyArray::load(ASSETS_PATH + "expected_preprocessed_image.npy");
+    if (reference.shape() != std::vector<int64_t>{1, 3, 224, 224}) {
+        std::cerr << "Error: Reference .npy has the wrong shape." << std::endl;
+        return false;
+    }
+
+    try {
+        NpyArray::load(ASSETS_PATH + "franz-kafka.jpg");
+        std::cerr << "Error: A JPEG was accepted as .npy." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::cout << ".npy files round-trip." << std::endl;
+    return true;
+}
+
+bool test_pixel_cache() {
+    std::cout << "=== Running test: PixelCache ===" << std::endl;
+    const std::string directory = "pixel_cache_test";
+    std::filesystem::remove_all(directory);
+
+    std::ifstream file(ASSETS_PATH + "franz-kafka.jpg", std::ios::binary);
+    std::vector<uint8_t> kafka((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    cv::Mat noise(300, 400, CV_8UC3);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(255));
+    std::vector<uint8_t> random;
+    cv::imencode(".jpg", noise, random);
+    Tensor expected_kafka = CLIPpreprocessor::encode_image_bytes(kafka);
+    Tensor expected_random = CLIPpreprocessor::encode_image_bytes(random);
+
+    {
+        // Miss and store, then hit with the same result
+        PixelCache cache(directory);
+        Tensor miss = CLIPpreprocessor::encode_image_bytes(kafka, &cache);
+        Tensor hit = CLIPpreprocessor::encode_image_bytes(kafka, &cache);
+        PixelCache::Stats stats = cache.stats();
+        if (!equal(miss, expected_kafka) || !equal(hit, expected_kafka) ||
+            stats.hits != 1 || stats.misses != 1 || stats.entries != 1) {
+            std::cerr << "Error: Cached encoding differs or was not reused." << std::endl;
+            return false;
+        }
+    }
+
+    // Simulate an interrupted run: a torn record and a torn index entry
+    {
+        std::ofstream shard(directory + "/pixels.bin", std::ios::binary | std::ios::app);
+        shard << std::string(1000, 'x');
+        std::ofstream index(directory + "/pixels.idx", std::ios::binary | std::ios::app);
+        index << std::string(5, 'x');
+    }
+
+    {
+        // Reopened, the stored image hits and new ones are appended cleanly
+        PixelCache cache(directory);
+        std::vector<std::span<const uint8_t>> images = {kafka, random, random};
+        Tensor batch({3, 3, CLIPpreprocessor::CLIP_INPUT_SIZE, CLIPpreprocessor::CLIP_INPUT_SIZE});
+        std::vector<std::string> errors = CLIPpreprocessor::encode_batch_bytes(images, batch.data(), &cache);
+        PixelCache::Stats stats = cache.stats();
+        if (!std::all_of(errors.begin(), errors.end(), [](const std::string& e) { return e.empty(); }) ||
+            !std::equal(expected_kafka.begin(), expected_kafka.end(), batch[0].begin()) ||
+            !std::equal(expected_random.begin(), expected_random.end(), batch[1].begin()) ||
+            !std::equal(expected_random.begin(), expected_random.end(), batch[2].begin()) ||
+            stats.hits < 1 || stats.entries != 2) {
+            std::cerr << "Error: Reopened cache gave wrong results." << std::endl;
+            return false;
+        }
+    }
+
+    {
+        PixelCache cache(directory);
+        if (!equal(CLIPpreprocessor::encode_image_bytes(random, &cache), expected_random) ||
+            cache.stats().hits != 1) {
+            std::cerr << "Error: Appended record was not found after reopening." << std::endl;
+            return false;
+        }
+    }
+
+    // A failed write turns inserts off instead of failing the image
+    {
+        PixelCache cache(directory);
+        cv::Mat other_noise(200, 300, CV_8UC3);
+        cv::randu(other_noise, cv::Scalar::all(0), cv::Scalar::all(255));
+        std::vector<uint8_t> other;
+        cv::imencode(".png", other_noise, other);
+        Tensor expected_other = CLIPpreprocessor::encode_image_bytes(other);
+
+        // Past the file size limit writes fail with EFBIG rather than SIGXFSZ
+        struct rlimit old_limit;
+        ::getrlimit(RLIMIT_FSIZE, &old_limit);
+        struct rlimit limit = {static_cast<rlim_t>(std::filesystem::file_size(directory + "/pixels.bin")),
+                               old_limit.rlim_max};
+        auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+        bool threw = false;
+        Tensor encoded;
+        try {
+            encoded = CLIPpreprocessor::encode_image_bytes(other, &cache);
+        } catch (...) {
+            threw = true;
+        }
+        ::setrlimit(RLIMIT_FSIZE, &old_limit);
+        std::signal(SIGXFSZ, old_handler);
+
+        // Once off, inserts stay off; stored records are still served
+        CLIPpreprocessor::encode_image_bytes(other, &cache);
+        bool stored_hit = equal(CLIPpreprocessor::encode_image_bytes(kafka, &cache), expected_kafka);
+        PixelCache::Stats stats = cache.stats();
+        if (threw || !equal(encoded, expected_other) || !stored_hit ||
+            stats.write_errors != 1 || stats.inserts != 0 || stats.entries != 2) {
+            std::cerr << "Error: A failed pixel cache write was not contained." << std::endl;
+            return false;
+        }
+    }
+
+    // Records of another size are refused
+    try {
+        PixelCache cache(directory, 256, 256);
+        std::cerr << "Error: Cache with another record size was opened." << std::endl;
+        return false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::filesystem::remove_all(directory);
+    std::cout << "Pixel cache round-trips across runs." << std::endl;
+    return true;
+}
+
+bool test_tiles() {
+    std::cout << "=== Running test: Tiles ===" << std::endl;
+    std::vector<cv::Rect2d> tiles;
+
+    // A 1x1 grid of a square image is the plain encoding
+    cv::Mat square(500, 500, CV_8UC3);
+    cv::randu(square, cv::Scalar::all(0), cv::Scalar::all(255));
+    Tensor single = CLIPpreprocessor::encode_tiles(square, CLIPpreprocessor::Tiling::grid(1, 1), tiles);
+    if (!equal(single, CLIPpreprocessor::encode_image(square)) || tiles.size() != 1) {
+        std::cerr << "Error: 1x1 grid differs from encode_image." << std::endl;
+        return false;
+    }
+
+    // Grid tiles split the source evenly, in row-major order
+    cv::Mat wide(300, 400, CV_8UC3);
+    cv::randu(wide, cv::Scalar::all(0), cv::Scalar::all(255));
+    Tensor grid = CLIPpreprocessor::encode_tiles(wide, CLIPpreprocessor::Tiling::grid(2, 3), tiles);
+    if (grid.shape() != std::vector<int64_t>{6, 3, 224, 224} || tiles.size() != 6 ||
+        tiles[1].x != 200.0 || tiles[1].y != 0.0 || tiles[1].width != 200.0 ||
+        tiles[5].y != 200.0 || tiles[5].height != 100.0) {
+        std::cerr << "Error: Unexpected grid layout." << std::endl;
+        return false;
+    }
+
+    // At the centre crop's scale, the tile at the crop offset is the plain encoding:
+    // a 400x300 image resizes to 298x224, tiles start at 0, 37 and 74
+    Tensor strided = CLIPpreprocessor::encode_tiles(wide, CLIPpreprocessor::Tiling::strided(224, 37), tiles);
+    Tensor centre = CLIPpreprocessor::encode_image(wide);
+    if (strided.size(0) != 3 || tiles.size() != 3 || std::abs(tiles[2].x + tiles[2].width - 400.0) > 1e-9 ||
+        !std::equal(centre.begin(), centre.end(), strided[1].begin())) {
+        std::cerr << "Error: Strided tiles do not line up with the centre crop." << std::endl;
+        return false;
+    }
+
+    try {
+        CLIPpreprocessor::encode_tiles(wide, CLIPpreprocessor::Tiling::strided(100, 50), tiles);
+        std::cerr << "Error: Short side below the input size was accepted." << std::endl;
+        return false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    // Grids without tiles are rejected rather than encoded to an empty batch
+    for (auto empty : {CLIPpreprocessor::Tiling::grid(0, 2), CLIPpreprocessor::Tiling::grid(3, 0),
+                       CLIPpreprocessor::Tiling::grid(-1, 1)}) {
+        try {
+            CLIPpreprocessor::encode_tiles(wide, empty, tiles);
+            std::cerr << "Error: A " << empty.columns << "x" << empty.rows << " grid was accepted." << std::endl;
+            return false;
+        } catch (const std::invalid_argument&) {
+        }
+    }
+
+    std::cout << "Tiles are laid out and encoded correctly." << std::endl;
+    return true;
+}
+
 int main() {
     int passed = 0;
     int failed = 0;
@@ -272,6 +734,16 @@ int main() {
     run_test(test_normalization, "Normalization");
     run_test(test_output_range, "OutputRange");
     run_test(test_matches_original_clip, "MatchesOriginalCLIP");
+    run_test(test_resize_tolerance, "ResizeTolerance");
+    run_test(test_encode_image_bytes, "EncodeImageBytes");
+    run_test(test_input_types, "InputTypes");
+    run_test(test_channel_order, "ChannelOrder");
+    run_test(test_encode_batch, "EncodeBatch");
+    run_test(test_resize_plan, "ResizePlan");
+    run_test(test_yuv_and_rgba_inputs, "YuvAndRgbaInputs");
+    run_test(test_npy_round_trip, "NpyRoundTrip");
+    run_test(test_pixel_cache, "PixelCache");
+    run_test(test_tiles, "Tiles");
 
     std::cout << "Test Summary:" << std::endl;
     std::cout << "Passed: " << passed << std::endl;
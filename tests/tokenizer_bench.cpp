@@ -0,0 +1,289 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <regex>
+#include <cctype>
+#include "../src/inference/tokenizer.hpp"
+#include "../src/inference/pretokenizer.hpp"
+
+/**
+ * Tokenizer throughput benchmark.
+ *
+ * Usage: ./tokenizer_bench [--corpus <tsv>] [--reference <txt>] [--vocab <path>]
+ *                          [--threads <n>] [--iterations <n>]
+ *
+ * The corpus holds `<category>\t<text>` lines (short prompts, long captions,
+ * non-ASCII text); the reference holds the ids of each line, written by
+ * scripts/gen_tokenizer_reference.py. The bundled reference came from the
+ * script's standard-library port of OpenAI's tokenizer, not from the `clip`
+ * package itself, so it is a second implementation rather than an
+ * independent oracle; regenerate it with `clip` installed to check against
+ * OpenAI's code. Every run first checks
+ * encode() against the reference and exits non-zero on any difference, then
+ * times the pre-tokenizer split alone (pieces/s) next to the std::regex
+ * split it replaced, and encode, encode_text and decode per string on one
+ * thread and on --threads threads, with the BPE cache cold and warm.
+ */
+
+struct Sample {
+    std::string         category;
+    std::string         text;
+    std::vector<int>    reference;
+};
+
+struct Result {
+    std::vector<double> latencies_us;   // one per call
+    size_t              tokens {0};
+    double              wall_s {0.0};
+};
+
+static std::vector<Sample> load_corpus(const std::string& corpus_path, const std::string& reference_path) {
+    std::ifstream corpus(corpus_path);
+    std::ifstream reference(reference_path);
+    if (!corpus || !reference) {
+        throw std::runtime_error("Error opening " + (corpus ? reference_path : corpus_path));
+    }
+
+    std::vector<Sample> samples;
+    std::string line;
+    std::string ids;
+    while (std::getline(corpus, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || !std::getline(reference, ids)) {
+            throw std::runtime_error("Corpus and reference are out of step at: " + line);
+        }
+
+        Sample sample {line.substr(0, tab), line.substr(tab + 1), {}};
+        std::istringstream stream(ids);
+        for (int id; stream >> id;) {
+            sample.reference.push_back(id);
+        }
+        samples.push_back(std::move(sample));
+    }
+    return samples;
+}
+
+/**
+ * Compare fresh encodings against the reference ids
+ *
+ * @returns int: number of mismatching lines
+ */
+static int check_parity(const CLIPTokenizer& tokenizer, const std::vector<Sample>& samples) {
+    int mismatches = 0;
+    for (const auto& sample : samples) {
+        std::vector<int> tokens = tokenizer.encode(sample.text);
+        if (tokens != sample.reference) {
+            if (++mismatches <= 5) {
+                std::cerr << "Mismatch [" << sample.category << "] \"" << sample.text << "\"\n  got:     ";
+                for (int id : tokens) std::cerr << id << " ";
+                std::cerr << "\n  expected:";
+                for (int id : sample.reference) std::cerr << " " << id;
+                std::cerr << std::endl;
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Run `op` over every selected sample `iterations` times on `threads` threads,
+ * timing each call. `op` returns the number of tokens it handled.
+ */
+static Result run(const std::vector<const Sample*>& samples, int threads, int iterations,
+                  const std::function<size_t(const Sample&)>& op) {
+    std::vector<Result> partial(threads);
+    auto worker = [&](int t) {
+        Result& result = partial[t];
+        result.latencies_us.reserve(samples.size() * iterations);
+        for (int it = 0; it < iterations; ++it) {
+            // Threads start at different offsets so they do not run in lockstep
+            for (size_t k = 0; k < samples.size(); ++k) {
+                const Sample& sample = *samples[(k + t * 7) % samples.size()];
+                auto start = std::chrono::steady_clock::now();
+                result.tokens += op(sample);
+                result.latencies_us.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) {
+        pool.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    Result total;
+    total.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto& result : partial) {
+        total.tokens += result.tokens;
+        total.latencies_us.insert(total.latencies_us.end(), result.latencies_us.begin(), result.latencies_us.end());
+    }
+    return total;
+}
+
+/**
+ * The split CLIPTokenizer made before PreTokenizer: trim, collapse whitespace
+ * with a regex, lowercase ASCII, then iterate the regex `pat` over the result.
+ * Both regexes are compiled once by the caller, so only matching is timed.
+ * std::regex has no \p{L} or \p{N}, so its pieces differ from the scanner's
+ * on letters and digits; it does the same work per string, which is what
+ * the timing compares.
+ *
+ * @returns size_t: number of pieces
+ */
+static size_t regex_split(const std::string& text, const std::regex& whitespace, const std::regex& pat) {
+    std::string cleaned = text;
+    cleaned.erase(0, cleaned.find_first_not_of(" \t\n\r\f\v"));
+    cleaned.erase(cleaned.find_last_not_of(" \t\n\r\f\v") + 1);
+    cleaned = std::regex_replace(cleaned, whitespace, " ");
+    std::transform(cleaned.begin(), cleaned.end(), cleaned.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    size_t pieces = 0;
+    for (std::sregex_iterator it(cleaned.begin(), cleaned.end(), pat), end; it != end; ++it) {
+        ++pieces;
+    }
+    return pieces;
+}
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t k = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static void report(const std::string& op, const std::string& category, const std::string& mode,
+                   int threads, Result result) {
+    double p50 = percentile(result.latencies_us, 0.50);
+    double p99 = percentile(result.latencies_us, 0.99);
+    std::cout << std::left << std::setw(12) << op << std::setw(11) << category << std::setw(6) << mode
+              << std::right << std::setw(4) << threads
+              << std::setw(14) << std::fixed << std::setprecision(0) << result.tokens / result.wall_s
+              << std::setw(10) << std::setprecision(2) << p50
+              << std::setw(10) << p99 << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string corpus_path = "../assets/tokenizer_corpus.tsv";
+    std::string reference_path = "../assets/tokenizer_reference.txt";
+    std::string vocab_path = "../src/data/bpe_simple_vocab_16e6.txt";
+    int threads = std::max(2u, std::thread::hardware_concurrency());
+    int iterations = 20;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--corpus") corpus_path = argv[i + 1];
+        else if (flag == "--reference") reference_path = argv[i + 1];
+        else if (flag == "--vocab") vocab_path = argv[i + 1];
+        else if (flag == "--threads") threads = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--iterations") iterations = std::max(1, std::stoi(argv[i + 1]));
+        else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        std::vector<Sample> samples = load_corpus(corpus_path, reference_path);
+        auto vocab = BPEVocab::load(vocab_path);
+
+        int mismatches = check_parity(CLIPTokenizer(vocab), samples);
+        std::cout << "Parity: " << samples.size() - mismatches << "/" << samples.size()
+                  << " lines match the reference" << std::endl;
+        if (mismatches) {
+            return 1;
+        }
+
+        const std::regex whitespace(R"(\s+)");
+        const std::regex pat(R"(<\|startoftext\|>|<\|endoftext\|>|'s|'t|'re|'ve|'m|'ll|'d|[\p{L}]+|[\p{N}]|[^\s\p{L}\p{N}]+)",
+                             std::regex::icase);
+
+        std::vector<std::string> categories = {"all"};
+        for (const auto& sample : samples) {
+            if (std::find(categories.begin(), categories.end(), sample.category) == categories.end()) {
+                categories.push_back(sample.category);
+            }
+        }
+
+        std::cout << "\n" << std::left << std::setw(12) << "op" << std::setw(11) << "category"
+                  << std::setw(6) << "bpe" << std::right << std::setw(4) << "thr"
+                  << std::setw(14) << "tokens/s" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::endl;
+
+        for (const auto& category : categories) {
+            std::vector<const Sample*> selected;
+            for (const auto& sample : samples) {
+                if (category == "all" || sample.category == category) {
+                    selected.push_back(&sample);
+                }
+            }
+
+            for (int thread_count : {1, threads}) {
+                // split only: normalisation and pre-tokenization, no BPE
+                Result scanned = run(selected, thread_count, iterations, [](const Sample& s) {
+                    thread_local std::string buffer;
+                    thread_local std::vector<std::string_view> pieces;
+                    PreTokenizer::split(s.text, buffer, pieces);
+                    return pieces.size();
+                });
+                Result regexed = run(selected, thread_count, iterations, [&](const Sample& s) {
+                    return regex_split(s.text, whitespace, pat);
+                });
+                double speedup = regexed.wall_s / scanned.wall_s;
+                report("pretokenize", category, "-", thread_count, scanned);
+                report("regex_split", category, "-", thread_count, regexed);
+                std::cout << "  split speedup over std::regex: " << std::setprecision(1) << speedup << "x"
+                          << std::endl;
+
+                // cold: every piece goes through the merge loop
+                CLIPTokenizer cold(vocab, BPECache::Config{0});
+                report("encode", category, "cold", thread_count,
+                       run(selected, thread_count, iterations,
+                           [&](const Sample& s) { return cold.encode(s.text).size(); }));
+
+                // warm: cache (and word table, if compiled) as in production
+                CLIPTokenizer warm(vocab_path);
+                report("encode", category, "warm", thread_count,
+                       run(selected, thread_count, iterations,
+                           [&](const Sample& s) { return warm.encode(s.text).size(); }));
+                report("encode_text", category, "warm", thread_count,
+                       run(selected, thread_count, iterations,
+                           [&](const Sample& s) { warm.encode_text(s.text, 77, true); return s.reference.size(); }));
+                report("decode", category, "-", thread_count,
+                       run(selected, thread_count, iterations,
+                           [&](const Sample& s) { warm.decode(s.reference); return s.reference.size(); }));
+
+                if (category == "all") {
+                    BPECache::Stats stats = warm.cache_stats();
+                    std::cout << "  cache: hit rate " << std::setprecision(4) << stats.hit_rate()
+                              << " (" << stats.hits << " hits, " << stats.misses << " misses, "
+                              << stats.evictions << " evictions, " << stats.entries << " entries), word table "
+                              << (warm.word_table() ? std::to_string(warm.word_table()->size()) + " words" : "absent")
+                              << std::endl;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
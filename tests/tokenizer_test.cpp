@@ -1,7 +1,17 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <chrono>
 #include "../src/inference/tokenizer.hpp"
+#include "../src/inference/pretokenizer.hpp"
+#include "../src/inference/bpe_vocab.hpp"
+#include "../src/inference/text_embedding_cache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
 
 bool test_basic_tokenization() {
     std::cout << "=== Running test: BasicTokenization ===" << std::endl;
@@ -31,13 +41,13 @@ bool test_special_tokens() {
     std::string text = "Test";
     std::vector<int> tokens = tokenizer.encode_text(text, 77, true);
 
-    int start_token = tokenizer.encoder.at("<|startoftext|>");
+    int start_token = tokenizer.vocab().at("<|startoftext|>");
     if (tokens.empty() || tokens[0] != start_token) {
         std::cerr << "Error: First token is not <|startoftext|>." << std::endl;
         return false;
     }
 
-    int end_token = tokenizer.encoder.at("<|endoftext|>");
+    int end_token = tokenizer.vocab().at("<|endoftext|>");
     bool found_eot = false;
     for (int token : tokens) {
         if (token == end_token) {
@@ -142,6 +152,511 @@ bool test_case_sensitivity() {
     return true;
 }
 
+bool test_bpe_merges_whole_words() {
+    std::cout << "=== Running test: BPEMergesWholeWords ===" << std::endl;
+    CLIPTokenizer tokenizer("../src/data/bpe_simple_vocab_16e6.txt");
+
+    // Common words are single entries in the vocabulary, so a correct merge
+    // loop must reduce each of them to exactly one token
+    std::vector<std::string> words = {"cat", "dog", "hello", "world", "testing", "photo", "between"};
+    for (const auto& word : words) {
+        std::vector<int> tokens = tokenizer.encode(word);
+        if (tokens.size() != 1 || tokens[0] != tokenizer.vocab().at(word + "</w>")) {
+            std::cerr << "Error: \"" << word << "\" was not merged to a single token, got "
+                      << tokens.size() << " tokens." << std::endl;
+            return false;
+        }
+    }
+
+    // Encoding the same text twice must give identical ids (second pass is cached)
+    std::string text = "a photo of a dog between two cats";
+    if (tokenizer.encode(text) != tokenizer.encode(text)) {
+        std::cerr << "Error: Cached encoding differs from first encoding." << std::endl;
+        return false;
+    }
+
+    std::cout << "BPE merges produce whole-word tokens." << std::endl;
+    return true;
+}
+
+bool test_pretokenizer_pieces() {
+    std::cout << "=== Running test: PreTokenizerPieces ===" << std::endl;
+    std::string buffer;
+    std::vector<std::string_view> pieces;
+
+    struct Case {
+        std::string                 text;
+        std::vector<std::string>    expected;
+    };
+    std::vector<Case> cases = {
+        {"  It's a <|endoftext|> TEST!!  12 ", {"it", "'s", "a", "<|endoftext|>", "test", "!!", "1", "2"}},
+        {"we'll\tsee\n\nthem", {"we", "'ll", "see", "them"}},
+        {"!<|startoftext|>", {"!<|", "startoftext", "|>"}},
+        {"Caf\xC3\xA9 \xC3\x9C\xC3\x9F" "er", {"caf\xC3\xA9", "\xC3\xBC\xC3\x9F" "er"}},
+        {"\xCE\x9F\xCE\x94\xCE\x9F\xCE\xA3", {"\xCE\xBF\xCE\xB4\xCE\xBF\xCF\x82"}},
+        {"\xE4\xB8\xAD\xE6\x96\x87\xEF\xBC\x8C\xD9\xA3", {"\xE4\xB8\xAD\xE6\x96\x87", "\xEF\xBC\x8C", "\xD9\xA3"}},
+        {"   ", {}},
+    };
+
+    for (const auto& c : cases) {
+        PreTokenizer::split(c.text, buffer, pieces);
+        std::vector<std::string> got(pieces.begin(), pieces.end());
+        if (got != c.expected) {
+            std::cerr << "Error: Unexpected pieces for \"" << c.text << "\":";
+            for (const auto& piece : got) {
+                std::cerr << " [" << piece << "]";
+            }
+            std::cerr << std::endl;
+            return false;
+        }
+    }
+
+    PreTokenizer::split("  Multiple    SPACES  ", buffer, pieces);
+    if (buffer != "multiple spaces") {
+        std::cerr << "Error: Normalised text is \"" << buffer << "\"." << std::endl;
+        return false;
+    }
+
+    std::cout << "Pre-tokenizer pieces match the CLIP split pattern." << std::endl;
+    return true;
+}
+
+bool test_pretokenizer_mixed_text() {
+    std::cout << "=== Running test: PreTokenizerMixedText ===" << std::endl;
+    std::string text;
+    for (int i = 0; i < 2000; ++i) {
+        text += "A photo of a Dog's   toy, taken in 2019!  Caf\xC3\xA9 \xE4\xB8\xAD\xE6\x96\x87 ";
+    }
+
+    // Every repetition splits the same way, whatever the text around it
+    const std::vector<std::string> expected = {
+        "a", "photo", "of", "a", "dog", "'s", "toy", ",", "taken", "in", "2", "0", "1", "9", "!",
+        "caf\xC3\xA9", "\xE4\xB8\xAD\xE6\x96\x87",
+    };
+    std::string buffer;
+    std::vector<std::string_view> pieces;
+    PreTokenizer::split(text, buffer, pieces);
+
+    if (pieces.size() != expected.size() * 2000) {
+        std::cerr << "Error: " << pieces.size() << " pieces, expected " << expected.size() * 2000 << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        if (pieces[i] != expected[i % expected.size()]) {
+            std::cerr << "Error: Piece " << i << " is [" << pieces[i] << "], expected ["
+                      << expected[i % expected.size()] << "]" << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Mixed text splits into the expected " << pieces.size() << " pieces." << std::endl;
+    return true;
+}
+
+bool test_compiled_vocab() {
+    std::cout << "=== Running test: CompiledVocab ===" << std::endl;
+    const std::string compiled_path = "tokenizer_test_vocab.bin";
+
+    // Parse the shipped .txt.gz directly and compile it
+    auto parsed = BPEVocab::from_merges("../src/data/bpe_simple_vocab_16e6.txt.gz");
+    parsed->save(compiled_path);
+
+    auto start = std::chrono::steady_clock::now();
+    auto mapped = BPEVocab::from_compiled(compiled_path);
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "Compiled vocab mapped in " << ms << " ms" << std::endl;
+
+    if (!mapped->is_mapped() || mapped->size() != 49408 || mapped->merges().size() != parsed->merges().size()) {
+        std::cerr << "Error: Compiled vocab has " << mapped->size() << " tokens." << std::endl;
+        std::remove(compiled_path.c_str());
+        return false;
+    }
+
+    CLIPTokenizer from_text("../src/data/bpe_simple_vocab_16e6.txt");
+    CLIPTokenizer from_compiled(mapped);
+    std::string text = "A photo of a Caf\xC3\xA9 with 2 dogs, it's <|endoftext|> cute!";
+    bool same = from_text.encode_text(text) == from_compiled.encode_text(text);
+
+    // Corrupt contents, not just sizes, are rejected on load. Header fields
+    // at their offsets in BPEVocab::Header
+    std::vector<char> image;
+    {
+        std::ifstream file(compiled_path, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    std::remove(compiled_path.c_str());
+    auto field = [&](size_t pos) -> uint64_t {
+        uint64_t value = 0;
+        std::memcpy(&value, image.data() + pos, pos == 20 ? 4 : 8);
+        return value;
+    };
+    const uint64_t merge_capacity = field(24), offsets_pos = field(32), merges_pos = field(48);
+    size_t used_slot = merges_pos;
+    while (field(used_slot) == MergeTable::EMPTY_KEY) {
+        used_slot += sizeof(MergeTable::Entry);
+    }
+
+    const std::string corrupt_path = "tokenizer_test_corrupt.bin";
+    auto rejects = [&](size_t pos, uint32_t value) {
+        std::vector<char> corrupt = image;
+        std::memcpy(corrupt.data() + pos, &value, sizeof(value));
+        std::ofstream(corrupt_path, std::ios::binary).write(corrupt.data(), corrupt.size());
+        bool rejected = false;
+        try {
+            BPEVocab::from_compiled(corrupt_path);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        std::remove(corrupt_path.c_str());
+        return rejected;
+    };
+    uint32_t offset2;
+    std::memcpy(&offset2, image.data() + offsets_pos + 2 * sizeof(uint32_t), sizeof(offset2));
+    bool rejected = rejects(20, static_cast<uint32_t>(merge_capacity)) &&          // merge_count: full table
+                    rejects(20, static_cast<uint32_t>(field(20) - 1)) &&           // merge_count: off by one
+                    rejects(used_slot + 12, 49408) &&                              // Entry::merged past the vocab
+                    rejects(offsets_pos + sizeof(uint32_t), offset2 + 1);          // offsets[1] > offsets[2]
+
+    if (!same) {
+        std::cerr << "Error: Compiled vocab encodes differently from the merges file." << std::endl;
+        return false;
+    }
+    if (!rejected) {
+        std::cerr << "Error: A corrupt compiled vocab was accepted." << std::endl;
+        return false;
+    }
+
+    std::cout << "Compiled vocab matches the merges file." << std::endl;
+    return true;
+}
+
+bool test_bpe_cache_bounded() {
+    std::cout << "=== Running test: BPECacheBounded ===" << std::endl;
+    auto vocab = BPEVocab::load("../src/data/bpe_simple_vocab_16e6.txt");
+
+    BPECache::Config small;
+    small.max_entries = 8;
+    CLIPTokenizer cached(vocab, small);
+
+    BPECache::Config disabled;
+    disabled.max_entries = 0;
+    CLIPTokenizer uncached(vocab, disabled);
+
+    std::string text = "the quick brown fox jumps over the lazy dog while a cat watches the fox";
+    for (int i = 0; i < 3; ++i) {
+        if (cached.encode(text) != uncached.encode(text)) {
+            std::cerr << "Error: Cached and uncached encodings differ." << std::endl;
+            return false;
+        }
+    }
+
+    BPECache::Stats stats = cached.cache_stats();
+    std::cout << "hits " << stats.hits << ", misses " << stats.misses << ", evictions "
+              << stats.evictions << ", entries " << stats.entries << std::endl;
+    if (stats.entries > small.max_entries || stats.evictions == 0 || stats.hits == 0) {
+        std::cerr << "Error: Cache did not stay within its budget." << std::endl;
+        return false;
+    }
+    if (uncached.cache_stats().entries != 0) {
+        std::cerr << "Error: Disabled cache stored entries." << std::endl;
+        return false;
+    }
+
+    std::cout << "BPE cache respects its entry budget." << std::endl;
+    return true;
+}
+
+bool test_concurrent_encode() {
+    std::cout << "=== Running test: ConcurrentEncode ===" << std::endl;
+    auto vocab = BPEVocab::load("../src/data/bpe_simple_vocab_16e6.txt");
+    CLIPTokenizer tokenizer(vocab);
+
+    std::vector<std::string> texts = {
+        "a photo of a dog", "a diagram", "an oil painting of a lighthouse at night",
+        "Caf\xC3\xA9 au lait, s'il vous pla\xC3\xAEt", "12 apples and 7 oranges",
+    };
+    std::vector<std::vector<int>> expected;
+    {
+        BPECache::Config disabled;
+        disabled.max_entries = 0;
+        CLIPTokenizer reference(vocab, disabled);
+        for (const auto& text : texts) {
+            expected.push_back(reference.encode_text(text));
+        }
+    }
+
+    std::atomic<int> mismatches {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 200; ++i) {
+                size_t k = (i + t) % texts.size();
+                if (tokenizer.encode_text(texts[k]) != expected[k]) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (mismatches != 0) {
+        std::cerr << "Error: " << mismatches << " concurrent encodings differ." << std::endl;
+        return false;
+    }
+
+    std::cout << "Concurrent encoding is consistent, cache hit rate "
+              << tokenizer.cache_stats().hit_rate() << std::endl;
+    return true;
+}
+
+bool test_encode_batch() {
+    std::cout << "=== Running test: EncodeBatch ===" << std::endl;
+    CLIPTokenizer tokenizer("../src/data/bpe_simple_vocab_16e6.txt");
+    const int context_length = 77;
+
+    std::vector<std::string> texts;
+    std::vector<std::string> words = {"a", "photo", "of", "the", "lighthouse", "Caf\xC3\xA9", "42", "it's", "!!"};
+    for (int i = 0; i < 1000; ++i) {
+        std::string text;
+        for (int w = 0; w < 1 + (i * 7) % 60; ++w) {
+            text += words[(i + w * 3) % words.size()] + " ";
+        }
+        texts.push_back(text);
+    }
+    std::vector<std::string_view> views(texts.begin(), texts.end());
+
+    for (int threads : {1, 4}) {
+        ThreadPool pool(threads);
+        std::vector<int64_t> batch(texts.size() * context_length, -1);
+        std::vector<int> lengths = tokenizer.encode_batch(views, batch.data(), context_length, pool);
+
+        for (size_t i = 0; i < texts.size(); ++i) {
+            std::vector<int> expected = tokenizer.encode_text(texts[i], context_length, true);
+            const int64_t* row = batch.data() + i * context_length;
+            if (!std::equal(expected.begin(), expected.end(), row)) {
+                std::cerr << "Error: Row " << i << " differs from encode_text with "
+                          << threads << " threads." << std::endl;
+                return false;
+            }
+            int valid = static_cast<int>(std::find(expected.begin(), expected.end(),
+                                                   tokenizer.vocab().eot_id()) - expected.begin()) + 1;
+            if (lengths[i] != valid) {
+                std::cerr << "Error: Row " << i << " length " << lengths[i] << " != " << valid << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::cout << "Batch encoding matches encode_text." << std::endl;
+    return true;
+}
+
+bool test_word_table() {
+    std::cout << "=== Running test: WordTable ===" << std::endl;
+    const std::string words_path = "tokenizer_test.words.bin";
+    auto vocab = BPEVocab::load("../src/data/bpe_simple_vocab_16e6.txt");
+
+    CLIPTokenizer plain(vocab);
+    std::vector<std::string_view> corpus = {"a lighthousekeeper's zzyzx Caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC"};
+    auto built = plain.build_word_table(corpus);
+    built->save(words_path);
+    auto mapped = WordTable::from_file(words_path, vocab->fingerprint(), vocab->size());
+    std::cout << "Word table holds " << mapped->size() << " words" << std::endl;
+
+    std::vector<int> ids;
+    if (!mapped->is_mapped() || mapped->size() != built->size() || mapped->size() < 30000 ||
+        !mapped->lookup("photo", ids) || !mapped->lookup("zzyzx", ids) || mapped->lookup("qqqqqqqq", ids)) {
+        std::cerr << "Error: Word table is missing words or holds unknown ones." << std::endl;
+        return false;
+    }
+
+    BPECache::Config cache_config;
+    CLIPTokenizer frozen(vocab, cache_config);
+    frozen.set_word_table(mapped);
+    std::vector<std::string> texts = {
+        "A photo of a lighthouse at dusk",
+        "lighthousekeeper's zzyzx notes, 42 pages!",
+        "Caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC unseenwordhere <|endoftext|>",
+    };
+    for (const auto& text : texts) {
+        if (frozen.encode(text) != plain.encode(text)) {
+            std::cerr << "Error: Word table changes the encoding of \"" << text << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    // Only the word outside the table and corpus should reach the merge loop
+    BPECache::Stats stats = frozen.cache_stats();
+    if (stats.misses != 1) {
+        std::cerr << "Error: " << stats.misses << " words missed the word table." << std::endl;
+        return false;
+    }
+
+    // A table is tied to the vocab it was built from
+    bool rejected = false;
+    try {
+        WordTable::from_file(words_path, BPEVocab::Fingerprint {vocab->fingerprint().merge_count, 1}, vocab->size());
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    if (!rejected || mapped->vocab_fingerprint() != vocab->fingerprint()) {
+        std::remove(words_path.c_str());
+        std::cerr << "Error: Word table loaded for another vocab." << std::endl;
+        return false;
+    }
+
+    // Corrupt tables are rejected at load instead of hanging or reading out
+    // of bounds in lookup(): ids outside the vocab, and a word count that
+    // does not match the occupied slots (word_count sits at byte 32)
+    auto rejects = [&](const auto& load) {
+        try {
+            load();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    bool unknown_ids = rejects([&] { WordTable::from_file(words_path, vocab->fingerprint(), 256); }) &&
+                       rejects([&] { WordTable::build({{"photo", {vocab->size()}}}, vocab->fingerprint(), vocab->size()); });
+    {
+        std::fstream file(words_path, std::ios::binary | std::ios::in | std::ios::out);
+        uint64_t word_count = built->size() + 1;
+        file.seekp(32);
+        file.write(reinterpret_cast<const char*>(&word_count), sizeof(word_count));
+    }
+    bool miscounted = rejects([&] { WordTable::from_file(words_path, vocab->fingerprint(), vocab->size()); });
+    std::remove(words_path.c_str());
+    if (!unknown_ids || !miscounted) {
+        std::cerr << "Error: Corrupt word table was accepted." << std::endl;
+        return false;
+    }
+
+    // A stale table next to the vocab is skipped, words go through BPE
+    const std::string vocab_path = "tokenizer_test_vocab.bin";
+    const std::string stale_path = WordTable::path_for(vocab_path);
+    vocab->save(vocab_path);
+    WordTable::build({{"photo", {42}}}, BPEVocab::Fingerprint {vocab->fingerprint().merge_count, 1}, vocab->size())
+        ->save(stale_path);
+    CLIPTokenizer stale(vocab_path);
+    built->save(stale_path);
+    CLIPTokenizer fresh(vocab_path);
+    std::remove(vocab_path.c_str());
+    std::remove(stale_path.c_str());
+    if (stale.word_table() || stale.encode("photo") != plain.encode("photo") || !fresh.word_table()) {
+        std::cerr << "Error: Stale word table was used, or a matching one was not." << std::endl;
+        return false;
+    }
+
+    std::cout << "Word table encodings match the merge loop." << std::endl;
+    return true;
+}
+
+bool test_streaming_decode() {
+    std::cout << "=== Running test: StreamingDecode ===" << std::endl;
+    CLIPTokenizer tokenizer("../src/data/bpe_simple_vocab_16e6.txt");
+    std::vector<int> tokens = tokenizer.encode("Hello,  World! Caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC");
+
+    std::string expected = "hello , world ! caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC ";
+    std::string decoded = tokenizer.decode(tokens);
+    if (decoded != expected) {
+        std::cerr << "Error: Decoded \"" << decoded << "\" instead of \"" << expected << "\"" << std::endl;
+        return false;
+    }
+
+    // Appending into an existing buffer and writing through an iterator
+    std::string buffer = ">";
+    tokenizer.decode_into(tokens, buffer);
+    char raw[64] = {};
+    char* end = tokenizer.decode_to(tokens, raw);
+    if (buffer != ">" + expected || std::string(raw, end) != expected) {
+        std::cerr << "Error: Streaming decode differs from decode()." << std::endl;
+        return false;
+    }
+
+    // A lone lead byte is replaced like Python's errors="replace"
+    std::vector<int> partial = {tokenizer.vocab().byte_id(0xC3), tokenizer.vocab().at("a</w>")};
+    if (tokenizer.decode(partial) != "\xEF\xBF\xBD" "a ") {
+        std::cerr << "Error: Invalid UTF-8 was not replaced." << std::endl;
+        return false;
+    }
+
+    std::cout << "Streaming decode matches decode()." << std::endl;
+    return true;
+}
+
+bool test_text_embedding_cache() {
+    std::cout << "=== Running test: TextEmbeddingCache ===" << std::endl;
+    const size_t dim = 512;
+    const std::string snapshot = "text_embedding_cache_test.bin";
+    CLIPTokenizer tokenizer("../src/data/bpe_simple_vocab_16e6.txt");
+
+    // Prompts the tokenizer cannot tell apart share a key, other models do not
+    std::string a, b, c;
+    TextEmbeddingCache::key("ViT-B/32", "  A Photo\tof a  DOG ", a);
+    TextEmbeddingCache::key("ViT-B/32", "a photo of a dog", b);
+    TextEmbeddingCache::key("RN50", "a photo of a dog", c);
+    if (a != b || b == c || tokenizer.encode("  A Photo\tof a  DOG ") != tokenizer.encode("a photo of a dog")) {
+        std::cerr << "Error: Unexpected cache key normalization." << std::endl;
+        return false;
+    }
+
+    // 1 MB in one shard holds a few hundred 512-float embeddings
+    TextEmbeddingCache::Config config;
+    config.max_bytes = 1 << 20;
+    config.shards = 1;
+    TextEmbeddingCache cache(config);
+    std::vector<std::string> keys;
+    std::vector<float> embedding(dim), out(dim);
+    for (int i = 0; i < 1000; ++i) {
+        keys.emplace_back();
+        TextEmbeddingCache::key("ViT-B/32", "a photo of a " + std::to_string(i), keys.back());
+        std::fill(embedding.begin(), embedding.end(), static_cast<float>(i));
+        cache.insert(keys.back(), embedding.data(), dim);
+    }
+
+    TextEmbeddingCache::Stats stats = cache.stats();
+    if (stats.bytes > config.max_bytes || stats.evictions == 0 || stats.entries + stats.evictions != 1000 ||
+        cache.lookup(keys[0], out.data(), dim) || !cache.lookup(keys[999], out.data(), dim) || out[0] != 999.0f ||
+        cache.lookup(keys[999], out.data(), dim / 2)) {
+        std::cerr << "Error: Cache exceeded its budget or evicted the wrong entries." << std::endl;
+        return false;
+    }
+
+    // The snapshot restores entries and recency; a smaller cache keeps the newest
+    cache.lookup(keys[stats.evictions], out.data(), dim);  // oldest entry becomes the newest
+    cache.save(snapshot);
+    TextEmbeddingCache restored(config);
+    config.max_bytes = 1 << 16;
+    TextEmbeddingCache small(config);
+    if (restored.load(snapshot) != stats.entries || small.load(snapshot) != stats.entries ||
+        restored.stats().entries != stats.entries || !restored.lookup(keys[900], out.data(), dim) ||
+        out[dim - 1] != 900.0f || !small.lookup(keys[stats.evictions], out.data(), dim) ||
+        small.lookup(keys[stats.evictions + 1], out.data(), dim)) {
+        std::cerr << "Error: Snapshot did not round-trip." << std::endl;
+        return false;
+    }
+
+    // Foreign and truncated files are rejected
+    std::filesystem::resize_file(snapshot, std::filesystem::file_size(snapshot) - 7);
+    bool rejected = false;
+    try {
+        restored.load(snapshot);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    std::remove(snapshot.c_str());
+    if (!rejected) {
+        std::cerr << "Error: Truncated snapshot was accepted." << std::endl;
+        return false;
+    }
+
+    std::cout << stats.entries << " entries in " << stats.bytes << " bytes survive a snapshot." << std::endl;
+    return true;
+}
+
 int main() {
     int passed = 0;
     int failed = 0;
@@ -164,6 +679,16 @@ int main() {
     run_test(test_bpe_function, "BPEFunction");
     run_test(test_whitespace_handling, "WhitespaceHandling");
     run_test(test_case_sensitivity, "CaseSensitivity");
+    run_test(test_bpe_merges_whole_words, "BPEMergesWholeWords");
+    run_test(test_pretokenizer_pieces, "PreTokenizerPieces");
+    run_test(test_pretokenizer_mixed_text, "PreTokenizerMixedText");
+    run_test(test_compiled_vocab, "CompiledVocab");
+    run_test(test_bpe_cache_bounded, "BPECacheBounded");
+    run_test(test_concurrent_encode, "ConcurrentEncode");
+    run_test(test_encode_batch, "EncodeBatch");
+    run_test(test_word_table, "WordTable");
+    run_test(test_streaming_decode, "StreamingDecode");
+    run_test(test_text_embedding_cache, "TextEmbeddingCache");
 
     std::cout << "Test Summary:" << std::endl;
     std::cout << "Passed: " << passed << std::endl;